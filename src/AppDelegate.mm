@@ -17,6 +17,7 @@
 #include "neovim.hpp"
 
 os_log_t rpc;
+os_log_t latency;
 
 /// Returns true if one or more windows contain unsaved changes, otherwise false.
 static bool hasUnsavedChanges(NSArray<NVWindowController*> *windows) {
@@ -150,16 +151,21 @@ static NVWindowController* openWith(NSArray<NVWindowController*> *windows,
 
     signal(SIGPIPE, SIG_IGN);
     rpc = os_log_create("io.github.jaysandhu.neovim-mac", "RPC");
+    latency = os_log_create("io.github.jaysandhu.neovim-mac", "Latency");
     
     NVRenderContextOptions options;
     options.rasterizerWidth = 512;
     options.rasterizerHeight = 512;
+    options.rasterizerPoolSize = 2;
     options.cachePageWidth = 1024;
     options.cachePageHeight = 1024;
     options.cacheGrowthFactor = 1.5;
     options.cacheInitialCapacity = 1;
     options.cacheEvictionThreshold = 8;
     options.cacheEvictionPreserve = 2;
+    options.colorIndependentGlyphs = false;
+    options.glyphDilationBuckets = 4;
+    options.glyphArchiveSize = 32 * 1024 * 1024;
 
     contextManager = [[NVRenderContextManager alloc] initWithOptions:options delegate:self];
 }
@@ -32,17 +32,33 @@ NS_ASSUME_NONNULL_BEGIN
 /// screen displaying the view.
 @property (nonatomic) NVRenderContext *renderContext;
 
-/// The view's grid.
-/// Setting a grid will cause the view to redraw itself. It will also reset
-/// the cursor blink loop. When the grid size changes the result of
+/// The view's grids.
+/// Setting the grids will cause the view to redraw itself. It will also reset
+/// the cursor blink loop. When the global grid size changes the result of
 /// - [desiredFrameSize:] changes accordingly.
-@property (nonatomic) const nvim::grid *grid;
+@property (nonatomic) const nvim::grid_set *grids;
+
+/// The global grid of the view's grids.
+@property (nonatomic, readonly) const nvim::grid *grid;
 
 /// The view's font family.
 /// The view's scale factor is also set by the font's scale factor. Changing a
 /// view's font may cause the view's cell size to change.
 @property (nonatomic) const font_family &font;
 
+/// Animate window scrolls. Scrolls are animated by translating what's already
+/// been rendered, so animation frames don't re-encode any rows.
+@property (nonatomic) BOOL smoothScrolling;
+
+/// Set while the view's window is occluded. Occluded views don't render and
+/// don't blink the cursor, redraws just mark the view as needing display. Once
+/// the view is no longer occluded, it renders a single up to date frame.
+@property (nonatomic) BOOL occluded;
+
+/// Sets the latency tracker. Once set, the view reports when frames are
+/// presented, and the render context's glyph cache counters.
+- (void)setLatencyTracker:(std::shared_ptr<latency_tracker>)tracker;
+
 /// Returns the size of a single width cell.
 - (NSSize)cellSize;
 
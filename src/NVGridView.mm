@@ -10,223 +10,217 @@
 #import <QuartzCore/CAMetalLayer.h>
 #import <Metal/Metal.h>
 #import "NVGridView.h"
+#include <cmath>
+#include "frame_ring.hpp"
+#include "log.h"
 #include "shader_types.hpp"
 
-/// Utility class to help manage Metal buffers.
-/// The class provides two additional abstractions over a MTLBuffer:
-///   1. A low overhead locking mechanism.
-///   2. A means to coalesce multiple allocations into a single MTLBuffer.
-class mtlbuffer {
-private:
-    id<MTLDevice> buffer_device;
+/// A grid's rows encoded into the render context's frame ring.
+///
+/// Only the rows that need to be rendered into the grid's texture are encoded.
+/// Each row owns a fixed region of the background buffer. The encoded rows'
+/// glyphs and lines are packed one after another, so their buffers are sized
+/// by what was actually encoded, and each is drawn with a single draw call.
+struct encoded_grid {
     id<MTLBuffer> buffer;
-    char *ptr;
-    size_t length;
-    size_t capacity;
-    std::atomic_flag in_use;
-
-    static constexpr size_t align_up(size_t val, size_t alignment) {
-        return (val + alignment - 1) & -alignment;
-    }
+    size_t backgroundOffset;
+    size_t glyphOffset;
+    size_t lineOffset;
+    size_t glyphCount;
+    size_t lineCount;
+    std::vector<bool> encodedRows;
+    std::vector<nvim::grid_scroll_record> scrolls;
+    bool full;
+    bool visible;
+
+    encoded_grid(): buffer(nil), backgroundOffset(0), glyphOffset(0), lineOffset(0),
+                    glyphCount(0), lineCount(0), full(false), visible(false) {}
+};
 
-public:
-    /// A region of the underlying MTLBuffer's memory.
-    struct region {
-        void *ptr;      ///< Pointer to the start of the region.
-        size_t offset;  ///< The regions offset in the underlying MTLBuffer.
-    };
+/// The runs a cell's lines can be merged into, as indices into a line_data
+/// vector. Underlines and undercurls share a run, they're mutually exclusive.
+struct line_runs {
+    size_t emphasis = SIZE_MAX;
+    size_t strikethrough = SIZE_MAX;
+};
 
-    /// Constructs an empty mtlbuffer.
-    mtlbuffer() {
-        buffer_device = nil;
-        buffer = nil;
-        ptr = nullptr;
-        length = 0;
-        capacity = 0;
-    }
-
-    /// Creates the underlying MTLBuffer.
-    ///
-    /// @param device   The new buffers device.
-    /// @param size     The size of the buffer in bytes.
-    ///
-    /// If the existing buffer is on the same device, and is of sufficient
-    /// length, it is reused. Otherwise a new buffer is allocated and the
-    /// existing buffer is freed. Calling this function invalidates any
-    /// previously allocated memory regions.
-    void create(id<MTLDevice> device, size_t size) {
-        length = 0;
-
-        if (buffer_device != device) {
-            buffer_device = device;
-            size = std::max(1048576ul, align_up(size, 8));
-        } else if (size <= capacity) {
+/// Appends a single cell line at position to lines. If the line at index run
+/// ends just before position, and has the same highlight and metrics, it's
+/// extended instead. Afterwards, run is the index of the line covering position.
+static void appendLine(std::vector<line_data> &lines, size_t &run,
+                       simd_short2 position, uint16_t highlight,
+                       line_metrics metrics, uint16_t count) {
+    if (run < lines.size()) {
+        line_data &line = lines[run];
+
+        if (line.highlight == highlight &&
+            line.ytranslate == metrics.ytranslate &&
+            line.period == metrics.period &&
+            line.thickness == metrics.thickness &&
+            line.grid_position.y == position.y &&
+            line.grid_position.x + line.width == position.x) {
+            line.width += 1;
             return;
         }
-
-        buffer = [device newBufferWithLength:size
-                                     options:MTLResourceStorageModeManaged |
-                                             MTLResourceCPUCacheModeWriteCombined];
-
-        ptr = static_cast<char*>([buffer contents]);
-        capacity = size;
-    }
-
-    /// Allocates a region of memory from the underlying MTLBuffer.
-    /// Assumes there is sufficient capacity to carry out the allocation.
-    /// Note: Regions are aligned to 256 byte boundaries, as such this function
-    /// can use up to size + 255 bytes.
-    region allocate(size_t size) {
-        size_t offset = length;
-        length = align_up(length + size, 256);
-        assert(length <= capacity);
-        return region{ptr + offset, offset};
     }
 
-    /// Returns the underlying MTLBuffer.
-    id<MTLBuffer> get() const {
-        return buffer;
-    }
+    run = lines.size();
+    lines.push_back(line_data(position, highlight, metrics, count));
+}
 
-    /// Informs the Metal device that the given range has been modified.
-    /// @see -[MTLBuffer didModifyRange] for more information.
-    void update(size_t start, size_t length) {
-        [buffer didModifyRange:NSMakeRange(start, length)];
-    }
+/// A band of rows encoded by one worker.
+///
+/// Encoding a grid with many rows to encode is split into bands, which are
+/// encoded concurrently, each into its own instance vectors. Workers only
+/// look up glyphs that are already cached, glyphs that miss the cache are
+/// recorded and looked up on the main thread once the workers are done,
+/// which may rasterize them.
+struct encode_band {
+    struct missed_glyph {
+        size_t index;
+        simd_short2 gridpos;
+        const nvim::cell *cell;
+        const nvim::cell_attributes *attrs;
+    };
 
-    /// Try to acquire the buffers lock. Returns immediately.
-    ///
-    /// Note: Calling this function in a loop amounts to an inefficient, and
-    /// more importantly, incorrect, spinlock implementation. Don't do it.
-    ///
-    /// @returns True if the lock was acquired successfully, otherwise false.
-    bool try_lock() {
-        return in_use.test_and_set() == false;
+    std::vector<glyph_data> glyphs;
+    std::vector<line_data> lines;
+    std::vector<missed_glyph> missed;
+    glyph_cache_stats stats;
+    size_t rowBegin;
+    size_t rowEnd;
+
+    void clear() {
+        glyphs.clear();
+        lines.clear();
+        missed.clear();
+        stats = {};
     }
+};
 
-    /// Release the buffers lock. May be called from any thread.
-    void unlock() {
-        in_use.clear();
+/// Bands have at least this many cells to encode, smaller grids are encoded
+/// on the calling thread.
+static constexpr size_t minBandCells = 8192;
+
+/// A grid's rendered contents, kept between frames.
+///
+/// Rows are rendered into the front texture when they're written, and the
+/// front texture is drawn into the drawable on every frame. When Neovim
+/// scrolls a grid, the front texture is blitted into the back texture offset
+/// by the scrolled rows, and the two are swapped. This way, only the rows
+/// scrolled into view need to be encoded and rendered.
+///
+/// After a scroll, the back texture holds the grid as it was before the
+/// scroll, which is used to animate the scroll.
+struct grid_texture {
+    id<MTLTexture> front;
+    id<MTLTexture> back;
+    nvim::grid_size size;
+    simd_float2 cellSize;
+    uint64_t drawTick;
+    uint64_t placeholderGeneration;
+    uint64_t paletteGeneration;
+    size_t topline;
+    bool valid;
+    bool visible;
+
+    nvim::grid_scroll_record scroll;
+    CFTimeInterval scrollStart;
+    bool animating;
+
+    grid_texture(): front(nil), back(nil), size{0, 0}, cellSize{0, 0},
+                    drawTick(0), placeholderGeneration(0),
+                    paletteGeneration(0), topline(0),
+                    valid(false), visible(false), scroll{},
+                    scrollStart(0), animating(false) {}
+
+    /// Discard the rendered contents, forcing the next frame to redraw them.
+    void invalidate() {
+        valid = false;
+        animating = false;
     }
 };
 
-/// Adjusts the color attributes of cells under a block cursor.
-class AdjustedGrid {
-private:
-    struct Range {
-        const nvim::cell *begin;
-        int16_t rowBegin;
-        int16_t rowEnd;
-        int16_t colBegin;
-        int16_t colEnd;
-    };
+/// The duration of smooth scroll animations in seconds.
+static constexpr CFTimeInterval smoothScrollDuration = 0.12;
+
+/// Returns a texture that a grid of the given size can be rendered into.
+static id<MTLTexture> newGridTexture(id<MTLDevice> device,
+                                     nvim::grid_size size,
+                                     simd_float2 cellSize) {
+    MTLTextureDescriptor *desc = [[MTLTextureDescriptor alloc] init];
+    desc.textureType = MTLTextureType2D;
+    desc.pixelFormat = MTLPixelFormatBGRA8Unorm_sRGB;
+    desc.width = size.width * cellSize.x;
+    desc.height = size.height * cellSize.y;
+    desc.storageMode = MTLStorageModePrivate;
+    desc.usage = MTLTextureUsageRenderTarget | MTLTextureUsageShaderRead;
+    return [device newTextureWithDescriptor:desc];
+}
 
-    nvim::cell adjustedCells[2];
-    Range ranges[4];
-    size_t rangesCount;
-
-public:
-    AdjustedGrid(const nvim::grid *grid, const nvim::cursor &cursor) {
-        ranges[0].begin = grid->begin();
-        ranges[0].rowBegin = 0;
-        ranges[0].colBegin = 0;
-
-        // If we're not dealing with a block cursor, no adjusments need to be
-        // made. We can iterate the grid in one swoop.
-        if (cursor.shape() != nvim::cursor_shape::block) {
-            rangesCount = 1;
-            ranges[0].rowEnd = grid->height();
-            ranges[0].colEnd = grid->width();
+/// Copies src to dest, moving the rows in the scrolled region as grid_scroll
+/// does. The rows scrolled into view are left as they were in dest.
+static void blitScrolled(id<MTLBlitCommandEncoder> encoder,
+                         id<MTLTexture> src,
+                         id<MTLTexture> dest,
+                         const nvim::grid_scroll_record &scroll,
+                         size_t gridHeight,
+                         size_t rowHeight) {
+    auto copyRows = [&](size_t srcRow, size_t destRow, size_t count) {
+        if (!count) {
             return;
         }
 
-        // We need to adjust the cursor cells.
-        // Grid's are immutable, so we make a copy of the adjusted cells.
-        const nvim::cell *cursorCell = &cursor.cell();
-        size_t cursorWidth = cursor.width();
-
-        adjustedCells[0] = cursorCell[0].recolored(cursor.foreground(),
-                                                   cursor.background(),
-                                                   cursor.special());
-
-        if (cursorWidth == 2) {
-            adjustedCells[1] = cursorCell[1].recolored(cursor.foreground(),
-                                                       cursor.background(),
-                                                       cursor.special());
-        }
-
-        // When iterating over the grid, we need to swap out cursor cells with
-        // our adjusted cells. The iteration order required to do that is
-        // stored in an array of four Range objects.
-        rangesCount = 4;
-
-        // Start with full rows up until the cursor row.
-        ranges[0].rowEnd = cursor.row();
-        ranges[0].colEnd = grid->width();
-
-        // Iterate from the start over the cursor row till the cursor column.
-        ranges[1].begin    = cursorCell - cursor.col();
-        ranges[1].rowBegin = cursor.row();
-        ranges[1].rowEnd   = cursor.row() + 1;
-        ranges[1].colBegin = 0;
-        ranges[1].colEnd   = cursor.col();
-
-        // We're at the cursor cells. Iterate over the adjusted cells instead.
-        ranges[2].begin    = adjustedCells;
-        ranges[2].rowBegin = cursor.row();
-        ranges[2].rowEnd   = cursor.row() + 1;
-        ranges[2].colBegin = cursor.col();
-        ranges[2].colEnd   = cursor.col() + cursorWidth;
-
-        // Start from after the cursor cells and finish off the grid.
-        ranges[3].begin    = cursorCell + cursorWidth;
-        ranges[3].rowBegin = cursor.row();
-        ranges[3].rowEnd   = grid->height();
-        ranges[3].colBegin = cursor.col() + cursorWidth;
-        ranges[3].colEnd   = grid->width();
-    }
-
-    /// Iterate over the cursor adjusted grid.
-    /// Calls the function object callback once for every cell in ascending
-    /// order. The callback is invoked with three arguments:
-    ///   1. The cell's row (int16_t).
-    ///   2. The cell's column (int16_t).
-    ///   3. A const pointer to the cell (const nvim::cell*).
-    /// The return value of the callback is ignored.
-    template<typename Callable>
-    void forEach(Callable callback) {
-        for (size_t i=0; i<rangesCount; ++i) {
-            const Range &range = ranges[i];
-            const nvim::cell *cell = range.begin;
-            int16_t col = range.colBegin;
-
-            for (int16_t row = range.rowBegin; row < range.rowEnd; ++row) {
-                for (; col < range.colEnd; ++col, ++cell) {
-                    callback(row, col, cell);
-                }
+        [encoder copyFromTexture:src
+                     sourceSlice:0
+                     sourceLevel:0
+                    sourceOrigin:MTLOriginMake(0, srcRow * rowHeight, 0)
+                      sourceSize:MTLSizeMake(src.width, count * rowHeight, 1)
+                       toTexture:dest
+                destinationSlice:0
+                destinationLevel:0
+               destinationOrigin:MTLOriginMake(0, destRow * rowHeight, 0)];
+    };
 
-                col = 0;
-            }
-        }
+    const size_t top = scroll.top;
+    const size_t bottom = scroll.bottom;
+    const size_t rows = std::abs(scroll.rows);
+    const size_t moved = (bottom - top) - std::min(rows, bottom - top);
+
+    copyRows(0, 0, top);
+    copyRows(bottom, bottom, gridHeight - bottom);
+
+    if (scroll.rows >= 0) {
+        copyRows(top + rows, top, moved);
+    } else {
+        copyRows(top, top + rows, moved);
     }
-};
+}
 
 @implementation NVGridView {
     CAMetalLayer *metalLayer;
 
     NVRenderContext *renderContext;
     id<MTLDevice> device;
-    id<MTLCommandQueue> commandQueue;
     id<MTLRenderPipelineState> backgroundRenderPipeline;
     id<MTLRenderPipelineState> glyphRenderPipeline;
     id<MTLRenderPipelineState> cursorRenderPipeline;
     id<MTLRenderPipelineState> lineRenderPipeline;
+    id<MTLRenderPipelineState> gridTextureRenderPipeline;
 
     glyph_manager *glyphManager;
+    frame_ring *frameRing;
+    std::shared_ptr<latency_tracker> latencyTracker;
     font_family fontFamily;
-    mtlbuffer buffers[3];
+    std::vector<uint16_t> backgroundScratch;
+    std::vector<encode_band> encodeBands;
+    encode_band cursorScratch;
+    size_t encodeConcurrency;
+    std::unordered_map<size_t, encoded_grid> encodedGrids;
+    std::unordered_map<size_t, grid_texture> gridTextures;
     nvim::cursor cursor;
-    const nvim::grid *grid;
+    const nvim::grid_set *grids;
+    const nvim::grid *cursorGrid;
 
     NSSize backingCellSize;
     simd_float2 cellSize;
@@ -239,8 +233,8 @@ public:
     dispatch_source_t blinkTimer;
     bool blinkTimerActive;
     bool inactive;
-
-    uint64_t frameIndex;
+    bool occluded;
+    bool needsDisplayWhenVisible;
 }
 
 - (instancetype)init {
@@ -252,20 +246,37 @@ public:
     blinkTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
                                         dispatch_get_main_queue());
 
+    encodeConcurrency = std::max<NSUInteger>([[NSProcessInfo processInfo] activeProcessorCount], 1);
+
     dispatch_set_context(blinkTimer, (__bridge void*)self);
+
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(glyphsReady:)
+                                                 name:NVRenderContextGlyphsReadyNotification
+                                               object:nil];
     return self;
 }
 
-- (void)setRenderContext:(NVRenderContext *)context {
-    renderContext            = context;
-    device                   = context.device;
-    commandQueue             = context.commandQueue;
-    backgroundRenderPipeline = context.backgroundRenderPipeline;
-    glyphRenderPipeline      = context.glyphRenderPipeline;
-    cursorRenderPipeline     = context.cursorRenderPipeline;
-    lineRenderPipeline       = context.lineRenderPipeline;
-    glyphManager             = context.glyphManager;
+- (void)glyphsReady:(NSNotification *)notification {
+    if (notification.object == renderContext) {
+        [self setNeedsDisplay:YES];
+    }
+}
 
+- (void)setRenderContext:(NVRenderContext *)context {
+    renderContext             = context;
+    device                    = context.device;
+    backgroundRenderPipeline  = context.backgroundRenderPipeline;
+    glyphRenderPipeline       = context.glyphRenderPipeline;
+    cursorRenderPipeline      = context.cursorRenderPipeline;
+    lineRenderPipeline        = context.lineRenderPipeline;
+    gridTextureRenderPipeline = context.gridTextureRenderPipeline;
+    glyphManager              = context.glyphManager;
+    frameRing                 = context.frameRing;
+
+    // Grid textures and encoded rows belong to the previous device.
+    gridTextures.clear();
+    encodedGrids.clear();
     metalLayer.device = device;
 }
 
@@ -273,6 +284,10 @@ public:
     return renderContext;
 }
 
+- (void)setLatencyTracker:(std::shared_ptr<latency_tracker>)tracker {
+    latencyTracker = std::move(tracker);
+}
+
 - (CALayer*)makeBackingLayer {
     metalLayer = [CAMetalLayer layer];
     metalLayer.delegate = self;
@@ -280,11 +295,27 @@ public:
     metalLayer.allowsNextDrawableTimeout = NO;
     metalLayer.autoresizingMask = kCALayerHeightSizable | kCALayerWidthSizable;
     metalLayer.needsDisplayOnBoundsChange = YES;
-    metalLayer.presentsWithTransaction = YES;
+    metalLayer.presentsWithTransaction = NO;
     return metalLayer;
 }
 
+- (void)viewWillStartLiveResize {
+    [super viewWillStartLiveResize];
+
+    // Frames are normally presented with the render context's batched command
+    // buffer. While live resizing, they're presented with the transaction that
+    // resizes the layer instead, so the window's contents stay in sync.
+    metalLayer.presentsWithTransaction = YES;
+}
+
+- (void)viewDidEndLiveResize {
+    [super viewDidEndLiveResize];
+    metalLayer.presentsWithTransaction = NO;
+}
+
 - (NSSize)desiredFrameSize {
+    const nvim::grid *grid = grids->global_grid();
+
     NSSize frameSize;
     frameSize.width = backingCellSize.width * grid->width();
     frameSize.height = backingCellSize.height * grid->height();
@@ -312,11 +343,12 @@ public:
 static void blinkCursorToggleOff(void *context);
 static void blinkCursorToggleOn(void *context);
 
-- (void)setGrid:(const nvim::grid *)newGrid {
+- (void)setGrids:(const nvim::grid_set *)newGrids {
     [self setNeedsDisplay:YES];
 
-    grid = newGrid;
-    cursor = newGrid->cursor();
+    grids = newGrids;
+    cursor = newGrids->cursor();
+    cursorGrid = newGrids->cursor_grid();
 
     // If we're not the main window:
     //   - The cursor blink loop should have already been stopped.
@@ -327,6 +359,12 @@ static void blinkCursorToggleOn(void *context);
         return;
     }
 
+    // Occluded views don't blink, the blink loop restarts once we're visible.
+    if (occluded) {
+        assert(!blinkTimerActive);
+        return;
+    }
+
     if (cursor.blinks()) {
         auto time = dispatch_time(DISPATCH_TIME_NOW, cursor.blinkwait() * NSEC_PER_MSEC);
 
@@ -343,8 +381,12 @@ static void blinkCursorToggleOn(void *context);
     }
 }
 
+- (const nvim::grid_set *)grids {
+    return grids;
+}
+
 - (const nvim::grid *)grid {
-    return grid;
+    return grids->global_grid();
 }
 
 - (void)setInactive {
@@ -367,10 +409,53 @@ static void blinkCursorToggleOn(void *context);
 - (void)setActive {
     if (inactive) {
         inactive = false;
-        [self setGrid:grid];
+        [self setGrids:grids];
+    }
+}
+
+- (BOOL)occluded {
+    return occluded;
+}
+
+- (void)setOccluded:(BOOL)isOccluded {
+    if (occluded == isOccluded) {
+        return;
+    }
+
+    occluded = isOccluded;
+
+    if (occluded) {
+        if (blinkTimerActive) {
+            dispatch_suspend(blinkTimer);
+            blinkTimerActive = false;
+        }
+
+        return;
+    }
+
+    // Restarts the blink loop, and resets the cursor if it was blinked off.
+    if (grids) {
+        [self setGrids:grids];
+    }
+
+    if (needsDisplayWhenVisible) {
+        needsDisplayWhenVisible = false;
+        [self setNeedsDisplay:YES];
     }
 }
 
+// While occluded, we only remember that we need display. Every redraw, blink,
+// or glyph that becomes ready is picked up by the frame rendered once we're
+// visible again.
+- (void)setNeedsDisplay:(BOOL)needsDisplay {
+    if (occluded && needsDisplay) {
+        needsDisplayWhenVisible = true;
+        return;
+    }
+
+    [super setNeedsDisplay:needsDisplay];
+}
+
 static void blinkCursorToggleOff(void *context) {
     NVGridView *self = (__bridge NVGridView*)context;
 
@@ -441,6 +526,11 @@ static void blinkCursorToggleOn(void *context) {
 
     cursorLineThickness = 1 * font.scale_factor();
     [metalLayer setContentsScale:font.scale_factor()];
+
+    // Rendered grids depend on the font.
+    for (auto &[id, texture] : gridTextures) {
+        texture.invalidate();
+    }
 }
 
 - (const font_family&)font {
@@ -448,102 +538,572 @@ static void blinkCursorToggleOn(void *context) {
 }
 
 - (void)displayLayer:(CALayer*)layer {
-    const CGSize drawableSize = [metalLayer drawableSize];
-    const uint64_t index = frameIndex % 3;
-    mtlbuffer &buffer = buffers[index];
-
-    // If we fail to acquire the buffer, drop this frame and try again on the
-    // next draw loop iteration. This should be rare.
-    if (!buffer.try_lock()) {
-        [self setNeedsDisplay:YES];
+    // Core Animation can still ask occluded layers to display, for example
+    // when they're resized. Defer the frame until it can be seen.
+    if (occluded) {
+        needsDisplayWhenVisible = true;
         return;
     }
 
-    // Allocate enough memory for the worst case scenario, where every cell has
-    // a glyph, a strikethrough, and an underline / undercurl. It takes two
-    // line_data objects to handle a cell with both a strikethrough and an
-    // underline / undercurl.
-    //
-    // We're using a lot of memory to handle our line data, but most grids have
-    // very few lines. Maybe this could be reworked.
-    const size_t gridSize = grid->cells_size();
-    const size_t uniformBufferSize    = sizeof(uniform_data);
-    const size_t backgroundBufferSize = gridSize * sizeof(uint32_t);
-    const size_t glyphBufferSize      = gridSize * sizeof(glyph_data);
-    const size_t lineBufferSize       = gridSize * sizeof(line_data) * 2;
-
-    // Pad to account for over allocations caused by alignment.
-    const size_t bufferSize = (256 * 4) + uniformBufferSize
-                                        + backgroundBufferSize
-                                        + glyphBufferSize
-                                        + lineBufferSize;
-
-    buffer.create(device, bufferSize);
-    auto uniformBuffer    = buffer.allocate(uniformBufferSize);
-    auto backgroundBuffer = buffer.allocate(backgroundBufferSize);
-    auto glyphBuffer      = buffer.allocate(glyphBufferSize);
-    auto lineBuffer       = buffer.allocate(lineBufferSize);
-
-    auto uniforms    = static_cast<uniform_data*>(uniformBuffer.ptr);
-    auto backgrounds = static_cast<uint32_t*>(backgroundBuffer.ptr);
-    auto glyphs      = static_cast<glyph_data*>(glyphBuffer.ptr);
-    auto lines       = static_cast<line_data*>(lineBuffer.ptr);
+    const CGSize drawableSize = [metalLayer drawableSize];
+    const uint64_t tick = grids->tick();
+    const os_signpost_id_t signpost = os_signpost_id_make_with_pointer(latency, (__bridge void*)self);
+    os_signpost_interval_begin(latency, signpost, "Encode", "tick=%llu", tick);
+
+    // Pick up any glyphs that finished rasterizing in the background. This
+    // bumps the placeholder generation, which causes a full redraw below.
+    glyphManager->update();
+
+    // Everything this frame's command buffer reads is allocated from the
+    // render context's frame ring, which is shared with every other view
+    // rendering on the same device.
+    const size_t uniformBufferSize = sizeof(uniform_data);
+    auto uniformBuffer = frameRing->allocate(uniformBufferSize);
+
+    auto uniforms = static_cast<uniform_data*>(uniformBuffer.ptr);
 
     const simd_float2 pixelSize = simd_make_float2(2.0, -2.0) /
                                   simd_make_float2(drawableSize.width, drawableSize.height);
 
+    const nvim::grid_point cursorOrigin = cursorGrid->origin();
+    const int16_t cursorRow = static_cast<int16_t>(cursorOrigin.row + cursor.row());
+    const int16_t cursorCol = static_cast<int16_t>(cursorOrigin.column + cursor.col());
+
     uniforms->pixel_size        = pixelSize;
     uniforms->cell_pixel_size   = cellSize;
     uniforms->cell_size         = cellSize * pixelSize;
     uniforms->baseline          = baselineTranslate;
-    uniforms->grid_width        = static_cast<uint32_t>(grid->width());
-    uniforms->cursor_position   = simd_make_short2(cursor.col(), cursor.row());
+    uniforms->cursor_position   = simd_make_short2(cursorCol, cursorRow);
     uniforms->cursor_color      = cursor.background();
     uniforms->cursor_line_width = cursorLineThickness;
     uniforms->cursor_cell_width = cursor.width();
+    uniforms->palette_size      = static_cast<uint32_t>(grids->palette_size());
 
-    glyph_data *glyphsBegin = glyphs;
-    line_data *linesBegin = lines;
-    simd_short2 undercurlNext = simd_make_short2(-1, -1);
-    uint16_t undercurlPosition = 0;
+    frame_ring::update(uniformBuffer, uniformBufferSize);
 
-    AdjustedGrid(grid, cursor).forEach([&](int16_t row, int16_t col, const nvim::cell *cell) {
-        simd_short2 gridpos = simd_make_short2(col, row);
-        *backgrounds++ = cell->background();
+    // Backgrounds and lines are drawn with highlight IDs, their colors are
+    // looked up in the palette by the shaders. The palette is only needed by
+    // frames that render rows into grid textures, so it's uploaded on demand.
+    frame_ring::region paletteBuffer{};
 
-        if (cell->has_line_emphasis()) {
-            nvim::rgb_color color = cell->special();
+    auto uploadPalette = [&]() {
+        const size_t paletteSize = grids->palette_size();
+        const size_t paletteBufferSize = paletteSize * sizeof(palette_entry);
 
+        paletteBuffer = frameRing->allocate(paletteBufferSize);
+        auto entries = static_cast<palette_entry*>(paletteBuffer.ptr);
+
+        for (size_t hlid=0; hlid<paletteSize; ++hlid) {
+            const nvim::cell_attributes &attrs = grids->highlight(hlid);
+            entries[hlid].background = attrs.background;
+            entries[hlid].special = attrs.special;
+        }
+
+        frame_ring::update(paletteBuffer, paletteBufferSize);
+    };
+
+    const uint64_t paletteGeneration = grids->palette_generation();
+
+    // Encodes a cell's lines and glyph into band. Lines take their color from
+    // the palette entry highlight, and are merged into the runs of the cells
+    // before them where possible. For undercurls, undercurlPosition is the
+    // index of the cell in the overall line.
+    //
+    // Memoized lookups only find cached glyphs, so they're safe to run on
+    // bands concurrently, misses are looked up later by resolveMisses. If
+    // attrs aren't the cell's own attributes, as for the cursor, lookups
+    // aren't memoized. They go straight to the glyph manager, so they must
+    // run on the main thread.
+    auto encodeCell = [&](simd_short2 gridpos, const nvim::cell &cell,
+                          const nvim::cell_attributes &attrs, uint16_t highlight,
+                          bool memoize, uint16_t undercurlPosition,
+                          line_runs &runs, encode_band &band) {
+        if (attrs.has_line_emphasis()) {
             // Undercurls and underlines are mutually exclusive. We'll make
             // undercurls take priority, they usually represent errors,
             // so users won't appreciate them being hidden.
-            if (cell->has_undercurl()) {
-                if (simd_equal(undercurlNext, gridpos)) {
-                    undercurlPosition += 1;
-                } else {
-                    undercurlPosition = 0;
+            if (attrs.has_undercurl()) {
+                appendLine(band.lines, runs.emphasis, gridpos, highlight,
+                           undercurl, undercurlPosition);
+            } else if (attrs.has_underline()) {
+                appendLine(band.lines, runs.emphasis, gridpos, highlight, underline, 0);
+            }
+
+            if (attrs.has_strikethrough()) {
+                appendLine(band.lines, runs.strikethrough, gridpos, highlight,
+                           strikethrough, 0);
+            }
+        }
+
+        if (!cell.empty()) {
+            glyph_rect glyph = {};
+
+            if (memoize) {
+                if (!glyphManager->find(fontFamily, cell, attrs, paletteGeneration,
+                                        glyph, band.stats)) {
+                    band.missed.push_back({band.glyphs.size(), gridpos, &cell, &attrs});
                 }
+            } else {
+                glyph = glyphManager->get(fontFamily.get(attrs.font_attributes()),
+                                          cell, attrs.background, attrs.foreground);
+            }
+
+            band.glyphs.push_back(glyph_data(gridpos, cell.width(), glyph, attrs.foreground));
+        }
+    };
 
-                undercurlNext = simd_make_short2(col + 1, row);
-                *lines++ = line_data(gridpos, color, undercurl, undercurlPosition);
-            } else if (cell->has_underline()) {
-                *lines++ = line_data(gridpos, color, underline);
+    // Looks up the glyphs a band missed, on the main thread.
+    auto resolveMisses = [&](encode_band &band) {
+        for (const encode_band::missed_glyph &miss : band.missed) {
+            glyph_rect glyph = glyphManager->get(fontFamily, *miss.cell, *miss.attrs,
+                                                 paletteGeneration);
+
+            band.glyphs[miss.index] = glyph_data(miss.gridpos, miss.cell->width(),
+                                                 glyph, miss.attrs->foreground);
+        }
+
+        glyphManager->add_stats(band.stats);
+    };
+
+    // Grid textures are the size of their grid, so they're rendered with
+    // their own uniforms.
+    auto textureUniforms = [&](const grid_texture &texture) {
+        uniform_data data = *uniforms;
+        data.pixel_size = simd_make_float2(2.0, -2.0) /
+                          simd_make_float2(texture.front.width, texture.front.height);
+        data.cell_size = cellSize * data.pixel_size;
+        return data;
+    };
+
+    // Works out what needs to be rendered into a grid's texture, and encodes
+    // the rows that need to be redrawn. Rows moved by scrolls since the
+    // texture was last rendered are moved rather than redrawn, so only rows
+    // written since then are encoded. Grids are encoded in their own
+    // coordinates, so moving a window doesn't require redrawing it.
+    auto encodeGrid = [&](const nvim::grid *grid, grid_texture &texture,
+                          encoded_grid &encoded) {
+        const size_t gridWidth = grid->width();
+        const size_t gridHeight = grid->height();
+
+        encoded.scrolls.clear();
+        encoded.encodedRows.assign(gridHeight, false);
+        const uint64_t drawnTick = texture.drawTick;
+
+        if (texture.size != grid->size() || simd_any(texture.cellSize != cellSize)) {
+            texture.front = newGridTexture(device, grid->size(), cellSize);
+            texture.back = nil;
+            texture.size = grid->size();
+            texture.cellSize = cellSize;
+            texture.invalidate();
+        }
+
+        // Textures drawn with placeholder glyphs, or too long ago to replay
+        // the grid's scrolls, are redrawn from scratch.
+        encoded.full = !texture.valid ||
+                       drawnTick < grid->scroll_history() ||
+                       texture.placeholderGeneration != glyphManager->placeholder_generation() ||
+                       texture.paletteGeneration != paletteGeneration;
+
+        // If only the cursor changed, which is always the case when blinking,
+        // there's nothing to do here.
+        if (!encoded.full && drawnTick == grid->tick()) {
+            return;
+        }
+
+        if (encoded.full) {
+            texture.animating = false;
+        } else {
+            for (const nvim::grid_scroll_record &scroll : grid->scrolls()) {
+                if (scroll.tick > drawnTick) {
+                    encoded.scrolls.push_back(scroll);
+                }
+            }
+        }
+
+        // Neovim also scrolls rows to insert and delete lines, but only
+        // scrolls that move the window's viewport are animated.
+        const size_t topline = grid->viewport().topline;
+
+        if (!encoded.scrolls.empty()) {
+            texture.animating = false;
+
+            const nvim::grid_scroll_record &scroll = encoded.scrolls.front();
+            const int32_t scrollHeight = scroll.bottom - scroll.top;
+
+            if (_smoothScrolling && encoded.scrolls.size() == 1 &&
+                topline != texture.topline && std::abs(scroll.rows) < scrollHeight) {
+                texture.scroll = scroll;
+                texture.scrollStart = CACurrentMediaTime();
+                texture.animating = true;
             }
+        }
 
-            if (cell->has_strikethrough()) {
-                *lines++ = line_data(gridpos, color, strikethrough);
+        texture.topline = topline;
+        texture.drawTick = grid->tick();
+        texture.placeholderGeneration = glyphManager->placeholder_generation();
+        texture.paletteGeneration = paletteGeneration;
+        texture.valid = true;
+
+        // Rows are encoded into scratch vectors first, then copied into the
+        // grid's buffer, which is sized by the number of glyphs and lines
+        // actually encoded. The scratch vectors are reused between grids and
+        // frames, so they only grow to the largest grid we've encoded.
+        const size_t gridSize = grid->cells_size();
+        backgroundScratch.resize(gridSize);
+        size_t encodedRowCount = 0;
+
+        for (size_t row=0; row<gridHeight; ++row) {
+            if (encoded.full || grid->row_tick(row) > drawnTick) {
+                encoded.encodedRows[row] = true;
+                encodedRowCount += 1;
             }
         }
 
-        if (!cell->empty()) {
-            glyph_rect glyph = glyphManager->get(fontFamily, *cell);
-            *glyphs++ = glyph_data(gridpos, cell->width(), glyph);
+        // Split the encoded rows into bands with a similar number of encoded
+        // rows each, one band per core at most.
+        const size_t bandCount = std::clamp<size_t>((encodedRowCount * gridWidth) / minBandCells,
+                                                    1, encodeConcurrency);
+        const size_t bandRows = (encodedRowCount + bandCount - 1) / bandCount;
+
+        if (encodeBands.size() < bandCount) {
+            encodeBands.resize(bandCount);
+        }
+
+        for (size_t row=0, band=0; band<bandCount; ++band) {
+            const bool last = band + 1 == bandCount;
+            size_t rows = 0;
+
+            encodeBands[band].clear();
+            encodeBands[band].rowBegin = row;
+
+            for (; row < gridHeight && (last || rows < bandRows); ++row) {
+                rows += encoded.encodedRows[row];
+            }
+
+            encodeBands[band].rowEnd = row;
         }
-    });
 
-    size_t glyphsCount = glyphs - glyphsBegin;
-    size_t linesCount = lines - linesBegin;
-    buffer.update(0, glyphBuffer.offset + (sizeof(glyph_data) * glyphsCount));
+        // Safe to run concurrently. Bands write to their own rows of the
+        // background scratch, and memoize glyphs in their own rows' cells.
+        auto encodeBand = [&](size_t index) {
+            encode_band &band = encodeBands[index];
+
+            for (size_t row=band.rowBegin; row<band.rowEnd; ++row) {
+                if (!encoded.encodedRows[row]) {
+                    continue;
+                }
+
+                const nvim::cell *cell = grid->get(row, 0);
+                uint16_t *rowBackgrounds = backgroundScratch.data() + (row * gridWidth);
+                uint16_t undercurlPosition = 0;
+                line_runs runs;
+
+                for (size_t col=0; col<gridWidth; ++col, ++cell) {
+                    simd_short2 gridpos = simd_make_short2(static_cast<int16_t>(col),
+                                                           static_cast<int16_t>(row));
+                    const nvim::cell_attributes &attrs = grids->attributes(*cell);
+                    *rowBackgrounds++ = cell->highlight();
+
+                    encodeCell(gridpos, *cell, attrs, cell->highlight(), true,
+                               undercurlPosition, runs, band);
+
+                    undercurlPosition = attrs.has_undercurl() ? undercurlPosition + 1 : 0;
+                }
+            }
+        };
+
+        if (bandCount == 1) {
+            encodeBand(0);
+        } else {
+            dispatch_apply_f(bandCount, DISPATCH_APPLY_AUTO, &encodeBand, [](void *context, size_t index) {
+                (*static_cast<decltype(encodeBand)*>(context))(index);
+            });
+        }
+
+        size_t glyphCount = 0;
+        size_t lineCount = 0;
+
+        for (size_t band=0; band<bandCount; ++band) {
+            resolveMisses(encodeBands[band]);
+            glyphCount += encodeBands[band].glyphs.size();
+            lineCount += encodeBands[band].lines.size();
+        }
+
+        const size_t backgroundBufferSize = gridSize * sizeof(uint16_t);
+        const size_t glyphBufferSize      = glyphCount * sizeof(glyph_data);
+        const size_t lineBufferSize       = lineCount * sizeof(line_data);
+
+        // The three buffers share a single allocation, so they're always in
+        // the same MTLBuffer.
+        const size_t glyphStart = frame_ring::align_up(backgroundBufferSize);
+        const size_t lineStart  = glyphStart + frame_ring::align_up(glyphBufferSize);
+
+        frame_ring::region gridBuffer = frameRing->allocate(lineStart + lineBufferSize);
+        char *gridData = static_cast<char*>(gridBuffer.ptr);
+
+        encoded.buffer = gridBuffer.buffer;
+        encoded.backgroundOffset = gridBuffer.offset;
+        encoded.glyphOffset = gridBuffer.offset + glyphStart;
+        encoded.lineOffset = gridBuffer.offset + lineStart;
+        encoded.glyphCount = glyphCount;
+        encoded.lineCount = lineCount;
+
+        // Copy the backgrounds of each run of encoded rows.
+        auto backgrounds = reinterpret_cast<uint16_t*>(gridData);
+
+        for (size_t row=0; row<gridHeight;) {
+            if (!encoded.encodedRows[row]) {
+                row += 1;
+                continue;
+            }
+
+            size_t runBegin = row;
+
+            while (row < gridHeight && encoded.encodedRows[row]) {
+                row += 1;
+            }
+
+            size_t cell = runBegin * gridWidth;
+            size_t cells = (row - runBegin) * gridWidth;
+
+            memcpy(backgrounds + cell, backgroundScratch.data() + cell,
+                   cells * sizeof(uint16_t));
+
+            [encoded.buffer didModifyRange:NSMakeRange(encoded.backgroundOffset + (cell * sizeof(uint16_t)),
+                                                       cells * sizeof(uint16_t))];
+        }
+
+        // Bands are copied in order, one after another.
+        char *glyphs = gridData + glyphStart;
+        char *lines = gridData + lineStart;
+
+        for (size_t band=0; band<bandCount; ++band) {
+            const encode_band &encodedBand = encodeBands[band];
+            const size_t bandGlyphsSize = encodedBand.glyphs.size() * sizeof(glyph_data);
+            const size_t bandLinesSize = encodedBand.lines.size() * sizeof(line_data);
+
+            memcpy(glyphs, encodedBand.glyphs.data(), bandGlyphsSize);
+            memcpy(lines, encodedBand.lines.data(), bandLinesSize);
+            glyphs += bandGlyphsSize;
+            lines += bandLinesSize;
+        }
+
+        if (glyphBufferSize) {
+            [encoded.buffer didModifyRange:NSMakeRange(encoded.glyphOffset, glyphBufferSize)];
+        }
+
+        if (lineBufferSize) {
+            [encoded.buffer didModifyRange:NSMakeRange(encoded.lineOffset, lineBufferSize)];
+        }
+    };
+
+    // Encode every visible grid, and drop the state of grids that are no
+    // longer visible.
+    for (auto &[id, encoded] : encodedGrids) {
+        encoded.visible = false;
+    }
+
+    for (auto &[id, texture] : gridTextures) {
+        texture.visible = false;
+    }
+
+    for (const nvim::grid *grid : grids->ordered()) {
+        if (!grid->cells_size()) {
+            continue;
+        }
+
+        encoded_grid &encoded = encodedGrids[grid->id()];
+        grid_texture &texture = gridTextures[grid->id()];
+        encoded.visible = true;
+        texture.visible = true;
+        encodeGrid(grid, texture, encoded);
+    }
+
+    for (auto iter = encodedGrids.begin(); iter != encodedGrids.end();) {
+        if (iter->second.visible) {
+            ++iter;
+        } else {
+            iter = encodedGrids.erase(iter);
+        }
+    }
+
+    for (auto iter = gridTextures.begin(); iter != gridTextures.end();) {
+        if (iter->second.visible) {
+            ++iter;
+        } else {
+            iter = gridTextures.erase(iter);
+        }
+    }
+
+    // Block cursors are drawn as an overlay. We fill the cursor cells with the
+    // cursor color, then redraw their contents using the cursor colors. The
+    // overlay is encoded in global grid coordinates. Its lines are drawn with
+    // a single entry palette holding the cursor colors.
+    palette_entry cursorPalette;
+    cursorPalette.background = cursor.background();
+    cursorPalette.special = cursor.special();
+
+    frame_ring::region cursorGlyphBuffer{};
+    frame_ring::region cursorLineBuffer{};
+    size_t cursorGlyphsCount = 0;
+    size_t cursorLinesCount = 0;
+
+    if (cursor.shape() == nvim::cursor_shape::block) {
+        const nvim::cell *cursorCell = &cursor.cell();
+        const nvim::cell *rowBegin = cursorCell - cursor.col();
+
+        // Keep undercurls in phase with the rest of their line.
+        uint16_t undercurlPosition = 0;
+
+        for (size_t col = cursor.col();
+             col && grids->attributes(rowBegin[col - 1]).has_undercurl(); --col) {
+            undercurlPosition += 1;
+        }
+
+        cursorScratch.clear();
+        line_runs runs;
+
+        for (size_t i=0; i<cursor.width(); ++i) {
+            nvim::cell_attributes recolored = grids->attributes(cursorCell[i]);
+            recolored.foreground = cursor.foreground();
+            recolored.background = cursor.background();
+            recolored.special = cursor.special();
+
+            simd_short2 gridpos = simd_make_short2(static_cast<int16_t>(cursorCol + i),
+                                                   cursorRow);
+
+            encodeCell(gridpos, cursorCell[i], recolored, 0, false,
+                       undercurlPosition + i, runs, cursorScratch);
+        }
+
+        // A double width cursor can cover two cells, but only one of them
+        // can have a glyph.
+        cursorGlyphsCount = std::min<size_t>(cursorScratch.glyphs.size(), 1);
+        cursorLinesCount = std::min<size_t>(cursorScratch.lines.size(), 4);
+
+        const size_t cursorGlyphBufferSize = cursorGlyphsCount * sizeof(glyph_data);
+        const size_t cursorLineBufferSize = cursorLinesCount * sizeof(line_data);
+
+        cursorGlyphBuffer = frameRing->allocate(cursorGlyphBufferSize);
+        cursorLineBuffer = frameRing->allocate(cursorLineBufferSize);
+
+        memcpy(cursorGlyphBuffer.ptr, cursorScratch.glyphs.data(), cursorGlyphBufferSize);
+        memcpy(cursorLineBuffer.ptr, cursorScratch.lines.data(), cursorLineBufferSize);
+
+        frame_ring::update(cursorGlyphBuffer, cursorGlyphBufferSize);
+        frame_ring::update(cursorLineBuffer, cursorLineBufferSize);
+    }
+
+    // Frames of every view rendering on this device during this run loop
+    // iteration are encoded into one command buffer.
+    id<MTLCommandBuffer> commandBuffer = [renderContext frameCommandBuffer];
+
+    // Upload any glyphs cached while encoding, before they're sampled.
+    glyphManager->flush(commandBuffer);
+
+    // Bring each grid's texture up to date. Scrolls are replayed first, then
+    // the encoded rows are drawn over them. Backgrounds are drawn one run of
+    // encoded rows at a time, the instance_id passed to the vertex function
+    // includes the base instance. Glyphs and lines are packed, they're drawn
+    // with one draw call each.
+    for (const nvim::grid *grid : grids->ordered()) {
+        if (!grid->cells_size()) {
+            continue;
+        }
+
+        grid_texture &texture = gridTextures[grid->id()];
+        const encoded_grid &encoded = encodedGrids[grid->id()];
+        const size_t gridWidth = grid->width();
+        const size_t gridHeight = grid->height();
+
+        if (!encoded.scrolls.empty()) {
+            if (!texture.back) {
+                texture.back = newGridTexture(device, texture.size, cellSize);
+            }
+
+            id<MTLBlitCommandEncoder> blitEncoder = [commandBuffer blitCommandEncoder];
+
+            for (const nvim::grid_scroll_record &scroll : encoded.scrolls) {
+                blitScrolled(blitEncoder, texture.front, texture.back,
+                             scroll, gridHeight, cellSize.y);
+
+                std::swap(texture.front, texture.back);
+            }
+
+            [blitEncoder endEncoding];
+        }
+
+        const auto &encodedRows = encoded.encodedRows;
+
+        if (std::find(encodedRows.begin(), encodedRows.end(), true) == encodedRows.end()) {
+            continue;
+        }
+
+        MTLRenderPassDescriptor *gridDesc = [MTLRenderPassDescriptor renderPassDescriptor];
+        gridDesc.colorAttachments[0].texture = texture.front;
+        gridDesc.colorAttachments[0].loadAction = encoded.full ? MTLLoadActionDontCare :
+                                                                 MTLLoadActionLoad;
+        gridDesc.colorAttachments[0].storeAction = MTLStoreActionStore;
+
+        if (!paletteBuffer.buffer) {
+            uploadPalette();
+        }
+
+        const uniform_data gridTextureUniforms = textureUniforms(texture);
+
+        grid_uniform_data gridUniforms;
+        gridUniforms.origin = simd_make_short2(0, 0);
+        gridUniforms.width = static_cast<uint32_t>(gridWidth);
+
+        id<MTLRenderCommandEncoder> gridEncoder = [commandBuffer renderCommandEncoderWithDescriptor:gridDesc];
+        [gridEncoder setVertexBytes:&gridTextureUniforms length:sizeof(gridTextureUniforms) atIndex:0];
+        [gridEncoder setVertexBytes:&gridUniforms length:sizeof(gridUniforms) atIndex:2];
+        [gridEncoder setVertexBuffer:paletteBuffer.buffer offset:paletteBuffer.offset atIndex:3];
+        [gridEncoder setFragmentTexture:glyphManager->texture() atIndex:0];
+
+        // Backgrounds are drawn one run of encoded rows at a time.
+        [gridEncoder setRenderPipelineState:backgroundRenderPipeline];
+        [gridEncoder setVertexBuffer:encoded.buffer offset:encoded.backgroundOffset atIndex:1];
+
+        for (size_t row=0; row<gridHeight;) {
+            if (!encodedRows[row]) {
+                row += 1;
+                continue;
+            }
+
+            size_t runBegin = row;
+
+            while (row < gridHeight && encodedRows[row]) {
+                row += 1;
+            }
+
+            [gridEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                            vertexStart:0
+                            vertexCount:4
+                          instanceCount:(row - runBegin) * gridWidth
+                           baseInstance:runBegin * gridWidth];
+        }
+
+        if (encoded.glyphCount) {
+            [gridEncoder setRenderPipelineState:glyphRenderPipeline];
+            [gridEncoder setVertexBufferOffset:encoded.glyphOffset atIndex:1];
+            [gridEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                            vertexStart:0
+                            vertexCount:4
+                          instanceCount:encoded.glyphCount];
+        }
+
+        if (encoded.lineCount) {
+            [gridEncoder setRenderPipelineState:lineRenderPipeline];
+            [gridEncoder setVertexBufferOffset:encoded.lineOffset atIndex:1];
+            [gridEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                            vertexStart:0
+                            vertexCount:4
+                          instanceCount:encoded.lineCount];
+        }
+
+        [gridEncoder endEncoding];
+    }
 
     id<CAMetalDrawable> drawable = [metalLayer nextDrawable];
     MTLRenderPassDescriptor *desc = [MTLRenderPassDescriptor renderPassDescriptor];
@@ -552,38 +1112,107 @@ static void blinkCursorToggleOn(void *context) {
     desc.colorAttachments[0].loadAction = MTLLoadActionClear;
     desc.colorAttachments[0].storeAction = MTLStoreActionStore;
 
-    id<MTLCommandBuffer> commandBuffer = [commandQueue commandBuffer];
     id<MTLRenderCommandEncoder> commandEncoder = [commandBuffer renderCommandEncoderWithDescriptor:desc];
+    [commandEncoder setVertexBuffer:uniformBuffer.buffer offset:uniformBuffer.offset atIndex:0];
+
+    // Returns a scissor rect for the given pixel rect, clamped to the drawable.
+    auto scissorRect = [&](double x, double y, double width, double height) {
+        double right = std::clamp(x + width, 0.0, drawableSize.width);
+        double bottom = std::clamp(y + height, 0.0, drawableSize.height);
+        x = std::clamp(x, 0.0, right);
+        y = std::clamp(y, 0.0, bottom);
+
+        return MTLScissorRect{static_cast<NSUInteger>(x),
+                              static_cast<NSUInteger>(y),
+                              static_cast<NSUInteger>(right - x),
+                              static_cast<NSUInteger>(bottom - y)};
+    };
+
+    // Grids are drawn in order, each one over the grids before it. While a
+    // scroll is animated, the scrolled region is drawn again, translated
+    // toward its final position. The rows scrolled into view are drawn from
+    // the pre scroll contents in the back texture.
+    [commandEncoder setRenderPipelineState:gridTextureRenderPipeline];
 
-    [commandEncoder setRenderPipelineState:backgroundRenderPipeline];
-    [commandEncoder setVertexBuffer:buffer.get() offset:uniformBuffer.offset atIndex:0];
-    [commandEncoder setVertexBuffer:buffer.get() offset:backgroundBuffer.offset atIndex:1];
-    [commandEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
-                       vertexStart:0
-                       vertexCount:4
-                     instanceCount:gridSize];
-
-    if (glyphsCount) {
-        [commandEncoder setRenderPipelineState:glyphRenderPipeline];
-        [commandEncoder setVertexBufferOffset:glyphBuffer.offset atIndex:1];
-        [commandEncoder setFragmentTexture:glyphManager->texture() atIndex:0];
+    const CFTimeInterval now = CACurrentMediaTime();
+    bool animating = false;
+
+    for (const nvim::grid *grid : grids->ordered()) {
+        if (!grid->cells_size()) {
+            continue;
+        }
+
+        grid_texture &texture = gridTextures[grid->id()];
+        const nvim::grid_point origin = grid->origin();
+
+        grid_texture_data textureData;
+        textureData.origin = simd_make_short2(static_cast<int16_t>(origin.column),
+                                              static_cast<int16_t>(origin.row));
+        textureData.size = simd_make_short2(static_cast<int16_t>(grid->width()),
+                                            static_cast<int16_t>(grid->height()));
+        textureData.rows = simd_make_short2(0, textureData.size.y);
+        textureData.offset = 0;
+
+        [commandEncoder setVertexBytes:&textureData length:sizeof(textureData) atIndex:2];
+        [commandEncoder setFragmentTexture:texture.front atIndex:0];
         [commandEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
                            vertexStart:0
-                           vertexCount:4
-                         instanceCount:glyphsCount];
-    }
+                           vertexCount:4];
+
+        if (!texture.animating) {
+            continue;
+        }
 
-    if (linesCount) {
-        buffer.update(lineBuffer.offset, sizeof(line_data) * linesCount);
+        const double progress = (now - texture.scrollStart) / smoothScrollDuration;
 
-        [commandEncoder setRenderPipelineState:lineRenderPipeline];
-        [commandEncoder setVertexBufferOffset:lineBuffer.offset atIndex:1];
+        if (progress >= 1) {
+            texture.animating = false;
+            continue;
+        }
+
+        // Ease out, the scroll starts at full speed and slows to a stop.
+        const nvim::grid_scroll_record &scroll = texture.scroll;
+        const float scrolledPixels = scroll.rows * cellSize.y;
+        const float offset = std::round(scrolledPixels * std::pow(1 - progress, 3));
+
+        [commandEncoder setScissorRect:scissorRect(origin.column * cellSize.x,
+                                                   (origin.row + scroll.top) * cellSize.y,
+                                                   grid->width() * cellSize.x,
+                                                   (scroll.bottom - scroll.top) * cellSize.y)];
+
+        textureData.rows = simd_make_short2(static_cast<int16_t>(scroll.top),
+                                            static_cast<int16_t>(scroll.bottom));
+        textureData.offset = offset - scrolledPixels;
+
+        [commandEncoder setVertexBytes:&textureData length:sizeof(textureData) atIndex:2];
+        [commandEncoder setFragmentTexture:texture.back atIndex:0];
+        [commandEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                           vertexStart:0
+                           vertexCount:4];
+
+        textureData.offset = offset;
+
+        [commandEncoder setVertexBytes:&textureData length:sizeof(textureData) atIndex:2];
+        [commandEncoder setFragmentTexture:texture.front atIndex:0];
         [commandEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
                            vertexStart:0
-                           vertexCount:4
-                         instanceCount:linesCount];
+                           vertexCount:4];
+
+        [commandEncoder setScissorRect:scissorRect(0, 0, drawableSize.width,
+                                                   drawableSize.height)];
+        animating = true;
     }
 
+    [commandEncoder setFragmentTexture:glyphManager->texture() atIndex:0];
+
+    // The cursor overlay is in global grid coordinates.
+    grid_uniform_data cursorUniforms;
+    cursorUniforms.origin = simd_make_short2(0, 0);
+    cursorUniforms.width = 1;
+
+    [commandEncoder setVertexBytes:&cursorUniforms length:sizeof(cursorUniforms) atIndex:2];
+    [commandEncoder setVertexBytes:&cursorPalette length:sizeof(cursorPalette) atIndex:3];
+
     switch (cursor.shape()) {
         case nvim::cursor_shape::vertical:
             [commandEncoder setRenderPipelineState:cursorRenderPipeline];
@@ -613,20 +1242,73 @@ static void blinkCursorToggleOn(void *context) {
             break;
 
         case nvim::cursor_shape::block:
-            break; // Block cursors are handled with AdjustedGrids.
+            [commandEncoder setRenderPipelineState:cursorRenderPipeline];
+            [commandEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                               vertexStart:0
+                               vertexCount:4
+                             instanceCount:1
+                              baseInstance:4];
+
+            if (cursorGlyphsCount) {
+                [commandEncoder setRenderPipelineState:glyphRenderPipeline];
+                [commandEncoder setVertexBuffer:cursorGlyphBuffer.buffer offset:cursorGlyphBuffer.offset atIndex:1];
+                [commandEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                                   vertexStart:0
+                                   vertexCount:4
+                                 instanceCount:cursorGlyphsCount];
+            }
+
+            if (cursorLinesCount) {
+                [commandEncoder setRenderPipelineState:lineRenderPipeline];
+                [commandEncoder setVertexBuffer:cursorLineBuffer.buffer offset:cursorLineBuffer.offset atIndex:1];
+                [commandEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                                   vertexStart:0
+                                   vertexCount:4
+                                 instanceCount:cursorLinesCount];
+            }
+
+            break;
     }
 
     [commandEncoder endEncoding];
-    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> commandBuffer) {
-        self->buffers[index].unlock();
-    }];
 
-    [commandBuffer commit];
-    [commandBuffer waitUntilScheduled];
-    [drawable present];
+    if (latencyTracker) {
+        [self trackPresentation:drawable tick:tick];
+    }
+
+    os_signpost_interval_end(latency, signpost, "Encode");
+
+    // The render context commits the frame, and evicts glyphs, once every
+    // view has been displayed.
+    [renderContext presentDrawable:drawable];
 
-    frameIndex += 1;
-    glyphManager->evict();
+    // Keep drawing until scroll animations finish. Animation frames only
+    // draw grid textures, nothing is encoded.
+    if (animating) {
+        [self setNeedsDisplay:YES];
+    }
+}
+
+/// Records the latencies of the inputs drawn by this frame once drawable is
+/// presented. Without presented handlers, the frame's completion is used.
+- (void)trackPresentation:(id<CAMetalDrawable>)drawable tick:(uint64_t)tick {
+    std::shared_ptr<latency_tracker> tracker = latencyTracker;
+    tracker->set_glyph_stats(glyphManager->stats());
+
+    if (@available(macOS 10.15.4, *)) {
+        [drawable addPresentedHandler:^(id<MTLDrawable> presented) {
+            CFTimeInterval time = [presented presentedTime];
+            uint64_t nanoseconds = time ? time * NSEC_PER_SEC : latency_tracker::now();
+
+            os_signpost_event_emit(latency, tick, "Present", "tick=%llu", tick);
+            tracker->presented(tick, nanoseconds);
+        }];
+    } else {
+        [[renderContext frameCommandBuffer] addCompletedHandler:^(id<MTLCommandBuffer>) {
+            os_signpost_event_emit(latency, tick, "Present", "tick=%llu", tick);
+            tracker->presented(tick, latency_tracker::now());
+        }];
+    }
 }
 
 - (BOOL)isFlipped {
@@ -659,6 +1341,7 @@ static void blinkCursorToggleOn(void *context) {
     }
 
     dispatch_source_cancel(blinkTimer);
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
 }
 
 @end
@@ -16,6 +16,13 @@ NS_ASSUME_NONNULL_BEGIN
 
 + (BOOL)titlebarAppearsTransparent;
 + (BOOL)externalizeTabline;
++ (BOOL)smoothScrolling;
+
+/// The directory Neovim output is captured to, or nil if capturing is off.
+/// Not exposed in the preferences window, set it with defaults write, or
+/// pass -NVPreferencesRedrawCaptureDirectory <path> on the command line.
+/// Captures can be replayed by the redraw replay tests.
++ (nullable NSString *)redrawCaptureDirectory;
 
 @end
 
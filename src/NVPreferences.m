@@ -11,6 +11,8 @@
 
 static NSString * const kTitlebarAppearsTransparent = @"NVPreferencesTitlebarAppearsTransparent";
 static NSString * const kExternalizeTabline = @"NVPreferencesExternalizeTabline";
+static NSString * const kSmoothScrolling = @"NVPreferencesSmoothScrolling";
+static NSString * const kRedrawCaptureDirectory = @"NVPreferencesRedrawCaptureDirectory";
 
 static BOOL getBooleanPreference(NSString *key, BOOL defaultValue) {
     NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
@@ -38,6 +40,16 @@ static void setBooleanPreference(NSString *key, BOOL value) {
     return getBooleanPreference(kExternalizeTabline, YES);
 }
 
++ (BOOL)smoothScrolling {
+    return getBooleanPreference(kSmoothScrolling, YES);
+}
+
++ (NSString *)redrawCaptureDirectory {
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    NSString *value = [defaults stringForKey:kRedrawCaptureDirectory];
+    return [value length] ? value : nil;
+}
+
 @end
 
 @interface NVPreferencesController()
@@ -9,12 +9,19 @@
 
 #import <Cocoa/Cocoa.h>
 #import <Metal/Metal.h>
+#import <QuartzCore/CAMetalLayer.h>
 
 struct font_manager;
+struct frame_ring;
 struct glyph_manager;
 
 NS_ASSUME_NONNULL_BEGIN
 
+/// Posted on the main thread when glyphs rasterized in the background are
+/// ready. The notification object is the NVRenderContext whose glyph manager
+/// has new glyphs. Views using that render context should redraw.
+extern NSNotificationName const NVRenderContextGlyphsReadyNotification;
+
 /// @class NVRenderContext
 /// @abstract Manages Metal device related state.
 ///
@@ -47,6 +54,10 @@ NS_ASSUME_NONNULL_BEGIN
 /// See shaders.metal for more information.
 @property (nonatomic, readonly) id<MTLRenderPipelineState> lineRenderPipeline;
 
+/// The pipeline that draws grids rendered to offscreen textures.
+/// See shaders.metal for more information.
+@property (nonatomic, readonly) id<MTLRenderPipelineState> gridTextureRenderPipeline;
+
 /// The glyph manager for this render context.
 /// Glyphs are cached in GPU memory (in Metal textures), this makes them
 /// specific to Metal devices. As such, they are managed by a render context.
@@ -55,6 +66,26 @@ NS_ASSUME_NONNULL_BEGIN
 /// The shared font manager.
 @property (nonatomic, readonly) struct font_manager* fontManager;
 
+/// The ring that per frame GPU data is allocated from.
+/// Shared by every view rendering with this render context. Allocations are
+/// valid until the frame they were made in completes.
+@property (nonatomic, readonly) struct frame_ring* frameRing;
+
+/// Returns the command buffer of the current frame.
+///
+/// Views that render during the same run loop iteration encode their frames
+/// into a single command buffer, which is committed once after Core Animation
+/// commits its transaction. Do not commit the returned command buffer.
+- (id<MTLCommandBuffer>)frameCommandBuffer;
+
+/// Presents drawable when the current frame is committed.
+/// If the drawable's layer presents with transactions, the current frame is
+/// committed immediately, so the drawable is presented in this transaction.
+- (void)presentDrawable:(id<CAMetalDrawable>)drawable;
+
+/// Commits the current frame, if any views have encoded into it.
+- (void)commitFrame;
+
 @end
 
 /// Controls the parameters of a NVRenderContexts and the objects it creates.
@@ -65,6 +96,10 @@ struct NVRenderContextOptions {
     /// The glyph_rasterizer width.
     size_t rasterizerWidth;
 
+    /// The number of glyph_rasterizers used to rasterize expensive glyphs in
+    /// the background. Use 0 to rasterize all glyphs on the main thread.
+    size_t rasterizerPoolSize;
+
     /// The glyph_texture_cache page height.
     size_t cachePageHeight;
 
@@ -77,6 +112,16 @@ struct NVRenderContextOptions {
     /// The glyph_texture_cache growth factor.
     double cacheGrowthFactor;
 
+    /// Cache glyphs as coverage masks that are tinted when drawn, rather than
+    /// once per foreground and background color combination. This uses far
+    /// less texture memory with colorful text, but dilation is approximate.
+    bool colorIndependentGlyphs;
+
+    /// When using color independent glyphs, the number of dilation buckets
+    /// foreground colors are quantized into. Each bucket is rasterized
+    /// separately. Values are clamped to the range [1, 16].
+    size_t glyphDilationBuckets;
+
     /// For a given glyph_texture_cache, when the number of allocated cache
     /// pages exceeds this threshold, the texture cache is evicted.
     size_t cacheEvictionThreshold;
@@ -84,6 +129,10 @@ struct NVRenderContextOptions {
     /// The number of cache pages to preserve when a texture cache is evicted.
     /// This number should be less than cacheEvictionThreshold.
     size_t cacheEvictionPreserve;
+
+    /// The maximum size in bytes of the on disk glyph archive, which persists
+    /// rasterized glyphs between launches. Use 0 to disable the archive.
+    size_t glyphArchiveSize;
 };
 
 /// @protocol NVMetalDeviceDelegate
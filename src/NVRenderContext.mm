@@ -9,6 +9,10 @@
 
 #import "NVRenderContext.h"
 #include "font.hpp"
+#include "frame_ring.hpp"
+#include "log.h"
+
+NSNotificationName const NVRenderContextGlyphsReadyNotification = @"NVRenderContextGlyphsReadyNotification";
 
 static inline MTLRenderPipelineDescriptor* defaultPipelineDescriptor() {
     MTLRenderPipelineDescriptor *desc = [[MTLRenderPipelineDescriptor alloc] init];
@@ -30,14 +34,27 @@ static inline MTLRenderPipelineDescriptor* blendedPipelineDescriptor() {
     return desc;
 }
 
+/// The initial capacity of a render context's frame ring.
+static constexpr size_t frameRingCapacity = 4 * 1024 * 1024;
+
+/// Core Animation commits its transactions in a run loop observer of this
+/// order. We commit frames just after it, once every view has been displayed.
+static constexpr CFIndex frameCommitOrder = 2000000 + 1;
+
 @implementation NVRenderContext {
     glyph_manager glyphManager;
+    frame_ring frameRing;
+    id<MTLCommandBuffer> frameCommandBuffer;
+    NSMutableArray<id<CAMetalDrawable>> *transactionDrawables;
+    CFRunLoopObserverRef commitObserver;
 }
 
 - (instancetype)initWithDevice:(id<MTLDevice>)device
                    fontManager:(font_manager *)fontManager
                 contextOptions:(NVRenderContextOptions *)options
                glyphRasterizer:(glyph_rasterizer *)rasterizer
+               rasterizerPool:(glyph_rasterizer_pool *)rasterizerPool
+                  glyphArchive:(glyph_archive *)glyphArchive
                          error:(NSError **)error {
     self = [super init];
     _device = device;
@@ -54,7 +71,11 @@ static inline MTLRenderPipelineDescriptor* blendedPipelineDescriptor() {
 
     if (*error) return self;
 
-    MTLRenderPipelineDescriptor *glyphDesc = defaultPipelineDescriptor();
+    // Coverage masks are blended with the background. Colored glyphs are
+    // opaque, so they're unaffected by blending, but we'll skip it if we can.
+    MTLRenderPipelineDescriptor *glyphDesc = options->colorIndependentGlyphs ?
+                                             blendedPipelineDescriptor() :
+                                             defaultPipelineDescriptor();
     glyphDesc.label = @"Glyph render pipeline";
     glyphDesc.vertexFunction = [lib newFunctionWithName:@"glyph_render"];
     glyphDesc.fragmentFunction = [lib newFunctionWithName:@"glyph_fill"];
@@ -78,24 +99,115 @@ static inline MTLRenderPipelineDescriptor* blendedPipelineDescriptor() {
 
     if (*error) return self;
 
+    MTLRenderPipelineDescriptor *gridTextureDesc = defaultPipelineDescriptor();
+    gridTextureDesc.label = @"Grid texture render pipeline";
+    gridTextureDesc.vertexFunction = [lib newFunctionWithName:@"grid_texture_render"];
+    gridTextureDesc.fragmentFunction = [lib newFunctionWithName:@"grid_texture_fill"];
+    _gridTextureRenderPipeline = [device newRenderPipelineStateWithDescriptor:gridTextureDesc error:error];
+
+    if (*error) return self;
+
     glyph_texture_cache textureCache(_commandQueue,
                                      options->cachePageWidth,
                                      options->cachePageHeight,
                                      options->cacheInitialCapacity,
                                      options->cacheGrowthFactor);
 
+    __weak NVRenderContext *weakSelf = self;
+
+    size_t dilationBuckets = 0;
+
+    if (options->colorIndependentGlyphs) {
+        dilationBuckets = std::max<size_t>(options->glyphDilationBuckets, 1);
+    }
+
     glyphManager = glyph_manager(rasterizer,
                                  std::move(textureCache),
                                  options->cacheEvictionThreshold,
-                                 options->cacheEvictionPreserve);
+                                 options->cacheEvictionPreserve,
+                                 rasterizerPool,
+                                 ^{
+        if (NVRenderContext *context = weakSelf) {
+            [[NSNotificationCenter defaultCenter] postNotificationName:NVRenderContextGlyphsReadyNotification
+                                                                object:context];
+        }
+    }, dilationBuckets, glyphArchive);
+
+    frameRing = frame_ring(device, frameRingCapacity);
+    transactionDrawables = [NSMutableArray arrayWithCapacity:4];
 
+    commitObserver = CFRunLoopObserverCreateWithHandler(kCFAllocatorDefault,
+                                                        kCFRunLoopBeforeWaiting | kCFRunLoopExit,
+                                                        true, frameCommitOrder,
+                                                        ^(CFRunLoopObserverRef observer, CFRunLoopActivity activity) {
+        [weakSelf commitFrame];
+    });
+
+    CFRunLoopAddObserver(CFRunLoopGetMain(), commitObserver, kCFRunLoopCommonModes);
     return self;
 }
 
+- (void)dealloc {
+    if (commitObserver) {
+        CFRunLoopObserverInvalidate(commitObserver);
+        CFRelease(commitObserver);
+    }
+}
+
 - (glyph_manager*)glyphManager {
     return &glyphManager;
 }
 
+- (frame_ring*)frameRing {
+    return &frameRing;
+}
+
+- (id<MTLCommandBuffer>)frameCommandBuffer {
+    if (!frameCommandBuffer) {
+        frameCommandBuffer = [_commandQueue commandBuffer];
+    }
+
+    return frameCommandBuffer;
+}
+
+- (void)presentDrawable:(id<CAMetalDrawable>)drawable {
+    // Drawables presented with a transaction have to be presented before the
+    // transaction commits, after their command buffer is scheduled.
+    if (drawable.layer.presentsWithTransaction) {
+        [transactionDrawables addObject:drawable];
+        [self commitFrame];
+    } else {
+        [[self frameCommandBuffer] presentDrawable:drawable];
+    }
+}
+
+- (void)commitFrame {
+    if (!frameCommandBuffer) {
+        return;
+    }
+
+    const os_signpost_id_t signpost = os_signpost_id_make_with_pointer(latency, (__bridge void*)self);
+    os_signpost_interval_begin(latency, signpost, "Commit");
+
+    frameRing.commit(frameCommandBuffer);
+    [frameCommandBuffer commit];
+
+    if ([transactionDrawables count]) {
+        [frameCommandBuffer waitUntilScheduled];
+
+        for (id<CAMetalDrawable> drawable in transactionDrawables) {
+            [drawable present];
+        }
+
+        [transactionDrawables removeAllObjects];
+    }
+
+    frameCommandBuffer = nil;
+    glyphManager.evict();
+
+    os_signpost_interval_end(latency, signpost, "Commit");
+}
+
 @end
 
 @implementation NVRenderContextManager {
@@ -105,6 +217,49 @@ static inline MTLRenderPipelineDescriptor* blendedPipelineDescriptor() {
     NVRenderContextOptions contextOptions;
     font_manager fontManager;
     glyph_rasterizer rasterizer;
+    glyph_rasterizer_pool rasterizerPool;
+    glyph_archive glyphArchive;
+    id<NSObject> terminateObserver;
+}
+
+/// Opens the glyph archive in the user's caches directory. Archives are only
+/// reused by the same system version, with the same rasterization options.
+static void openGlyphArchive(glyph_archive &archive, const NVRenderContextOptions &options) {
+    if (!options.glyphArchiveSize) {
+        return;
+    }
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSURL *caches = [[fileManager URLsForDirectory:NSCachesDirectory
+                                         inDomains:NSUserDomainMask] firstObject];
+
+    NSString *bundleIdentifier = [[NSBundle mainBundle] bundleIdentifier];
+
+    if (!caches || !bundleIdentifier) {
+        return;
+    }
+
+    NSURL *directory = [caches URLByAppendingPathComponent:bundleIdentifier isDirectory:YES];
+
+    if (![fileManager createDirectoryAtURL:directory
+               withIntermediateDirectories:YES
+                                attributes:nil
+                                     error:nil]) {
+        return;
+    }
+
+    NSString *environment = [NSString stringWithFormat:@"%@ %zu %zu %d %zu",
+                             [[NSProcessInfo processInfo] operatingSystemVersionString],
+                             options.rasterizerWidth,
+                             options.rasterizerHeight,
+                             options.colorIndependentGlyphs,
+                             options.glyphDilationBuckets];
+
+    NSURL *path = [directory URLByAppendingPathComponent:@"glyphs.cache" isDirectory:NO];
+
+    archive.open([path fileSystemRepresentation],
+                 glyph_archive::fingerprint([environment UTF8String]),
+                 options.glyphArchiveSize);
 }
 
 - (instancetype)initWithOptions:(NVRenderContextOptions)options
@@ -129,8 +284,23 @@ static inline MTLRenderPipelineDescriptor* blendedPipelineDescriptor() {
     NSMutableArray<NSString *> *uninitializedDevices = [NSMutableArray arrayWithCapacity:16];
     renderContexts = [NSMutableArray arrayWithCapacity:16];
     rasterizer = glyph_rasterizer(options.rasterizerWidth, options.rasterizerHeight);
+    rasterizerPool = glyph_rasterizer_pool(options.rasterizerPoolSize,
+                                           options.rasterizerWidth,
+                                           options.rasterizerHeight);
     contextOptions = options;
     deviceObserver = observer;
+    openGlyphArchive(glyphArchive, options);
+
+    __weak NVRenderContextManager *weakSelf = self;
+
+    terminateObserver = [[NSNotificationCenter defaultCenter] addObserverForName:NSApplicationWillTerminateNotification
+                                                                          object:nil
+                                                                           queue:nil
+                                                                      usingBlock:^(NSNotification *notification) {
+        if (NVRenderContextManager *manager = weakSelf) {
+            manager->glyphArchive.save();
+        }
+    }];
 
     for (id<MTLDevice> device in devices) {
         NSError *error = nil;
@@ -138,6 +308,8 @@ static inline MTLRenderPipelineDescriptor* blendedPipelineDescriptor() {
                                                                fontManager:&fontManager
                                                             contextOptions:&contextOptions
                                                            glyphRasterizer:&rasterizer
+                                                            rasterizerPool:&rasterizerPool
+                                                              glyphArchive:&glyphArchive
                                                                      error:&error];
 
         if (!error) {
@@ -157,6 +329,12 @@ static inline MTLRenderPipelineDescriptor* blendedPipelineDescriptor() {
 
 - (void)dealloc {
     MTLRemoveDeviceObserver(deviceObserver);
+
+    if (terminateObserver) {
+        [[NSNotificationCenter defaultCenter] removeObserver:terminateObserver];
+    }
+
+    glyphArchive.save();
 }
 
 - (NVRenderContext*)addMetalDevice:(id<MTLDevice>)device {
@@ -165,6 +343,8 @@ static inline MTLRenderPipelineDescriptor* blendedPipelineDescriptor() {
                                                            fontManager:&fontManager
                                                         contextOptions:&contextOptions
                                                        glyphRasterizer:&rasterizer
+                                                        rasterizerPool:&rasterizerPool
+                                                          glyphArchive:&glyphArchive
                                                                  error:&error];
 
     if (error) {
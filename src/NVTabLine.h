@@ -46,15 +46,15 @@ NS_ASSUME_NONNULL_BEGIN
 /// Create a new tab.
 /// @param title    The tab title.
 /// @param filetype The filetype of the current buffer. Used for icons.
-/// @param tabpage  Opaque pointer to the corresponding nvim::tabpage.
+/// @param handle   The Neovim handle of the corresponding tabpage.
 /// @param tabLine  The tabLine that will own this tab.
 - (instancetype)initWithTitle:(NSString *)title
                      filetype:(NSString *)filetype
-                      tabpage:(void *)tabpage
+                       handle:(int)handle
                       tabLine:(NVTabLine *)tabLine;
 
-/// Opaque pointer to the corresponding nvim::tabpage.
-@property (nonatomic, readonly) void *tabpage;
+/// The Neovim handle of the corresponding tabpage.
+@property (nonatomic, readonly) int handle;
 
 /// Set the tab title.
 - (void)setTitle:(NSString *)title;
@@ -441,13 +441,13 @@ static NSArray* alphaMaskGradientLocations(CGFloat intrinsicWidth, CGFloat frame
 
 - (instancetype)initWithTitle:(NSString *)title
                      filetype:(NSString *)filetype
-                      tabpage:(void *)tabpage
+                       handle:(int)handle
                       tabLine:(NVTabLine *)owner {
     self = [super init];
     self.wantsLayer = YES;
 
     tabLine = owner;
-    _tabpage = tabpage;
+    _handle = handle;
     NVColorScheme *colorScheme = owner.colorScheme;
 
     iconLayer = [CALayer layer];
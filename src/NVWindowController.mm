@@ -8,6 +8,7 @@
 //
 
 #import <Carbon/Carbon.h>
+#import <CoreVideo/CoreVideo.h>
 #import "NVColorScheme.h"
 #import "NVGridView.h"
 #import "NVPreferences.h"
@@ -16,6 +17,7 @@
 #import "NVWindowController.h"
 
 #include <thread>
+#include "clipboard.hpp"
 #include "log.h"
 #include "neovim.hpp"
 
@@ -39,11 +41,19 @@ enum MouseButton {
 struct MouseEvent {
     nvim::grid_point location;
     NSEventModifierFlags modifiers;
+    size_t grid = 0;
     bool isDragging = false;
 };
 
 static void handleMouseDragEvents(void *context);
 
+static CVReturn displayLinkCallback(CVDisplayLinkRef displayLink,
+                                    const CVTimeStamp *now,
+                                    const CVTimeStamp *outputTime,
+                                    CVOptionFlags flagsIn,
+                                    CVOptionFlags *flagsOut,
+                                    void *context);
+
 static inline std::string_view buttonName(MouseButton button) {
     static constexpr std::string_view names[] = {
         "left",
@@ -68,6 +78,8 @@ static NSMutableArray<NVWindowController*> *neovimWindows = [[NSMutableArray all
     NSView *titlebarView;
 
     NSMutableArray<NVTab*> *tabs;
+    std::vector<nvim::tabpage> tabPages;
+    uint64_t tabLineVersion;
     NSLayoutConstraint *gridViewWidthConstraint;
     NSLayoutConstraint *gridViewHeightConstraint;
     NSLayoutConstraint *titlebarHeightConstraint;
@@ -77,6 +89,7 @@ static NSMutableArray<NVWindowController*> *neovimWindows = [[NSMutableArray all
     nvim::showtabline showTabLineOption;
     nvim::ui_options uiOptions;
     nvim::grid_size lastGridSize;
+    uint64_t lastPaletteGeneration;
 
     dispatch_source_t mouseTimer;
     int64_t mouseTimerRunningCount;
@@ -90,6 +103,11 @@ static NSMutableArray<NVWindowController*> *neovimWindows = [[NSMutableArray all
     BOOL isOpen;
     BOOL isAlive;
     uint64_t isLiveResizing;
+
+    // Read by scheduleRedraw, which is called on the RPC queue.
+    std::atomic<bool> isOccluded;
+
+    CVDisplayLinkRef displayLink;
 }
 
 - (void)dealloc {
@@ -98,6 +116,11 @@ static NSMutableArray<NVWindowController*> *neovimWindows = [[NSMutableArray all
     }
 
     dispatch_cancel(mouseTimer);
+
+    if (displayLink) {
+        CVDisplayLinkStop(displayLink);
+        CVDisplayLinkRelease(displayLink);
+    }
 }
 
 + (NSArray<NVWindowController*>*)windows {
@@ -157,7 +180,7 @@ static NSMutableArray<NVWindowController*> *neovimWindows = [[NSMutableArray all
         .ext_hlstate    = false,
         .ext_linegrid   = true,
         .ext_messages   = false,
-        .ext_multigrid  = false,
+        .ext_multigrid  = true,
         .ext_popupmenu  = false,
         .ext_tabline    = (bool)[NVPreferences externalizeTabline],
         .ext_termcolors = false
@@ -176,6 +199,16 @@ static NSMutableArray<NVWindowController*> *neovimWindows = [[NSMutableArray all
     dispatch_source_set_event_handler_f(mouseTimer, handleMouseDragEvents);
     dispatch_source_set_timer(mouseTimer, DISPATCH_TIME_NOW, NSEC_PER_SEC / 120, 1 * NSEC_PER_MSEC);
 
+    // Redraws are paced by a display link, see redraw_scheduler. The display
+    // link only runs while redraws are pending.
+    if (CVDisplayLinkCreateWithActiveCGDisplays(&displayLink) == kCVReturnSuccess) {
+        CVDisplayLinkSetOutputCallback(displayLink, displayLinkCallback, (__bridge void*)self);
+    } else {
+        displayLink = nullptr;
+        os_log_error(rpc, "Display link error: Failed to create a display link, "
+                          "redraws will not be paced");
+    }
+
     return self;
 }
 
@@ -298,8 +331,25 @@ static inline NSSize minGridViewSize(NSSize cellSize) {
     return NSMakeSize(cellSize.width * MIN_GRID_WIDTH, cellSize.height * MIN_GRID_HEIGHT);
 }
 
+/// Rasterizes printable ASCII in the current font and default colors in the
+/// background. The glyphs are cached by the render context, so every window
+/// using it draws them without rasterizing.
+- (void)prewarmGlyphs {
+    NVRenderContext *context = [gridView renderContext];
+
+    if (!context) {
+        return;
+    }
+
+    const nvim::grid_set *grids = [gridView grids];
+    const nvim::cell_attributes &defaults = grids->highlight(0);
+    context.glyphManager->prewarm(gridView.font, defaults.background, defaults.foreground);
+    lastPaletteGeneration = grids->palette_generation();
+}
+
 - (void)setFont:(const font_family&)font {
     [gridView setFont:font];
+    [self prewarmGlyphs];
     NSWindow *window = [self window];
     NSSize cellSize = [gridView cellSize];
 
@@ -352,11 +402,17 @@ static std::pair<arc_ptr<CTFontDescriptorRef>, CGFloat> getFontDescriptor(nvim::
         return;
     }
 
+    if (displayLink) {
+        NSNumber *screenNumber = screen.deviceDescription[@"NSScreenNumber"];
+        CVDisplayLinkSetCurrentCGDisplay(displayLink, [screenNumber unsignedIntValue]);
+    }
+
     NVRenderContext *oldContext = [gridView renderContext];
     NVRenderContext *newContext = [contextManager renderContextForScreen:screen];
 
     if (oldContext != newContext) {
         [gridView setRenderContext:newContext];
+        [self prewarmGlyphs];
     }
 
     const font_family &oldFont = gridView.font;
@@ -396,7 +452,7 @@ static std::pair<arc_ptr<CTFontDescriptorRef>, CGFloat> getFontDescriptor(nvim::
         }
     }
 
-    const nvim::grid *grid = nvim.get_global_grid();
+    const nvim::grid_set *grids = nvim.get_grids();
     auto [fontDescriptor, fontSize] = getFontDescriptor(nvim);
 
     if (!fontDescriptor) {
@@ -405,9 +461,11 @@ static std::pair<arc_ptr<CTFontDescriptorRef>, CGFloat> getFontDescriptor(nvim::
 
     gridView = [[NVGridView alloc] init];
     gridView.font = fontManager->get(fontDescriptor.get(), fontSize, scaleFactor);
-    gridView.grid = grid;
+    gridView.grids = grids;
+    gridView.smoothScrolling = [NVPreferences smoothScrolling];
+    [gridView setLatencyTracker:nvim.get_latency_tracker()];
 
-    lastGridSize = grid->size();
+    lastGridSize = grids->global_grid()->size();
     NSSize cellSize = gridView.cellSize;
 
     [window makeFirstResponder:self];
@@ -454,6 +512,8 @@ static std::pair<arc_ptr<CTFontDescriptorRef>, CGFloat> getFontDescriptor(nvim::
         [self handleScreenChanges:nil];
     }
 
+    [self prewarmGlyphs];
+
     // This notification is posted when the system display settings change.
     // It is also posted when the device driving a display changes, for example,
     // when a system switches between integrated and discrete graphics. In both
@@ -471,10 +531,20 @@ static std::pair<arc_ptr<CTFontDescriptorRef>, CGFloat> getFontDescriptor(nvim::
 }
 
 - (void)redraw {
-    const nvim::grid *grid = nvim.get_global_grid();
-    nvim::grid_size gridSize = grid->size();
+    const os_signpost_id_t signpost = os_signpost_id_make_with_pointer(latency, (__bridge void*)self);
+    os_signpost_interval_begin(latency, signpost, "GetGrids");
+
+    const nvim::grid_set *grids = nvim.get_grids();
+    os_signpost_interval_end(latency, signpost, "GetGrids", "tick=%llu", grids->tick());
+    nvim::grid_size gridSize = grids->global_grid()->size();
 
-    [gridView setGrid:grid];
+    [gridView setGrids:grids];
+
+    // Default color changes redefine the palette, which changes the glyphs
+    // worth prewarming.
+    if (grids->palette_generation() != lastPaletteGeneration) {
+        [self prewarmGlyphs];
+    }
 
     if (gridSize != lastGridSize) {
         lastGridSize = gridSize;
@@ -486,6 +556,71 @@ static std::pair<arc_ptr<CTFontDescriptorRef>, CGFloat> getFontDescriptor(nvim::
     }
 }
 
+- (void)scheduleRedraw {
+    // Occluded windows don't redraw. The redraw stays pending, so later
+    // flushes are merged into it, and it's drawn once we're visible again.
+    if (isOccluded) {
+        return;
+    }
+
+    if (displayLink) {
+        CVDisplayLinkStart(displayLink);
+    } else {
+        dispatch_async_f(dispatch_get_main_queue(), (__bridge void*)self, [](void *context) {
+            [(__bridge NVWindowController*)context displayRefresh];
+        });
+    }
+}
+
+- (void)displayRefresh {
+    redraw_scheduler &scheduler = nvim.get_redraw_scheduler();
+
+    // The window was occluded while the display link was running. Stop it,
+    // and leave the redraw pending, windowDidChangeOcclusionState catches up
+    // on it once we're visible again.
+    if (isOccluded) {
+        if (displayLink) {
+            CVDisplayLinkStop(displayLink);
+        }
+
+        scheduler.cancel_refresh();
+        return;
+    }
+
+    if (scheduler.begin_redraw()) {
+        return [self redraw];
+    }
+
+    // There's nothing to draw, so stop refreshing until the next flush. If a
+    // flush arrived while we were stopping, its redraw would be lost, so
+    // check again after stopping.
+    if (displayLink) {
+        CVDisplayLinkStop(displayLink);
+
+        if (scheduler.is_pending()) {
+            CVDisplayLinkStart(displayLink);
+        }
+    }
+}
+
+// Called on the display link's thread. Redraws happen on the main thread.
+static CVReturn displayLinkCallback(CVDisplayLinkRef displayLink,
+                                    const CVTimeStamp *now,
+                                    const CVTimeStamp *outputTime,
+                                    CVOptionFlags flagsIn,
+                                    CVOptionFlags *flagsOut,
+                                    void *context) {
+    NVWindowController *self = (__bridge NVWindowController*)context;
+
+    if (self->nvim.get_redraw_scheduler().refresh()) {
+        dispatch_async_f(dispatch_get_main_queue(), context, [](void *context) {
+            [(__bridge NVWindowController*)context displayRefresh];
+        });
+    }
+
+    return kCVReturnSuccess;
+}
+
 - (void)attach {
     dispatch_time_t timeout = dispatch_time(DISPATCH_TIME_NOW, 1 * NSEC_PER_SEC);
     nvim.ui_attach_wait(lastGridSize.width, lastGridSize.height, uiOptions, timeout);
@@ -496,7 +631,25 @@ static std::pair<arc_ptr<CTFontDescriptorRef>, CGFloat> getFontDescriptor(nvim::
     [self initialRedraw];
 }
 
+/// Records Neovim's output to a new file in the redraw capture directory, if
+/// one is set. See nvim::process::capture().
+- (void)startCapture {
+    NSString *directory = [NVPreferences redrawCaptureDirectory];
+
+    if (!directory) {
+        return;
+    }
+
+    NSString *name = [NSString stringWithFormat:@"%@.nvcapture", [[NSUUID UUID] UUIDString]];
+    NSString *path = [[directory stringByExpandingTildeInPath] stringByAppendingPathComponent:name];
+
+    if (int error = nvim.capture([path fileSystemRepresentation])) {
+        os_log_error(rpc, "Capture error: %i: %s\n", error, strerror(error));
+    }
+}
+
 - (int)connect:(NSString *)addr {
+    [self startCapture];
     int error = nvim.connect([addr UTF8String]);
 
     if (error) {
@@ -515,6 +668,7 @@ static std::pair<arc_ptr<CTFontDescriptorRef>, CGFloat> getFontDescriptor(nvim::
     const char *workingDir = [directory UTF8String];
     const char *path = [nvimExecutable UTF8String];
 
+    [self startCapture];
     int error = nvim.spawn(path, argv, (const char**)environ, workingDir);
 
     if (error) {
@@ -576,6 +730,28 @@ static std::pair<arc_ptr<CTFontDescriptorRef>, CGFloat> getFontDescriptor(nvim::
     [gridView setInactive];
 }
 
+- (void)windowDidChangeOcclusionState:(NSNotification *)notification {
+    bool occluded = !(self.window.occlusionState & NSWindowOcclusionStateVisible);
+
+    if (occluded == isOccluded) {
+        return;
+    }
+
+    isOccluded = occluded;
+    gridView.occluded = occluded;
+
+    // Any refresh already queued sees isOccluded and doesn't redraw.
+    if (occluded && displayLink) {
+        CVDisplayLinkStop(displayLink);
+    }
+
+    // Catch up on the redraw we skipped while occluded, if any. The latest
+    // grids are all we need, the view renders them in a single frame.
+    if (!occluded && nvim.get_redraw_scheduler().begin_redraw()) {
+        [self redraw];
+    }
+}
+
 - (void)windowWillStartLiveResize:(NSNotification *)notification {
     isLiveResizing += 1;
 }
@@ -811,6 +987,33 @@ static inline bool pointInGrid(nvim::grid_point point, nvim::grid_size size) {
            point.column >= 0 && point.column < size.width;
 }
 
+/// Sends a mouse event at the given global grid location.
+/// With ext_multigrid, Neovim expects locations relative to a grid. Use the
+/// given grid if it's still around, otherwise the topmost grid at location.
+/// @returns The grid the event was sent to.
+static size_t inputMouse(NVWindowController *self, std::string_view button,
+                         std::string_view action, std::string_view modifiers,
+                         nvim::grid_point location, size_t gridID = 0) {
+    if (!self->uiOptions.ext_multigrid) {
+        self->nvim.input_mouse(button, action, modifiers, 0, location.row, location.column);
+        return 0;
+    }
+
+    const nvim::grid_set *grids = self->gridView.grids;
+    const nvim::grid *grid = gridID ? grids->find(gridID) : nullptr;
+
+    if (!grid) {
+        grid = grids->grid_at(location);
+    }
+
+    nvim::grid_point origin = grid->origin();
+    int32_t row = std::max(location.row - origin.row, 0);
+    int32_t col = std::max(location.column - origin.column, 0);
+
+    self->nvim.input_mouse(button, action, modifiers, grid->id(), row, col);
+    return grid->id();
+}
+
 static void handleMouseDragEvents(void *context) {
     NVWindowController *self = (__bridge NVWindowController*)context;
 
@@ -823,7 +1026,7 @@ static void handleMouseDragEvents(void *context) {
         }
 
         input_modifiers modifiers = input_modifiers(event.modifiers);
-        self->nvim.input_mouse(buttonName(button), "drag", modifiers, event.location.row, event.location.column);
+        inputMouse(self, buttonName(button), "drag", modifiers, event.location, event.grid);
     }
 }
 
@@ -842,7 +1045,7 @@ static void handleMouseDragEvents(void *context) {
     mouseEvent.isDragging = false;
 
     input_modifiers modifiers = input_modifiers(modifierFlags);
-    nvim.input_mouse(buttonName(button), "press", modifiers, location.row, location.column);
+    mouseEvent.grid = inputMouse(self, buttonName(button), "press", modifiers, location);
 }
 
 - (void)mouseDragged:(NSEvent *)event button:(MouseButton)button {
@@ -876,7 +1079,7 @@ static void handleMouseDragEvents(void *context) {
 
     nvim::grid_point location = [gridView cellLocation:event.locationInWindow];
     input_modifiers modifiers = input_modifiers(event.modifierFlags);
-    nvim.input_mouse(buttonName(button), "release", modifiers, location.row, location.column);
+    inputMouse(self, buttonName(button), "release", modifiers, location, mouseEvent.grid);
 }
 
 - (void)mouseDown:(NSEvent *)event {
@@ -915,10 +1118,10 @@ static void handleMouseDragEvents(void *context) {
     [self mouseUp:event button:MouseButtonOther];
 }
 
-static void scrollEvent(nvim::process &nvim, size_t count, std::string_view direction,
+static void scrollEvent(NVWindowController *self, size_t count, std::string_view direction,
                         std::string_view modifiers, nvim::grid_point location) {
     for (size_t i=0; i<count; ++i) {
-        nvim.input_mouse("wheel", direction, modifiers, location.row, location.column);
+        inputMouse(self, "wheel", direction, modifiers, location);
     }
 }
 
@@ -971,15 +1174,15 @@ static void scrollEvent(nvim::process &nvim, size_t count, std::string_view dire
     input_modifiers modifiers = input_modifiers(modifierFlags);
 
     if (deltaY > 0) {
-        scrollEvent(nvim, deltaY, "up", modifiers, location);
+        scrollEvent(self, deltaY, "up", modifiers, location);
     } else if (deltaY < 0) {
-        scrollEvent(nvim, -deltaY, "down", modifiers, location);
+        scrollEvent(self, -deltaY, "down", modifiers, location);
     }
 
     if (deltaX > 0) {
-        scrollEvent(nvim, deltaX, "left", modifiers, location);
+        scrollEvent(self, deltaX, "left", modifiers, location);
     } else if (deltaX < 0) {
-        scrollEvent(nvim, -deltaX, "right", modifiers, location);
+        scrollEvent(self, -deltaX, "right", modifiers, location);
     }
 }
 
@@ -1211,9 +1414,35 @@ static inline bool canSave(nvim::process &nvim) {
     }
 }
 
+// Large pastes are streamed through nvim_paste, rather than copied through the
+// + register in one piece. Returns NO if the paste should use the register.
+// Only characterwise text is streamed, see clipboard_get_text(). Unlike the
+// "+gP used for smaller pastes, nvim_paste puts Normal mode pastes after the
+// cursor.
+- (BOOL)streamPaste:(nvim::mode)mode {
+    if (!is_normal_mode(mode) && !is_insert_mode(mode) &&
+        !is_replace_mode(mode) && !is_command_line_mode(mode) &&
+        !is_terminal_mode(mode)) {
+        return NO;
+    }
+
+    clipboard_text clipboard = clipboard_get_text();
+
+    if (clipboard.text.size() <= nvim::process::paste_chunk_size) {
+        return NO;
+    }
+
+    nvim.stream_paste(clipboard.text, std::move(clipboard.owner));
+    return YES;
+}
+
 - (IBAction)paste:(id)sender {
     nvim::mode mode = nvim.get_mode();
 
+    if ([self streamPaste:mode]) {
+        return;
+    }
+
     if (is_normal_mode(mode)) {
         nvim.feedkeys("\"+gP");
     } else if (is_visual_mode(mode)) {
@@ -1489,11 +1718,16 @@ static inline bool shouldShowTabLine(size_t tabsCount, nvim::showtabline showtab
         return;
     }
 
-    std::lock_guard<unfair_lock> lg(nvim.get_tab_lock());
+    // Updates are coalesced, the latest tabline may already be shown.
+    const nvim::tabline &tabline = nvim.get_tabline();
+    uint64_t version = nvim.get_tabline_version();
+
+    if (version == tabLineVersion) {
+        return;
+    }
 
-    auto tabpages = nvim.get_tabs();
-    auto selected = nvim.get_selected_tab();
-    auto tabCount = tabpages.size();
+    tabLineVersion = version;
+    auto tabCount = tabline.tabs.size();
 
     bool shownAtStart = tabLine.isShown;
     bool shownAtEnd = shouldShowTabLine(tabCount, showTabLineOption);
@@ -1503,55 +1737,69 @@ static inline bool shouldShowTabLine(size_t tabsCount, nvim::showtabline showtab
         [self hideTabLine];
     }
 
-    for (NVTab *tab in tabs) {
-        auto *tabpage = static_cast<nvim::tabpage*>(tab.tabpage);
-
-        if (tabpage->closed) {
-            nvim.free_tabpage(tabpage);
-
-            if (shouldAnimate) {
-                [tabLine animateCloseTab:tab];
-            } else {
-                [tabLine closeTab:tab];
-            }
-        } else {
-            if (tabpage->name_changed) {
-                tabpage->name_changed = false;
-                tab.title = NSStringFromStringView(tabpage->name);
-            }
+    // Index the tabs we're showing by handle. Tabs left in the index after
+    // matching the new tabline have been closed.
+    std::unordered_map<int, size_t> shownIndex;
+    shownIndex.reserve(tabPages.size());
 
-            if (tabpage->filetype_changed) {
-                tabpage->filetype_changed = false;
-                tab.filetype = NSStringFromStringView(tabpage->filetype);
-            }
-        }
+    for (size_t index=0; index<tabPages.size(); ++index) {
+        shownIndex.emplace(tabPages[index].handle, index);
     }
 
-    [tabs removeAllObjects];
+    NSMutableArray<NVTab*> *newTabs = [NSMutableArray arrayWithCapacity:tabCount];
+    std::vector<size_t> addedTabs;
 
     for (size_t index=0; index<tabCount; ++index) {
-        auto tabpage = tabpages[index];
-        NVTab *tab = (__bridge NVTab*)tabpage->nvtab;
+        const nvim::tabpage &tabpage = tabline.tabs[index];
+        auto iter = shownIndex.find(tabpage.handle);
+        NVTab *tab;
 
-        if (!tab) {
-            NSString *title = NSStringFromStringView(tabpage->name);
-            NSString *filetype = NSStringFromStringView(tabpage->filetype);
-            tab = [[NVTab alloc] initWithTitle:title filetype:filetype tabpage:tabpage tabLine:tabLine];
-            tabpage->nvtab = (__bridge void*)tab;
+        if (iter != shownIndex.end()) {
+            tab = tabs[iter->second];
+            const nvim::tabpage &shown = tabPages[iter->second];
 
-            if (shouldAnimate) {
-                [tabLine animateAddTab:tab atIndex:index isSelected:tabpage == selected];
+            if (shown.name != tabpage.name) {
+                tab.title = NSStringFromStringView(tabpage.name);
             }
+
+            if (shown.filetype != tabpage.filetype) {
+                tab.filetype = NSStringFromStringView(tabpage.filetype);
+            }
+
+            shownIndex.erase(iter);
+        } else {
+            NSString *title = NSStringFromStringView(tabpage.name);
+            NSString *filetype = NSStringFromStringView(tabpage.filetype);
+            tab = [[NVTab alloc] initWithTitle:title filetype:filetype handle:tabpage.handle tabLine:tabLine];
+            addedTabs.push_back(index);
         }
 
-        [tabs addObject:tab];
+        [newTabs addObject:tab];
+    }
+
+    for (const auto &kv : shownIndex) {
+        if (shouldAnimate) {
+            [tabLine animateCloseTab:tabs[kv.second]];
+        } else {
+            [tabLine closeTab:tabs[kv.second]];
+        }
+    }
+
+    if (shouldAnimate) {
+        for (size_t index : addedTabs) {
+            [tabLine animateAddTab:newTabs[index] atIndex:index isSelected:index == tabline.selected];
+        }
     }
 
+    tabs = newTabs;
+    tabPages = tabline.tabs;
+    NVTab *selected = tabs[tabline.selected];
+
     if (shouldAnimate) {
-        [tabLine animateSetTabs:tabs selectedTab:(__bridge NVTab*)selected->nvtab];
+        [tabLine animateSetTabs:tabs selectedTab:selected];
     } else {
         [tabLine setTabs:tabs];
-        [tabLine setSelectedTab:(__bridge NVTab*)selected->nvtab];
+        [tabLine setSelectedTab:selected];
     }
 
     if (!shownAtStart && shownAtEnd) {
@@ -1568,12 +1816,10 @@ static inline bool shouldShowTabLine(size_t tabsCount, nvim::showtabline showtab
         return [self normalCommand:"quit"];
     }
 
-    auto tabpage = static_cast<nvim::tabpage*>(tab.tabpage);
-
     std::string command;
     command.reserve(256);
     command.append("execute \"tabclose \" . nvim_tabpage_get_number(");
-    command.append(std::to_string(tabpage->handle));
+    command.append(std::to_string(tab.handle));
     command.push_back(')');
 
     [self normalCommand:command];
@@ -1590,12 +1836,10 @@ static inline bool shouldShowTabLine(size_t tabsCount, nvim::showtabline showtab
         nvim.feedkeys(CTRL_BACKSLASH CTRL_N);
     }
 
-    auto tabpage = static_cast<nvim::tabpage*>(tab.tabpage);
-
     std::string command;
     command.reserve(256);
     command.append("execute \"tabnext \" . nvim_tabpage_get_number(");
-    command.append(std::to_string(tabpage->handle));
+    command.append(std::to_string(tab.handle));
     command.push_back(')');
 
     auto response = nvim.sync_command(command, dispatch_time(DISPATCH_TIME_NOW, 100 * NSEC_PER_MSEC));
@@ -1664,9 +1908,7 @@ void window_controller::shutdown() {
 }
 
 void window_controller::redraw() {
-    dispatch_async_f(dispatch_get_main_queue(), controller, [](void *context) {
-        [(__bridge NVWindowController*)context redraw];
-    });
+    [(__bridge NVWindowController*)controller scheduleRedraw];
 }
 
 void window_controller::title_set() {
@@ -0,0 +1,47 @@
+//
+//  Neovim Mac
+//  block_fill.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef BLOCK_FILL_HPP
+#define BLOCK_FILL_HPP
+
+#include <simd/simd.h>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+/// Fills the count objects starting at dest with copies of value.
+///
+/// Objects must be 16 bytes, the width of a vector register. The value is
+/// loaded into a register once, and stored four registers, 64 bytes, at a
+/// time. Stores are done with memcpy, which compiles to unaligned vector
+/// stores, so dest only has to be aligned for T.
+template<typename T>
+inline void block_fill(T *dest, const T &value, size_t count) {
+    static_assert(sizeof(T) == sizeof(simd_uint4), "16 byte objects only");
+    static_assert(std::is_trivially_copyable_v<T>, "Trivially copyable types only");
+
+    simd_uint4 pattern;
+    memcpy(&pattern, &value, sizeof(pattern));
+
+    char *out = reinterpret_cast<char*>(dest);
+    char *end = out + (count * sizeof(T));
+
+    for (; end - out >= 64; out += 64) {
+        memcpy(out,      &pattern, sizeof(pattern));
+        memcpy(out + 16, &pattern, sizeof(pattern));
+        memcpy(out + 32, &pattern, sizeof(pattern));
+        memcpy(out + 48, &pattern, sizeof(pattern));
+    }
+
+    for (; out != end; out += 16) {
+        memcpy(out, &pattern, sizeof(pattern));
+    }
+}
+
+#endif // BLOCK_FILL_HPP
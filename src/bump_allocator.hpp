@@ -34,6 +34,12 @@
 // On deallocation, all used buffers are freed and the tracking pointer is
 // reset to the end of the current backing buffer.
 //
+// Allocators that are reused for similarly sized workloads, like an unpacker
+// reused for every message, can call reset() instead. If the workload didn't
+// fit in a single backing buffer, the used buffers are consolidated into one
+// large enough to hold them all. From then on the workload is served without
+// calling malloc.
+//
 // If AddressSanitizer is enabled we poison and unpoison memory as needed. We
 // also guard each allocation with a small poisoned memory region.
 
@@ -43,6 +49,7 @@ private:
     char *end;
     char *ptr;
     void **used_buffers;
+    size_t used_capacity;
 
     static constexpr size_t alignment = 8;
     static constexpr size_t header_size = sizeof(void*);
@@ -110,6 +117,7 @@ private:
         }
 
         push_used_buffer(oldbuff);
+        used_capacity += oldsize;
         new_backing_buffer(newsize);
 
         ptr = (char*)align_down((uintptr_t)end - size);
@@ -134,6 +142,7 @@ public:
         end = nullptr;
         ptr = nullptr;
         used_buffers = nullptr;
+        used_capacity = 0;
     }
 
     /// Construct a new allocator with the given capacity
@@ -141,6 +150,7 @@ public:
     explicit bump_allocator(size_t init_capacity) {
         new_backing_buffer(align_up(init_capacity));
         used_buffers = nullptr;
+        used_capacity = 0;
     }
 
     bump_allocator(const bump_allocator&) = delete;
@@ -151,11 +161,13 @@ public:
         end = other.end;
         ptr = other.ptr;
         used_buffers = other.used_buffers;
+        used_capacity = other.used_capacity;
 
         other.start = nullptr;
         other.end = nullptr;
         other.ptr = nullptr;
         other.used_buffers = nullptr;
+        other.used_capacity = 0;
     }
 
     bump_allocator& operator=(bump_allocator &&other) {
@@ -166,11 +178,13 @@ public:
         end = other.end;
         ptr = other.ptr;
         used_buffers = other.used_buffers;
+        used_capacity = other.used_capacity;
 
         other.start = nullptr;
         other.end = nullptr;
         other.ptr = nullptr;
         other.used_buffers = nullptr;
+        other.used_capacity = 0;
 
         return *this;
     }
@@ -194,6 +208,7 @@ public:
     void reserve(size_t size) {
         if (size > remaining()) {
             push_used_buffer(backing_buffer());
+            used_capacity += capacity();
             new_backing_buffer(align_up(size) + header_size);
         }
     }
@@ -212,9 +227,25 @@ public:
             ::free(pop_used_buffer());
         }
 
+        used_capacity = 0;
         ptr = end;
         ASAN_POISON_MEMORY_REGION(start, end - start);
     }
+
+    /// Deallocates all current allocations. If they spanned several backing
+    /// buffers, the buffers are replaced by a single buffer large enough to
+    /// hold all of them.
+    void reset() {
+        if (!used_buffers) {
+            return dealloc_all();
+        }
+
+        size_t total = used_capacity + capacity();
+        dealloc_all();
+
+        ::free(backing_buffer());
+        new_backing_buffer(total);
+    }
 };
 
 inline void* operator new(size_t size, bump_allocator &allocator) {
@@ -10,6 +10,7 @@
 #ifndef CIRCULAR_BUFFER_HPP
 #define CIRCULAR_BUFFER_HPP
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <mach/vm_page_size.h>
@@ -190,6 +191,25 @@ public:
         length += size;
     }
 
+    /// Returns a pointer to the end of the buffer, where at least size bytes
+    /// can be written. The buffer resizes if necessary. Bytes written to the
+    /// returned pointer are appended by a subsequent call to commit().
+    /// Complexity: Constant, or linear in size() if the buffer resizes.
+    char* prepare(size_t size) {
+        if (UNLIKELY(size > buffsize - length)) {
+            resize(round_up_capacity(std::max(buffsize * 2, length + size)));
+        }
+
+        return end();
+    }
+
+    /// Appends size bytes previously written to the pointer returned by
+    /// prepare(). Complexity: Constant.
+    void commit(size_t size) {
+        assert(size <= buffsize - length);
+        length += size;
+    }
+
     /// Consume size bytes from the start of the buffer. This marks the region
     /// as safe to overwrite with new data. Complexity: Constant.
     void consume(size_t size) {
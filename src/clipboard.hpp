@@ -10,7 +10,8 @@
 #ifndef CLIPBOARD_HPP
 #define CLIPBOARD_HPP
 
-#include <string>
+#include <memory>
+#include <string_view>
 #include <tuple>
 #include <vector>
 
@@ -28,12 +29,30 @@
 ///
 /// See :help clipboard for more.
 
+/// The system clipboard's text, encoded as UTF-8.
+///
+/// The text is a view into pasteboard data, owner keeps that data alive. Empty
+/// if the clipboard doesn't hold any text.
+struct clipboard_text {
+    std::shared_ptr<const void> owner;
+    std::string_view text;
+};
+
 /// Clipboard data
 ///
-/// A tuple of:
-///   1. An array of lines.
-///   2. A string representing the register type.
-using clipboard_data = std::tuple<std::vector<std::string>, msg::string>;
+/// The lines are views into the clipboard text, they're valid for the
+/// lifetime of the clipboard_data object. Pack with as_tuple().
+struct clipboard_data {
+    clipboard_text text;
+    std::vector<std::string_view> lines;
+    msg::string regtype;
+
+    /// Returns the data as Neovim's clipboard providers expect it. That is a
+    /// tuple of the lines and a string representing the register type.
+    auto as_tuple() const {
+        return std::tie(lines, regtype);
+    }
+};
 
 /// Sets the system clipboard.
 ///
@@ -48,4 +67,11 @@ void clipboard_set(msg::array args);
 /// @returns A clipboard_data object.
 clipboard_data clipboard_get();
 
+/// Get the text of the system clipboard without splitting it into lines.
+///
+/// Used to stream large pastes through nvim_paste. Returns an empty text if
+/// the clipboard holds a linewise or blockwise register, nvim_paste pastes
+/// characterwise and would drop the register type. Use clipboard_get() then.
+clipboard_text clipboard_get_text();
+
 #endif // CLIPBOARD_HPP
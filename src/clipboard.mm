@@ -64,65 +64,159 @@ msg::string to_register_string(register_type regtype) {
     }
 }
 
-clipboard_data make_clipboard_data(register_type regtype, NSString *string) {
-    NSCharacterSet *newLines = [NSCharacterSet newlineCharacterSet];
-    NSArray *nsLines = [string componentsSeparatedByCharactersInSet:newLines];
+clipboard_text make_clipboard_text(NSData *data) {
+    if (!data) {
+        return clipboard_text();
+    }
+
+    clipboard_text text;
+    text.text = std::string_view(static_cast<const char*>([data bytes]),
+                                 [data length]);
+    text.owner = std::shared_ptr<const void>(CFBridgingRetain(data), CFRelease);
+    return text;
+}
+
+// Splits text into lines. Line breaks are LF, CR LF, or a lone CR.
+std::vector<std::string_view> split_lines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    size_t begin = 0;
 
-    std::vector<std::string> lines;
-    lines.reserve([nsLines count]);
+    for (size_t i=0; i<text.size(); ++i) {
+        char c = text[i];
+
+        if (c == '\n' || c == '\r') {
+            lines.push_back(text.substr(begin, i - begin));
+
+            if (c == '\r' && i + 1 < text.size() && text[i + 1] == '\n') {
+                i += 1;
+            }
 
-    for (NSString *line in nsLines) {
-        lines.emplace_back([line UTF8String]);
+            begin = i + 1;
+        }
     }
 
-    return clipboard_data(std::move(lines), to_register_string(regtype));
+    lines.push_back(text.substr(begin));
+    return lines;
 }
 
-clipboard_data autoreleased_clipboard_get() {
-    NSPasteboard *pasteboard = [NSPasteboard generalPasteboard];
-    NSArray *supportedTypes = @[NVimPasteboardType, NSPasteboardTypeString];
+clipboard_data make_clipboard_data(register_type regtype, NSData *data) {
+    clipboard_data clipboard;
+    clipboard.text = make_clipboard_text(data);
+    clipboard.lines = split_lines(clipboard.text.text);
+    clipboard.regtype = to_register_string(regtype);
+    return clipboard;
+}
 
+// If the clipboard holds a Vim register, returns its type and text.
+std::optional<std::tuple<register_type, NSString*>> vim_register(NSPasteboard *pasteboard) {
+    NSArray *supportedTypes = @[NVimPasteboardType, NSPasteboardTypeString];
     NSString *available = [pasteboard availableTypeFromArray:supportedTypes];
 
-    if ([available isEqual:NVimPasteboardType]) {
-        // This should be an array with two objects:
-        //   1. Register type (NSNumber)
-        //   2. Text (NSString)
-        //
-        // If this is not the case we fall back on using NSPasteboardTypeString.
-        NSArray *plist = [pasteboard propertyListForType:NVimPasteboardType];
-
-        if ([plist isKindOfClass:[NSArray class]] && [plist count] == 2 &&
-            [plist[0] isKindOfClass:[NSNumber class]] &&
-            [plist[1] isKindOfClass:[NSString class]]) {
-            auto regtype = static_cast<register_type>((int)[plist[0] intValue]);
-            return make_clipboard_data(regtype, plist[1]);
-        }
+    if (![available isEqual:NVimPasteboardType]) {
+        return std::nullopt;
+    }
+
+    // This should be an array with two objects:
+    //   1. Register type (NSNumber)
+    //   2. Text (NSString)
+    //
+    // If this is not the case we fall back on using NSPasteboardTypeString.
+    NSArray *plist = [pasteboard propertyListForType:NVimPasteboardType];
+
+    if ([plist isKindOfClass:[NSArray class]] && [plist count] == 2 &&
+        [plist[0] isKindOfClass:[NSNumber class]] &&
+        [plist[1] isKindOfClass:[NSString class]]) {
+        auto regtype = static_cast<register_type>((int)[plist[0] intValue]);
+        return std::make_tuple(regtype, (NSString*)plist[1]);
+    }
+
+    return std::nullopt;
+}
+
+// Returns the clipboard's plain text as UTF-8. Pasteboard data is used as is,
+// unless it only holds another string representation.
+NSData* string_data(NSPasteboard *pasteboard) {
+    NSData *data = [pasteboard dataForType:NSPasteboardTypeString];
+
+    if (data) {
+        return data;
     }
 
     NSString *string = [pasteboard stringForType:NSPasteboardTypeString];
+    return [string dataUsingEncoding:NSUTF8StringEncoding];
+}
 
-    if (!string) {
+clipboard_data autoreleased_clipboard_get() {
+    NSPasteboard *pasteboard = [NSPasteboard generalPasteboard];
+
+    if (auto reg = vim_register(pasteboard)) {
+        auto [regtype, string] = *reg;
+        return make_clipboard_data(regtype, [string dataUsingEncoding:NSUTF8StringEncoding]);
+    }
+
+    NSData *data = string_data(pasteboard);
+
+    if (!data) {
         return clipboard_data();
     }
 
-    return make_clipboard_data(register_type::unknown, string);
+    return make_clipboard_data(register_type::unknown, data);
+}
+
+clipboard_text autoreleased_clipboard_get_text() {
+    NSPasteboard *pasteboard = [NSPasteboard generalPasteboard];
+
+    if (auto reg = vim_register(pasteboard)) {
+        auto [regtype, string] = *reg;
+
+        // Linewise and blockwise registers must be put as such, nvim_paste
+        // only pastes characterwise.
+        if (regtype == register_type::line || regtype == register_type::block) {
+            return clipboard_text();
+        }
+
+        return make_clipboard_text([string dataUsingEncoding:NSUTF8StringEncoding]);
+    }
+
+    return make_clipboard_text(string_data(pasteboard));
 }
 
 void autoreleased_clipboard_set(msg::array lines, msg::string regstring) {
-    std::string buffer;
-    buffer.reserve(lines.size() * 128);
+    // The lines are views into the unpacker's buffer. Join them straight into
+    // a buffer of the exact size, which the string takes ownership of.
+    size_t length = lines.size() ? lines.size() - 1 : 0;
+
+    for (auto object : lines) {
+        length += object.get<msg::string>().size();
+    }
+
+    char *buffer = static_cast<char*>(malloc(std::max(length, 1ul)));
+    char *current = buffer;
+    bool first = true;
 
     for (auto object : lines) {
         msg::string line = object.get<msg::string>();
-        buffer.append(line.data(), line.size());
-        buffer.push_back('\n');
+
+        if (!first) {
+            *current++ = '\n';
+        }
+
+        first = false;
+        memcpy(current, line.data(), line.size());
+        current += line.size();
     }
 
-    size_t length = std::max(buffer.length(), 1ul) - 1;
-    NSString *string = [[NSString alloc] initWithBytes:buffer.data()
-                                                length:length
-                                              encoding:NSUTF8StringEncoding];
+    NSString *string = [[NSString alloc] initWithBytesNoCopy:buffer
+                                                      length:length
+                                                    encoding:NSUTF8StringEncoding
+                                                freeWhenDone:YES];
+
+    if (!string) {
+        // On failure, the buffer is still ours.
+        free(buffer);
+        return os_log_info(rpc, "Clipboard set encoding error - Lines=%zu",
+                           lines.size());
+    }
 
     register_type regtype = to_register_type(regstring);
     NSPasteboard *pasteboard = [NSPasteboard generalPasteboard];
@@ -158,6 +252,12 @@ clipboard_data clipboard_get() {
     }
 }
 
+clipboard_text clipboard_get_text() {
+    @autoreleasepool {
+        return autoreleased_clipboard_get_text();
+    }
+}
+
 void clipboard_set(msg::array args) {
     if (type_check_args(args)) {
         msg::array lines = args[0].get<msg::array>();
@@ -10,14 +10,19 @@
 #ifndef GLYPH_HPP
 #define GLYPH_HPP
 
+#include <dispatch/dispatch.h>
 #include <simd/simd.h>
 #include <Metal/Metal.h>
-#include <unordered_map>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <string>
+#include "glyph_archive.hpp"
+#include "hash_table.hpp"
+#include "latency_tracker.hpp"
 #include "shader_types.hpp"
 #include "ui.hpp"
+#include "unfair_lock.hpp"
 
 /// A smart pointer that manages CoreFoundation objects.
 /// Works with any pointer compatible with CFRetain / CFRelease.
@@ -293,15 +298,83 @@ public:
     }
 };
 
+/// A pool of glyph rasterizers for rasterizing glyphs off the main thread.
+/// Each rasterizer is bound to its own serial dispatch queue, all of which
+/// target a concurrent global queue. Work is distributed round robin.
+class glyph_rasterizer_pool {
+private:
+    struct worker {
+        glyph_rasterizer rasterizer;
+        dispatch_queue_t queue;
+    };
+
+    std::vector<worker> workers;
+    size_t next_worker;
+
+public:
+    /// Constructs an empty pool.
+    glyph_rasterizer_pool(): next_worker(0) {}
+
+    /// Constructs a pool of count rasterizers.
+    /// @param count    The number of rasterizers in the pool.
+    /// @param width    The width passed to each glyph_rasterizer.
+    /// @param height   The height passed to each glyph_rasterizer.
+    glyph_rasterizer_pool(size_t count, size_t width, size_t height);
+
+    /// Returns the number of rasterizers in the pool.
+    size_t size() const {
+        return workers.size();
+    }
+
+    /// Returns the next rasterizer and the queue it must be used on.
+    /// Precondition: size() > 0. This function is not thread safe.
+    std::pair<glyph_rasterizer*, dispatch_queue_t> next() {
+        worker &next = workers[next_worker];
+        next_worker = (next_worker + 1) % workers.size();
+        return {&next.rasterizer, next.queue};
+    }
+};
+
 /// Caches glyphs in a Metal texture.
 /// Glyphs are cached in an array of 2d textures. Each texture in the texture
 /// array is a cache page. Cache pages are added and evicted as needed. The
 /// texture cache uses a FIFO cache eviction scheme.
+///
+/// The texture is not written to directly. New bitmaps are copied into shared
+/// staging buffers, and page array resizes are recorded. The pending copies
+/// are encoded in a single blit pass by flush(), which must be called on the
+/// command buffer of any frame that uses the cache.
 class glyph_texture_cache {
 private:
+    /// A shared memory buffer that bitmaps are staged in.
+    /// A staging buffer is in flight from the moment it receives its first
+    /// bitmap until the command buffer that copies its contents completes.
+    struct staging_buffer {
+        id<MTLBuffer> buffer;
+        size_t used;
+        std::atomic<bool> in_flight;
+    };
+
+    /// A copy that will be encoded on the next flush().
+    /// Bitmap uploads copy from a staging buffer to a region of a single
+    /// page. Page array copies copy count whole pages between textures.
+    struct pending_copy {
+        id<MTLTexture> destination;
+        id<MTLTexture> source_texture;
+        id<MTLBuffer> source_buffer;
+        size_t source_offset;
+        size_t source_stride;
+        MTLRegion region;
+        size_t slice;
+        size_t count;
+    };
+
     id<MTLDevice> device;
-    id<MTLCommandQueue> queue;
     id<MTLTexture> texture;
+    std::vector<std::shared_ptr<staging_buffer>> staging_ring;
+    std::vector<std::shared_ptr<staging_buffer>> staged;
+    std::vector<pending_copy> pending;
+    size_t staging_size;
     double growth_factor;
     size_t page_count;
     size_t page_index;
@@ -315,6 +388,11 @@ private:
 
     void realloc(size_t new_page_count, size_t begin, size_t count);
 
+    void upload(const glyph_bitmap &bitmap, size_t x, size_t y,
+                size_t width, size_t height);
+
+    staging_buffer& staging_for(size_t size);
+
 public:
     /// Default constructed objects should only be assigned to or destroyed.
     /// This constructor is only provided because Objective-C++ requires C++
@@ -370,10 +448,17 @@ public:
     ///          z - The cache page the bitmap was stored in.
     simd_short3 add(const glyph_bitmap &bitmap);
 
+    /// Encodes all pending bitmap uploads and page array copies.
+    /// @param command_buffer The command buffer of the frame being rendered.
+    ///                       The copies are encoded in a single blit pass, and
+    ///                       should precede any passes that read the texture.
+    void flush(id<MTLCommandBuffer> command_buffer);
+
     /// Evicts all but the newest n cache pages.
     /// Eviction is done by copying the contents of the page array to a new
     /// smaller MTLTexture. The existing MTLTexture is released, but it is not
-    /// mutated, other references to it remain valid.
+    /// mutated, other references to it remain valid. The copy is encoded on
+    /// the next flush().
     ///
     /// @param preserve The maximum number of cache pages to preserve. The
     /// newest cache pages are preserved, starting with the one currently
@@ -387,9 +472,24 @@ public:
 /// Rasterizes and caches glyphs.
 /// Glyph managers rasterize text on demand and cache the resulting bitmaps in
 /// glyph_texture_caches. A glyph manager will always ensure every glyph
-/// required to render a frame is in GPU memory. Once a frame has been
-/// committed, you should call evict() on the glyph_manager object to give it
-/// a chance to cull old cache pages.
+/// required to render a frame is in GPU memory, provided flush() is called on
+/// the frame's command buffer. Once a frame has been committed, you should call
+/// evict() on the glyph_manager object to give it a chance to cull old cache
+/// pages.
+///
+/// If constructed with a glyph_rasterizer_pool, glyphs that are expensive to
+/// rasterize (anything other than single byte graphemes, i.e. CJK text or
+/// emoji) are rasterized in the background. Until they're ready, get() returns
+/// an empty placeholder glyph. Call update() before encoding each frame to add
+/// the finished glyphs to the cache.
+///
+/// Glyph managers can optionally cache coverage masks instead of colored
+/// glyphs. See glyph_rasterizer for why that isn't the default. In this mode,
+/// glyphs are rasterized once per font, grapheme, and dilation bucket, and are
+/// tinted by the glyph shader. Foreground colors are quantized by luminance
+/// into a small number of buckets, each rasterized with a representative gray,
+/// which approximates CoreText's color dependent stem darkening. Glyphs that
+/// are drawn in color, like emoji, are still cached per color combination.
 class glyph_manager {
 private:
     struct key_type {
@@ -399,6 +499,8 @@ private:
         uint32_t foreground;
         CTFontRef font;
 
+        key_type() = default;
+
         key_type(CTFontRef font,
                  const nvim::grapheme_cluster &graphemes,
                  nvim::rgb_color background,
@@ -422,33 +524,237 @@ private:
             jumbled.w = ((uintptr_t)font >> 3) ^ foreground ^ background;
             hash = jumbled.x ^ jumbled.y ^ jumbled.z ^ jumbled.w;
         }
-    };
 
-    struct key_hash {
-        size_t operator()(const key_type &key) const {
-            return key.hash;
+        /// Constructs the key of a coverage mask. Mask keys store the dilation
+        /// bucket as their background, which never has its alpha bits set, so
+        /// they can't collide with the keys of colored glyphs.
+        static key_type mask(CTFontRef font,
+                             const nvim::grapheme_cluster &graphemes,
+                             uint32_t bucket) {
+            key_type key(font, graphemes, nvim::rgb_color(), nvim::rgb_color());
+            key.background = bucket;
+            key.foreground = 0;
+            key.hash ^= bucket;
+            return key;
+        }
+
+        /// True if this is the key of a coverage mask.
+        bool is_mask() const {
+            return !(background & 0xFF000000);
         }
     };
 
-    struct key_equal {
-        bool operator()(const key_type &left, const key_type &right) const {
-            return memcmp(&left, &right, sizeof(key_type)) == 0;
+    using glyph_map = hash_table<key_type, glyph_rect>;
+
+    /// Placeholder glyphs are empty and refer to the nonexistent page -1.
+    static constexpr int16_t placeholder_page = -1;
+
+    static glyph_rect placeholder() {
+        glyph_rect rect = {};
+        rect.texture_origin.z = placeholder_page;
+        return rect;
+    }
+
+    /// Stored under a mask key if the glyph turned out to be colored. Lookups
+    /// that find it fall back to caching the glyph per color combination.
+    static constexpr int16_t colored_marker = -1;
+
+    static glyph_rect colored() {
+        glyph_rect rect = placeholder();
+        rect.texture_origin.w = colored_marker;
+        return rect;
+    }
+
+    static bool is_colored_marker(const glyph_rect &rect) {
+        return rect.texture_origin.w == colored_marker;
+    }
+
+    static bool is_placeholder(const glyph_rect &rect) {
+        return rect.texture_origin.z == placeholder_page &&
+               rect.texture_origin.w != colored_marker;
+    }
+
+    /// A glyph rasterized in the background.
+    struct rasterized_glyph {
+        key_type key;
+        glyph_bitmap bitmap;
+        std::unique_ptr<unsigned char[]> pixels;
+        bool colored;
+        bool prewarmed;
+    };
+
+    /// State shared with background rasterization jobs. Jobs may outlive the
+    /// glyph manager, so the state is reference counted.
+    struct async_state {
+        unfair_lock lock;
+        std::vector<rasterized_glyph> completed;
+        dispatch_source_t ready;
+
+        ~async_state() {
+            if (ready) {
+                dispatch_source_cancel(ready);
+            }
         }
     };
 
-    using glyph_map = std::unordered_map<key_type,
-                                         glyph_rect,
-                                         key_hash,
-                                         key_equal>;
+    struct async_job;
+    struct prewarm_job;
+
+    static void run_async_job(void *context);
+    static void run_prewarm_job(void *context);
+
+    /// Rasterizes the key's text, copying the bitmap out of the rasterizer's
+    /// canvas so it outlives the next rasterization.
+    static rasterized_glyph rasterize_detached(glyph_rasterizer *rasterizer,
+                                               const key_type &key,
+                                               size_t length,
+                                               nvim::rgb_color background,
+                                               nvim::rgb_color foreground);
+
+    /// Hands glyphs rasterized in the background over to update().
+    static void complete_async(async_state &state,
+                               std::vector<rasterized_glyph> glyphs);
+
+    // Enough for a few screens worth of distinct glyphs.
+    static constexpr size_t initial_map_capacity = 2048;
 
     size_t evict_threshold;
     size_t evict_preserve;
     glyph_rasterizer *rasterizer;
+    glyph_rasterizer_pool *pool;
     glyph_texture_cache texture_cache;
     glyph_map map;
+    std::shared_ptr<async_state> async;
+    glyph_archive *archive = nullptr;
+    std::vector<std::pair<CTFontRef, uint64_t>> archive_fonts;
+    std::vector<key_type> prewarmed;
+    uint64_t generation_count = 1;
+    uint64_t resolved_count = 0;
+    uint32_t memo_id = 0;
+    uint32_t dilation_buckets = 0;
+    glyph_cache_stats counters = {};
 
     void do_evict();
 
+    /// Adds a rasterized glyph to the texture cache.
+    /// @param mask True if the bitmap was converted to a coverage mask.
+    glyph_rect cache(const glyph_bitmap &glyph, bool mask = false);
+
+    /// Returns the archive key of a glyph.
+    glyph_archive::key_type archive_key(const key_type &key);
+
+    /// Caches an archived glyph, if the archive has one.
+    /// @returns The glyph's map slot, or npos if it isn't archived.
+    size_t unarchive(const key_type &key);
+
+    /// Archives a rasterized glyph, so later sessions can skip rasterizing it.
+    void archive_glyph(const key_type &key, const glyph_bitmap &glyph);
+
+    /// Returns the dilation bucket of the given foreground color.
+    uint32_t dilation_bucket(nvim::rgb_color foreground) const;
+
+    /// The representative colors used to rasterize a dilation bucket.
+    static std::pair<nvim::rgb_color, nvim::rgb_color>
+    bucket_colors(uint32_t bucket, uint32_t bucket_count);
+
+    /// Returns the map slot of a coverage mask, or npos if the glyph is
+    /// colored and can't be tinted.
+    size_t lookup_mask(CTFontRef font,
+                       const nvim::cell &cell,
+                       nvim::rgb_color foreground);
+
+    /// Rasterizes the key's text on a pool rasterizer.
+    void rasterize_async(const key_type &key, size_t length,
+                         nvim::rgb_color background,
+                         nvim::rgb_color foreground);
+
+    /// Returns a process unique memo_id for a new glyph manager.
+    static uint32_t next_memo_id();
+
+    /// Memoized slots are valid until glyphs are evicted or the map rehashes.
+    /// Cells are shared by every render context's glyph manager, so the sum
+    /// includes memo_id, otherwise two managers with the same counters would
+    /// trust each other's memos. In practice the sum is never zero, the
+    /// cell's "nothing memoized" value.
+    uint32_t memo_generation() const {
+        return static_cast<uint32_t>(memo_id + generation_count + map.generation());
+    }
+
+    /// Returns the cell's memoized slot, or npos if the memo is stale.
+    size_t memoized_slot(CTFontRef font,
+                         const nvim::cell &cell,
+                         uint32_t generation) const {
+        if (!cell.has_memoized_glyph(generation)) {
+            return glyph_map::npos;
+        }
+
+        // Memo generations can collide, so never index out of bounds.
+        size_t slot = cell.memoized_glyph();
+
+        if (slot >= map.slot_count() || map.key_at(slot).font != font) {
+            return glyph_map::npos;
+        }
+
+        return slot;
+    }
+
+    /// Returns the map slot of a cached glyph, or npos if it isn't cached.
+    /// Unlike lookup(), nothing is modified.
+    size_t find_slot(CTFontRef font,
+                     const nvim::cell &cell,
+                     nvim::rgb_color background,
+                     nvim::rgb_color foreground) const {
+        if (dilation_buckets) {
+            uint32_t bucket = dilation_bucket(foreground);
+            size_t slot = map.find_slot(key_type::mask(font, cell.grapheme(), bucket));
+
+            if (slot == glyph_map::npos || !is_colored_marker(map.value_at(slot))) {
+                return slot;
+            }
+        }
+
+        return map.find_slot(key_type(font, cell.grapheme(), background, foreground));
+    }
+
+    /// Returns the map slot of a cached glyph, rasterizing it if necessary.
+    size_t lookup(CTFontRef font,
+                  const nvim::cell &cell,
+                  nvim::rgb_color background,
+                  nvim::rgb_color foreground) {
+        if (dilation_buckets) {
+            if (size_t slot = lookup_mask(font, cell, foreground); slot != glyph_map::npos) {
+                return slot;
+            }
+        }
+
+        key_type key(font, cell.grapheme(), background, foreground);
+
+        if (size_t slot = map.find_slot(key); slot != glyph_map::npos) {
+            counters.cached += 1;
+            return slot;
+        }
+
+        if (size_t slot = unarchive(key); slot != glyph_map::npos) {
+            return slot;
+        }
+
+        std::string_view text = cell.grapheme_view();
+        counters.rasterized += 1;
+
+        if (async && text.size() > 1) {
+            rasterize_async(key, text.size(), background, foreground);
+            return map.insert(key, placeholder());
+        }
+
+        glyph_bitmap glyph = rasterizer->rasterize(font,
+                                                   background,
+                                                   foreground,
+                                                   text);
+
+        archive_glyph(key, glyph);
+        return map.insert(key, cache(glyph));
+    }
+
 public:
     /// Default constructed objects should only be assigned to or destroyed.
     /// This constructor is only provided because Objective-C++ requires C++
@@ -462,14 +768,28 @@ public:
     /// @param evict_preserve   The number of texture cache pages preserved
     ///                         on eviction. This number should be less than
     ///                         evict_threshold.
+    /// @param pool             The shared rasterizer pool used for background
+    ///                         rasterization. Pass nullptr, or an empty pool,
+    ///                         to rasterize every glyph synchronously.
+    /// @param ready            Called on the main queue when background
+    ///                         glyphs are ready to be added by update().
+    ///                         Multiple completions are coalesced.
+    /// @param dilation_buckets If non zero, glyphs are cached as coverage
+    ///                         masks, with foreground colors quantized into
+    ///                         this many dilation buckets. Pass 0 to cache
+    ///                         glyphs per color combination.
+    /// @param archive          The shared glyph archive. Glyphs missing from
+    ///                         the cache are loaded from the archive rather
+    ///                         than rasterized, and rasterized glyphs are
+    ///                         added to it. Pass nullptr to disable.
     glyph_manager(glyph_rasterizer *rasterizer,
                   glyph_texture_cache texture_cache,
                   size_t evict_threshold,
-                  size_t evict_preserve):
-        rasterizer(rasterizer),
-        texture_cache(std::move(texture_cache)),
-        evict_threshold(evict_threshold),
-        evict_preserve(evict_preserve) {}
+                  size_t evict_preserve,
+                  glyph_rasterizer_pool *pool = nullptr,
+                  dispatch_block_t ready = nullptr,
+                  size_t dilation_buckets = 0,
+                  glyph_archive *archive = nullptr);
 
     /// Returns a cached glyph with the given attributes.
     /// @param font         The font.
@@ -481,34 +801,105 @@ public:
                    const nvim::cell &cell,
                    nvim::rgb_color background,
                    nvim::rgb_color foreground) {
-        key_type key(font, cell.grapheme(), background, foreground);
+        return map.value_at(lookup(font, cell, background, foreground));
+    }
 
-        if (auto iter = map.find(key); iter != map.end()) {
-            return iter->second;
+    /// Calls get using the font and colors of the cell's highlight attributes.
+    ///
+    /// The lookup is memoized in the cell. Memoized lookups skip hashing and
+    /// are trusted until the cache generation or the palette generation
+    /// changes. Cells are responsible for discarding their memo if their text
+    /// or highlight changes. The font is checked, as cells are not aware of
+    /// font changes.
+    ///
+    /// @param font_family          The font family.
+    /// @param cell                 The cell.
+    /// @param attrs                The cell's highlight attributes.
+    /// @param palette_generation   The generation of the palette attrs came
+    ///                             from, see grid_set::palette_generation().
+    glyph_rect get(const font_family &font_family,
+                   const nvim::cell &cell,
+                   const nvim::cell_attributes &attrs,
+                   uint64_t palette_generation) {
+        CTFontRef font = font_family.get(attrs.font_attributes());
+
+        // Every counter only increases, so the sum changes whenever any of
+        // them do.
+        uint32_t generation = memo_generation() +
+                              static_cast<uint32_t>(palette_generation);
+
+        if (size_t slot = memoized_slot(font, cell, generation); slot != glyph_map::npos) {
+            counters.memoized += 1;
+            return map.value_at(slot);
         }
 
-        glyph_bitmap glyph = rasterizer->rasterize(font,
-                                                   background,
-                                                   foreground,
-                                                   cell.grapheme_view());
+        size_t slot = lookup(font, cell, attrs.background, attrs.foreground);
+        cell.memoize_glyph(static_cast<uint32_t>(slot), generation);
+        return map.value_at(slot);
+    }
 
-        auto texture_position = texture_cache.add(glyph);
+    /// Looks up a glyph like the memoized get(), but only if it's cached.
+    ///
+    /// Nothing but the cell's memo is modified, so lookups can run on several
+    /// threads at once, provided no other member functions are called in the
+    /// meantime, and each cell is only looked up by one thread. Lookups are
+    /// counted in stats, add them to the glyph manager's counters with
+    /// add_stats().
+    ///
+    /// @returns True if the glyph is cached, and sets glyph. Otherwise look
+    ///          the glyph up with get().
+    bool find(const font_family &font_family,
+              const nvim::cell &cell,
+              const nvim::cell_attributes &attrs,
+              uint64_t palette_generation,
+              glyph_rect &glyph,
+              glyph_cache_stats &stats) const {
+        CTFontRef font = font_family.get(attrs.font_attributes());
+        uint32_t generation = memo_generation() +
+                              static_cast<uint32_t>(palette_generation);
+
+        if (size_t slot = memoized_slot(font, cell, generation); slot != glyph_map::npos) {
+            stats.memoized += 1;
+            glyph = map.value_at(slot);
+            return true;
+        }
 
-        glyph_rect cached;
-        cached.texture_origin = texture_position;
-        cached.position.x = glyph.left_bearing;
-        cached.position.y = -glyph.ascent;
-        cached.size.x = glyph.width;
-        cached.size.y = glyph.height;
+        size_t slot = find_slot(font, cell, attrs.background, attrs.foreground);
 
-        map.emplace(key, cached);
-        return cached;
+        if (slot == glyph_map::npos) {
+            return false;
+        }
+
+        stats.cached += 1;
+        cell.memoize_glyph(static_cast<uint32_t>(slot), generation);
+        glyph = map.value_at(slot);
+        return true;
     }
 
-    /// Calls get using the background and foreground colors of cell.
-    glyph_rect get(const font_family &font_family, const nvim::cell &cell) {
-        CTFontRef font = font_family.get(cell.font_attributes());
-        return get(font, cell, cell.background(), cell.foreground());
+    /// Adds lookups counted by find() to the glyph manager's counters.
+    void add_stats(const glyph_cache_stats &stats) {
+        counters.memoized += stats.memoized;
+        counters.cached += stats.cached;
+        counters.archived += stats.archived;
+        counters.rasterized += stats.rasterized;
+    }
+
+    /// Rasterizes printable ASCII in the background, so later lookups are
+    /// cache hits.
+    ///
+    /// Glyphs are rasterized in the font family's regular, bold, italic and
+    /// bold italic faces, with the given colors, which should be the grid's
+    /// default colors. They're added to the cache by update(), glyphs cached
+    /// in the meantime are skipped. Repeated calls with the same font and
+    /// colors do nothing until the cache is evicted. Does nothing if the
+    /// glyph manager has no rasterizer pool.
+    void prewarm(const font_family &font_family,
+                 nvim::rgb_color background,
+                 nvim::rgb_color foreground);
+
+    /// Returns the glyph lookup counters. Counters only increase.
+    const glyph_cache_stats& stats() const {
+        return counters;
     }
 
     /// Returns the Metal texture containing the cached glyphs.
@@ -516,6 +907,32 @@ public:
         return texture_cache.metal_texture();
     }
 
+    /// Returns the cache generation. The generation changes whenever glyphs
+    /// are evicted, which invalidates all previously returned glyph_rects, or
+    /// when placeholder glyphs are replaced by update().
+    uint64_t generation() const {
+        return generation_count + resolved_count;
+    }
+
+    /// Changes whenever placeholder glyphs are replaced by update().
+    /// Anything drawn with placeholders is stale once this changes. Unlike
+    /// generation(), evictions don't affect what's already been drawn.
+    uint64_t placeholder_generation() const {
+        return resolved_count;
+    }
+
+    /// Adds glyphs rasterized in the background to the cache, replacing their
+    /// placeholders. Call before encoding a frame. Prewarmed glyphs that
+    /// didn't replace placeholders don't change placeholder_generation().
+    void update();
+
+    /// Uploads newly cached glyphs to GPU memory.
+    /// Call with the frame's command buffer after all glyphs have been looked
+    /// up, and before encoding any passes that sample texture().
+    void flush(id<MTLCommandBuffer> command_buffer) {
+        texture_cache.flush(command_buffer);
+    }
+
     /// Evicts old cache pages if necessary.
     /// The cache is evicted if the number of allocated cache pages exceeds the
     /// cache eviction threshold. The newest n cache pages are preserved, where
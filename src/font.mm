@@ -9,6 +9,8 @@
 
 #import <Cocoa/Cocoa.h>
 #include <CoreText/CoreText.h>
+#include <algorithm>
+#include <mutex>
 #include "font.hpp"
 
 CGFloat font_family::width() const {
@@ -147,6 +149,20 @@ glyph_rasterizer::glyph_rasterizer(size_t width, size_t height) {
     CGContextSetShouldSubpixelQuantizeFonts(context.get(), true);
 }
 
+glyph_rasterizer_pool::glyph_rasterizer_pool(size_t count, size_t width, size_t height):
+    next_worker(0) {
+    dispatch_queue_t target = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+    workers.reserve(count);
+
+    for (size_t i=0; i<count; ++i) {
+        dispatch_queue_t queue = dispatch_queue_create_with_target("glyph_rasterizer",
+                                                                   DISPATCH_QUEUE_SERIAL,
+                                                                   target);
+
+        workers.push_back(worker{glyph_rasterizer(width, height), queue});
+    }
+}
+
 /// Clamps value to between limit and -limit.
 static inline CGFloat clamp_abs(CGFloat value, CGFloat limit) {
     if (value > limit) {
@@ -243,6 +259,7 @@ static id<MTLTexture> alloc_texture(id<MTLDevice> device, size_t width,
     desc.width = width;
     desc.height = height;
     desc.mipmapLevelCount = 1;
+    desc.storageMode = MTLStorageModePrivate;
     return [device newTextureWithDescriptor:desc];
 }
 
@@ -250,7 +267,6 @@ glyph_texture_cache::glyph_texture_cache(id<MTLCommandQueue> queue, size_t width
                                          size_t height, size_t init_capacity,
                                          double growth_factor):
     device(queue.device),
-    queue(queue),
     growth_factor(growth_factor) {
     x_used = 0;
     y_used = 0;
@@ -260,6 +276,120 @@ glyph_texture_cache::glyph_texture_cache(id<MTLCommandQueue> queue, size_t width
     page_index = 0;
     page_count = std::max(1ul, init_capacity);
     texture = alloc_texture(device, width, height, page_count);
+
+    // Large enough to stage a full page of glyphs. Font changes and color
+    // scheme switches invalidate every glyph, so the first frame after one
+    // uploads at least a page worth of bitmaps.
+    staging_size = width * height * 4;
+}
+
+/// Returns a staging buffer with at least size bytes free.
+/// Idle buffers in the ring are reused, if every buffer is in flight or full,
+/// a new buffer is added to the ring.
+glyph_texture_cache::staging_buffer& glyph_texture_cache::staging_for(size_t size) {
+    if (!staged.empty()) {
+        staging_buffer &current = *staged.back();
+
+        if (current.used + size <= [current.buffer length]) {
+            return current;
+        }
+    }
+
+    for (auto &candidate : staging_ring) {
+        if (!candidate->in_flight.load(std::memory_order_acquire) &&
+            [candidate->buffer length] >= size) {
+            candidate->used = 0;
+            candidate->in_flight.store(true, std::memory_order_relaxed);
+            staged.push_back(candidate);
+            return *candidate;
+        }
+    }
+
+    auto created = std::make_shared<staging_buffer>();
+    created->buffer = [device newBufferWithLength:std::max(size, staging_size)
+                                          options:MTLResourceStorageModeShared |
+                                                  MTLResourceCPUCacheModeWriteCombined];
+    created->used = 0;
+    created->in_flight.store(true, std::memory_order_relaxed);
+    staging_ring.push_back(created);
+    staged.push_back(created);
+    return *created;
+}
+
+/// Stages a width x height region of bitmap for upload to (x, y) of the
+/// current cache page.
+void glyph_texture_cache::upload(const glyph_bitmap &bitmap, size_t x, size_t y,
+                                 size_t width, size_t height) {
+    if (!width || !height) {
+        return;
+    }
+
+    const size_t row_size = width * 4;
+    staging_buffer &stage = staging_for(row_size * height + 15);
+
+    // Source offsets must be a multiple of the pixel size, we align to 16.
+    size_t offset = (stage.used + 15) & ~size_t(15);
+    char *dest = static_cast<char*>([stage.buffer contents]) + offset;
+
+    for (size_t row=0; row<height; ++row) {
+        memcpy(dest + (row * row_size), bitmap.buffer + (row * bitmap.stride), row_size);
+    }
+
+    stage.used = offset + (row_size * height);
+
+    pending_copy copy = {};
+    copy.destination = texture;
+    copy.source_buffer = stage.buffer;
+    copy.source_offset = offset;
+    copy.source_stride = row_size;
+    copy.region = MTLRegionMake2D(x, y, width, height);
+    copy.slice = page_index;
+    pending.push_back(copy);
+}
+
+void glyph_texture_cache::flush(id<MTLCommandBuffer> command_buffer) {
+    if (!pending.empty()) {
+        id<MTLBlitCommandEncoder> blitEncoder = [command_buffer blitCommandEncoder];
+
+        // Copies are encoded in the order they were recorded. Uploads to a
+        // texture that was later resized must land before its pages are copied.
+        for (const pending_copy &copy : pending) {
+            if (copy.source_texture) {
+                [blitEncoder copyFromTexture:copy.source_texture
+                                 sourceSlice:copy.source_offset
+                                 sourceLevel:0
+                                   toTexture:copy.destination
+                            destinationSlice:copy.slice
+                            destinationLevel:0
+                                  sliceCount:copy.count
+                                  levelCount:1];
+            } else {
+                [blitEncoder copyFromBuffer:copy.source_buffer
+                               sourceOffset:copy.source_offset
+                          sourceBytesPerRow:copy.source_stride
+                        sourceBytesPerImage:copy.source_stride * copy.region.size.height
+                                 sourceSize:copy.region.size
+                                  toTexture:copy.destination
+                           destinationSlice:copy.slice
+                           destinationLevel:0
+                          destinationOrigin:copy.region.origin];
+            }
+        }
+
+        [blitEncoder endEncoding];
+        pending.clear();
+    }
+
+    // Staging buffers become reusable once the GPU has consumed them.
+    for (auto &stage : staged) {
+        std::shared_ptr<staging_buffer> retained = stage;
+
+        [command_buffer addCompletedHandler:^(id<MTLCommandBuffer>) {
+            retained->in_flight.store(false, std::memory_order_release);
+        }];
+    }
+
+    staged.clear();
 }
 
 /// Resizes the cache page array.
@@ -272,20 +402,14 @@ glyph_texture_cache::glyph_texture_cache(id<MTLCommandQueue> queue, size_t width
 ///              a new texture instead.
 void glyph_texture_cache::realloc(size_t new_page_count, size_t begin, size_t count) {
     id<MTLTexture> new_texture = alloc_texture(device, x_size, y_size, new_page_count);
-    id<MTLCommandBuffer> commandBuffer = [queue commandBuffer];
-    id<MTLBlitCommandEncoder> blitEncoder = [commandBuffer blitCommandEncoder];
-
-    [blitEncoder copyFromTexture:texture
-                     sourceSlice:begin
-                     sourceLevel:0
-                       toTexture:new_texture
-                destinationSlice:0
-                destinationLevel:0
-                      sliceCount:count
-                      levelCount:1];
 
-    [blitEncoder endEncoding];
-    [commandBuffer commit];
+    pending_copy copy = {};
+    copy.destination = new_texture;
+    copy.source_texture = texture;
+    copy.source_offset = begin;
+    copy.slice = 0;
+    copy.count = count;
+    pending.push_back(copy);
 
     texture = new_texture;
     page_count = new_page_count;
@@ -293,6 +417,9 @@ void glyph_texture_cache::realloc(size_t new_page_count, size_t begin, size_t co
 
 size_t glyph_texture_cache::evict(size_t preserve) {
     if (preserve == 0) {
+        // Nothing survives, so none of the pending copies matter. Staged
+        // buffers are still released by the next flush().
+        pending.clear();
         texture = alloc_texture(device, x_size, y_size, 1);
         page_count = 1;
         page_index = 0;
@@ -329,14 +456,8 @@ simd_short3 glyph_texture_cache::add_new_page(const glyph_bitmap &bitmap) {
     x_used = std::min((size_t)bitmap.width + 1, x_size);
     y_used = std::min((size_t)bitmap.height, y_size);
     row_height = y_used;
-    
-    [texture replaceRegion:MTLRegionMake2D(0, 0, x_used, y_used)
-               mipmapLevel:0
-                     slice:page_index
-                 withBytes:bitmap.buffer
-               bytesPerRow:bitmap.stride
-             bytesPerImage:0];
-    
+
+    upload(bitmap, 0, 0, x_used, y_used);
     return simd_short3{0, 0, (int16_t)page_index};
 }
 
@@ -351,12 +472,7 @@ simd_short3 glyph_texture_cache::add(const glyph_bitmap &bitmap) {
         size_t newy = row_height + y_used;
 
         if (newx <= x_size && newy <= y_size) {
-            [texture replaceRegion:MTLRegionMake2D(x_used, y_used, glyph_width, glyph_height)
-                       mipmapLevel:0
-                             slice:page_index
-                         withBytes:bitmap.buffer
-                       bytesPerRow:bitmap.stride
-                     bytesPerImage:0];
+            upload(bitmap, x_used, y_used, glyph_width, glyph_height);
 
             simd_short3 origin;
             origin.x = x_used;
@@ -377,7 +493,435 @@ simd_short3 glyph_texture_cache::add(const glyph_bitmap &bitmap) {
     }
 }
 
+uint32_t glyph_manager::next_memo_id() {
+    // Successive multiples of an odd constant are distinct modulo 2^32, and
+    // far apart, so counters of different managers are unlikely to meet.
+    static std::atomic<uint32_t> count = 0;
+    return (count.fetch_add(1, std::memory_order_relaxed) + 1) * 0x9e3779b9u;
+}
+
+glyph_manager::glyph_manager(glyph_rasterizer *rasterizer,
+                             glyph_texture_cache texture_cache,
+                             size_t evict_threshold,
+                             size_t evict_preserve,
+                             glyph_rasterizer_pool *pool,
+                             dispatch_block_t ready,
+                             size_t dilation_buckets,
+                             glyph_archive *archive):
+    rasterizer(rasterizer),
+    pool(pool),
+    texture_cache(std::move(texture_cache)),
+    evict_threshold(evict_threshold),
+    evict_preserve(evict_preserve),
+    map(initial_map_capacity),
+    archive(archive),
+    memo_id(next_memo_id()),
+    dilation_buckets(static_cast<uint32_t>(std::min<size_t>(dilation_buckets, 16))) {
+    if (!pool || !pool->size()) {
+        return;
+    }
+
+    async = std::make_shared<async_state>();
+    async->ready = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0,
+                                          dispatch_get_main_queue());
+
+    if (ready) {
+        dispatch_source_set_event_handler(async->ready, ready);
+    }
+
+    dispatch_resume(async->ready);
+}
+
+glyph_rect glyph_manager::cache(const glyph_bitmap &glyph, bool mask) {
+    glyph_rect cached;
+    cached.texture_origin = simd_make_short4(texture_cache.add(glyph), mask ? 1 : 0);
+    cached.position.x = glyph.left_bearing;
+    cached.position.y = -glyph.ascent;
+    cached.size.x = glyph.width;
+    cached.size.y = glyph.height;
+    return cached;
+}
+
+/// Converts a bitmap rasterized with a gray foreground over a black or white
+/// background into a coverage mask. The coverage is stored in every channel,
+/// the glyph shader only reads alpha. Returns false if the bitmap contains
+/// color, in which case the bitmap is left partially converted.
+static bool make_coverage_mask(glyph_bitmap &bitmap,
+                               nvim::rgb_color background,
+                               nvim::rgb_color foreground) {
+    const int bg = background.red();
+    const int range = static_cast<int>(foreground.red()) - bg;
+    const size_t row_size = bitmap.width * glyph_rasterizer::pixel_size;
+
+    unsigned char *row = bitmap.buffer;
+    unsigned char *endrow = row + (bitmap.height * bitmap.stride);
+
+    for (; row != endrow; row += bitmap.stride) {
+        unsigned char *endpixel = row + row_size;
+
+        for (unsigned char *pixel = row; pixel != endpixel; pixel += 4) {
+            int r = pixel[0];
+            int g = pixel[1];
+            int b = pixel[2];
+
+            // Allow for rounding differences between channels.
+            if (std::max({r, g, b}) - std::min({r, g, b}) > 2) {
+                return false;
+            }
+
+            int coverage = std::clamp((((r + g + b) / 3) - bg) * 255 / range, 0, 255);
+            memset(pixel, coverage, 4);
+        }
+    }
+
+    return true;
+}
+
+glyph_archive::key_type glyph_manager::archive_key(const key_type &key) {
+    uint64_t font_id = 0;
+    auto cached = std::find_if(archive_fonts.begin(), archive_fonts.end(),
+                               [&](auto &entry) { return entry.first == key.font; });
+
+    if (cached != archive_fonts.end()) {
+        font_id = cached->second;
+    } else {
+        arc_ptr<CFStringRef> name = CTFontCopyPostScriptName(key.font);
+        char buffer[256] = {};
+        CFStringGetCString(name.get(), buffer, sizeof(buffer), kCFStringEncodingUTF8);
+
+        font_id = glyph_archive::font_id(buffer, CTFontGetSize(key.font));
+        archive_fonts.emplace_back(key.font, font_id);
+    }
+
+    return glyph_archive::key_type(font_id, key.graphemes,
+                                   key.background, key.foreground);
+}
+
+size_t glyph_manager::unarchive(const key_type &key) {
+    glyph_archive::bitmap found;
+
+    if (!archive || !archive->find(archive_key(key), found)) {
+        return glyph_map::npos;
+    }
+
+    // The texture cache copies the bitmap into a staging buffer, it's never
+    // written to.
+    glyph_bitmap glyph;
+    glyph.buffer = const_cast<unsigned char*>(found.pixels);
+    glyph.stride = found.stride;
+    glyph.left_bearing = found.left_bearing;
+    glyph.ascent = found.ascent;
+    glyph.width = found.width;
+    glyph.height = found.height;
+
+    counters.archived += 1;
+    return map.insert(key, cache(glyph, key.is_mask()));
+}
+
+void glyph_manager::archive_glyph(const key_type &key, const glyph_bitmap &glyph) {
+    if (!archive) {
+        return;
+    }
+
+    glyph_archive::bitmap bitmap;
+    bitmap.pixels = glyph.buffer;
+    bitmap.stride = glyph.stride;
+    bitmap.left_bearing = glyph.left_bearing;
+    bitmap.ascent = glyph.ascent;
+    bitmap.width = glyph.width;
+    bitmap.height = glyph.height;
+
+    // The texture cache may read one pixel past the bitmap's width.
+    archive->add(archive_key(key), bitmap,
+                 (glyph.width + 1) * glyph_rasterizer::pixel_size);
+}
+
+uint32_t glyph_manager::dilation_bucket(nvim::rgb_color foreground) const {
+    // Rec. 709 luma coefficients in 8.8 fixed point, they sum to 256.
+    uint32_t luma = (54 * foreground.red() +
+                     183 * foreground.green() +
+                     19 * foreground.blue()) >> 8;
+
+    return (luma * dilation_buckets) >> 8;
+}
+
+std::pair<nvim::rgb_color, nvim::rgb_color>
+glyph_manager::bucket_colors(uint32_t bucket, uint32_t bucket_count) {
+    uint32_t gray = std::min<uint32_t>(((bucket * 256) + 128) / bucket_count, 255);
+
+    // Light text is assumed to be on a dark background, and vice versa. This
+    // also keeps the foreground far enough from the background to recover
+    // accurate coverage values.
+    if (gray >= 128) {
+        return {nvim::rgb_color(0, 0, 0), nvim::rgb_color(gray, gray, gray)};
+    } else {
+        return {nvim::rgb_color(255, 255, 255), nvim::rgb_color(gray, gray, gray)};
+    }
+}
+
+size_t glyph_manager::lookup_mask(CTFontRef font,
+                                  const nvim::cell &cell,
+                                  nvim::rgb_color foreground) {
+    uint32_t bucket = dilation_bucket(foreground);
+    key_type key = key_type::mask(font, cell.grapheme(), bucket);
+
+    if (size_t slot = map.find_slot(key); slot != glyph_map::npos) {
+        // Colored glyphs are looked up again, and counted, by lookup().
+        if (is_colored_marker(map.value_at(slot))) {
+            return glyph_map::npos;
+        }
+
+        counters.cached += 1;
+        return slot;
+    }
+
+    if (size_t slot = unarchive(key); slot != glyph_map::npos) {
+        return slot;
+    }
+
+    auto [mask_background, mask_foreground] = bucket_colors(bucket, dilation_buckets);
+    std::string_view text = cell.grapheme_view();
+    counters.rasterized += 1;
+
+    if (async && text.size() > 1) {
+        rasterize_async(key, text.size(), mask_background, mask_foreground);
+        return map.insert(key, placeholder());
+    }
+
+    glyph_bitmap glyph = rasterizer->rasterize(font,
+                                               mask_background,
+                                               mask_foreground,
+                                               text);
+
+    if (!make_coverage_mask(glyph, mask_background, mask_foreground)) {
+        map.insert(key, colored());
+        return glyph_map::npos;
+    }
+
+    archive_glyph(key, glyph);
+    return map.insert(key, cache(glyph, true));
+}
+
+struct glyph_manager::async_job {
+    std::shared_ptr<async_state> state;
+    glyph_rasterizer *rasterizer;
+    key_type key;
+    size_t length;
+    nvim::rgb_color background;
+    nvim::rgb_color foreground;
+};
+
+void glyph_manager::rasterize_async(const key_type &key, size_t length,
+                                    nvim::rgb_color background,
+                                    nvim::rgb_color foreground) {
+    auto [pool_rasterizer, queue] = pool->next();
+
+    auto job = new async_job{async, pool_rasterizer, key,
+                             length, background, foreground};
+
+    dispatch_async_f(queue, job, run_async_job);
+}
+
+glyph_manager::rasterized_glyph
+glyph_manager::rasterize_detached(glyph_rasterizer *rasterizer,
+                                  const key_type &key,
+                                  size_t length,
+                                  nvim::rgb_color background,
+                                  nvim::rgb_color foreground) {
+    std::string_view text(key.graphemes.data(), length);
+    glyph_bitmap bitmap = rasterizer->rasterize(key.font, background, foreground, text);
+    bool colored = false;
+
+    if (key.is_mask()) {
+        colored = !make_coverage_mask(bitmap, background, foreground);
+    }
+
+    // The bitmap points into the rasterizer's canvas, which will be reused by
+    // the next job. Copy it out into a tightly packed buffer. The texture
+    // cache may read one pixel past the bitmap's width, so copy that too.
+    size_t row_size = (bitmap.width + 1) * glyph_rasterizer::pixel_size;
+    auto pixels = std::make_unique<unsigned char[]>(row_size * bitmap.height);
+
+    for (size_t row=0; row<static_cast<size_t>(bitmap.height); ++row) {
+        memcpy(pixels.get() + (row * row_size),
+               bitmap.buffer + (row * bitmap.stride),
+               row_size);
+    }
+
+    bitmap.buffer = pixels.get();
+    bitmap.stride = row_size;
+    return rasterized_glyph{key, bitmap, std::move(pixels), colored, false};
+}
+
+void glyph_manager::complete_async(async_state &state,
+                                   std::vector<rasterized_glyph> glyphs) {
+    bool notify;
+
+    {
+        std::lock_guard lock(state.lock);
+        notify = state.completed.empty();
+
+        for (rasterized_glyph &glyph : glyphs) {
+            state.completed.push_back(std::move(glyph));
+        }
+    }
+
+    if (notify) {
+        dispatch_source_merge_data(state.ready, 1);
+    }
+}
+
+void glyph_manager::run_async_job(void *context) {
+    std::unique_ptr<async_job> job(static_cast<async_job*>(context));
+
+    std::vector<rasterized_glyph> glyphs;
+    glyphs.push_back(rasterize_detached(job->rasterizer, job->key, job->length,
+                                        job->background, job->foreground));
+
+    complete_async(*job->state, std::move(glyphs));
+}
+
+struct glyph_manager::prewarm_job {
+    std::shared_ptr<async_state> state;
+    glyph_rasterizer *rasterizer;
+    std::vector<key_type> keys;
+    nvim::rgb_color background;
+    nvim::rgb_color foreground;
+};
+
+void glyph_manager::run_prewarm_job(void *context) {
+    std::unique_ptr<prewarm_job> job(static_cast<prewarm_job*>(context));
+
+    std::vector<rasterized_glyph> glyphs;
+    glyphs.reserve(job->keys.size());
+
+    for (const key_type &key : job->keys) {
+        glyphs.push_back(rasterize_detached(job->rasterizer, key, 1,
+                                            job->background, job->foreground));
+        glyphs.back().prewarmed = true;
+    }
+
+    complete_async(*job->state, std::move(glyphs));
+}
+
+void glyph_manager::prewarm(const font_family &font_family,
+                            nvim::rgb_color background,
+                            nvim::rgb_color foreground) {
+    if (!async) {
+        return;
+    }
+
+    // Identify each prewarm by the key of its first glyph.
+    nvim::grapheme_cluster space = {' '};
+    key_type identity(font_family.regular(), space, background, foreground);
+
+    for (const key_type &key : prewarmed) {
+        if (memcmp(&key, &identity, sizeof(key_type)) == 0) {
+            return;
+        }
+    }
+
+    prewarmed.push_back(identity);
+
+    nvim::rgb_color job_background = background;
+    nvim::rgb_color job_foreground = foreground;
+    uint32_t bucket = 0;
+
+    if (dilation_buckets) {
+        bucket = dilation_bucket(foreground);
+        auto colors = bucket_colors(bucket, dilation_buckets);
+        job_background = colors.first;
+        job_foreground = colors.second;
+    }
+
+    glyph_archive::bitmap archived;
+
+    // One job per face, so the faces are rasterized in parallel.
+    for (size_t attrs=0; attrs<=(size_t)nvim::font_attributes::bold_italic; ++attrs) {
+        CTFontRef font = font_family.get(static_cast<nvim::font_attributes>(attrs));
+
+        auto job = std::make_unique<prewarm_job>();
+        job->state = async;
+        job->background = job_background;
+        job->foreground = job_foreground;
+
+        for (char ascii = 0x20; ascii < 0x7f; ++ascii) {
+            nvim::grapheme_cluster graphemes = {ascii};
+            key_type key = dilation_buckets ? key_type::mask(font, graphemes, bucket) :
+                                              key_type(font, graphemes, background, foreground);
+
+            // Archived glyphs are cached on demand, without rasterizing.
+            if (map.find_slot(key) == glyph_map::npos &&
+                !(archive && archive->find(archive_key(key), archived))) {
+                job->keys.push_back(key);
+            }
+        }
+
+        if (job->keys.empty()) {
+            continue;
+        }
+
+        auto [pool_rasterizer, queue] = pool->next();
+        job->rasterizer = pool_rasterizer;
+        dispatch_async_f(queue, job.release(), run_prewarm_job);
+    }
+}
+
+void glyph_manager::update() {
+    if (!async) {
+        return;
+    }
+
+    std::vector<rasterized_glyph> completed;
+
+    {
+        std::lock_guard lock(async->lock);
+        completed.swap(async->completed);
+    }
+
+    if (completed.empty()) {
+        return;
+    }
+
+    bool replaced = false;
+
+    for (const rasterized_glyph &glyph : completed) {
+        size_t slot = map.find_slot(glyph.key);
+
+        if (slot != glyph_map::npos && !is_placeholder(map.value_at(slot))) {
+            continue;
+        }
+
+        // Colored glyphs can't be tinted, the next lookup caches them per
+        // color combination instead.
+        glyph_rect rect = glyph.colored ? colored() :
+                                          cache(glyph.bitmap, glyph.key.is_mask());
+
+        if (!glyph.colored) {
+            archive_glyph(glyph.key, glyph.bitmap);
+        }
+
+        // If the placeholder was evicted, the glyph is still useful.
+        if (slot == glyph_map::npos) {
+            map.insert(glyph.key, rect);
+        } else {
+            map.value_at(slot) = rect;
+        }
+
+        // Unless they replaced a placeholder, nothing was drawn without
+        // prewarmed glyphs.
+        replaced |= slot != glyph_map::npos || !glyph.prewarmed;
+    }
+
+    // Glyphs previously encoded as placeholders must be encoded again.
+    if (replaced) {
+        resolved_count += 1;
+    }
+}
+
 void glyph_manager::do_evict() {
+    generation_count += 1;
+    prewarmed.clear();
     size_t evicted = texture_cache.evict(evict_preserve);
 
     if (evicted == 0) {
@@ -388,16 +932,15 @@ void glyph_manager::do_evict() {
         return;
     }
 
-    glyph_map new_map;
-    new_map.reserve(map.size());
-
-    for (const auto& [key, value] : map) {
-        if (value.texture_origin.z >= evicted) {
-            auto shifted = value;
-            shifted.texture_origin.z -= evicted;
-            new_map.emplace(key, shifted);
+    // Drop glyphs on evicted pages, and shift the remaining glyphs down.
+    // Placeholders are dropped too, their glyphs are reinserted by update().
+    // Compare as signed values, placeholders and markers are on page -1.
+    map.filter([evicted = static_cast<int16_t>(evicted)](glyph_rect &rect) {
+        if (rect.texture_origin.z < evicted) {
+            return false;
         }
-    }
 
-    map = std::move(new_map);
+        rect.texture_origin.z -= evicted;
+        return true;
+    });
 }
@@ -0,0 +1,147 @@
+//
+//  Neovim Mac
+//  frame_ring.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef FRAME_RING_HPP
+#define FRAME_RING_HPP
+
+#include <Metal/Metal.h>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+
+/// A ring of GPU memory for per frame data.
+///
+/// Every view rendering with a Metal device sub-allocates the data its frames
+/// read, uniforms, encoded rows, palettes, and so on, from a single MTLBuffer.
+/// A frame ends when its command buffer is committed, which signals a shared
+/// event with the frame's serial number once the GPU is done with it.
+/// Allocations check the event, and reclaim the memory of completed frames,
+/// oldest first.
+///
+/// If a frame doesn't fit, the ring is replaced with a larger buffer. Frames
+/// still in flight keep the old buffer alive, command buffers retain the
+/// buffers they use.
+///
+/// Thread safety: Not thread safe. Used on the main thread.
+class frame_ring {
+public:
+    /// A region of ring memory, valid until the frame it was allocated in
+    /// completes.
+    struct region {
+        id<MTLBuffer> buffer;  ///< The buffer the region belongs to.
+        void *ptr;             ///< Pointer to the start of the region.
+        size_t offset;         ///< The region's offset in buffer.
+    };
+
+private:
+    struct frame_end {
+        uint64_t serial;
+        size_t position;
+    };
+
+    id<MTLDevice> device;
+    id<MTLBuffer> buffer;
+    id<MTLSharedEvent> fence;
+    std::deque<frame_end> in_flight;
+    size_t capacity;
+    uint64_t serial;
+
+    // Monotonically increasing positions, wrapped on use. Memory between
+    // tail and head belongs to frames that are in flight or being encoded.
+    size_t head;
+    size_t tail;
+
+    void reclaim() {
+        const uint64_t completed = [fence signaledValue];
+
+        while (!in_flight.empty() && in_flight.front().serial <= completed) {
+            tail = in_flight.front().position;
+            in_flight.pop_front();
+        }
+    }
+
+    void grow(size_t size) {
+        capacity = std::max(capacity * 2, align_up(size) * 2);
+        buffer = [device newBufferWithLength:capacity
+                                     options:MTLResourceStorageModeManaged |
+                                             MTLResourceCPUCacheModeWriteCombined];
+
+        // The new buffer is empty, frames in flight are using the old one.
+        in_flight.clear();
+        head = 0;
+        tail = 0;
+    }
+
+public:
+    /// The alignment of allocated regions.
+    static constexpr size_t alignment = 256;
+
+    /// Rounds val up to a multiple of alignment.
+    static constexpr size_t align_up(size_t val) {
+        return (val + alignment - 1) & -alignment;
+    }
+
+    /// Constructs an empty frame_ring. Exists to allow Objective-C++ instance
+    /// variables to be default constructible.
+    frame_ring(): capacity(0), serial(0), head(0), tail(0) {}
+
+    /// Constructs a frame_ring.
+    /// @param device   The Metal device to allocate buffers from.
+    /// @param capacity The initial size of the ring in bytes.
+    frame_ring(id<MTLDevice> device, size_t capacity):
+        device(device), capacity(align_up(capacity)), serial(0), head(0), tail(0) {
+        fence = [device newSharedEvent];
+        buffer = [device newBufferWithLength:this->capacity
+                                     options:MTLResourceStorageModeManaged |
+                                             MTLResourceCPUCacheModeWriteCombined];
+    }
+
+    /// Allocates size bytes for the frame being encoded.
+    /// Regions are aligned to 256 byte boundaries.
+    region allocate(size_t size) {
+        reclaim();
+        size = align_up(std::max<size_t>(size, 1));
+
+        // Regions are never split, if a region doesn't fit before the end of
+        // the buffer, the remaining space is skipped.
+        size_t offset = head % capacity;
+        size_t skip = offset + size > capacity ? capacity - offset : 0;
+
+        if ((head + skip + size) - tail > capacity) {
+            grow(size);
+            skip = 0;
+        }
+
+        head += skip;
+        offset = head % capacity;
+        head += size;
+
+        char *ptr = static_cast<char*>([buffer contents]) + offset;
+        return region{buffer, ptr, offset};
+    }
+
+    /// Informs the Metal device that size bytes at the start of region have
+    /// been modified. @see -[MTLBuffer didModifyRange] for more information.
+    static void update(const region &region, size_t size) {
+        if (size) {
+            [region.buffer didModifyRange:NSMakeRange(region.offset, size)];
+        }
+    }
+
+    /// Ends the frame being encoded. Its memory is reclaimed once
+    /// command_buffer completes.
+    /// Note: Must be called before command_buffer is committed.
+    void commit(id<MTLCommandBuffer> command_buffer) {
+        serial += 1;
+        [command_buffer encodeSignalEvent:fence value:serial];
+        in_flight.push_back(frame_end{serial, head});
+    }
+};
+
+#endif // FRAME_RING_HPP
@@ -0,0 +1,241 @@
+//
+//  Neovim Mac
+//  glyph_archive.cpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "glyph_archive.hpp"
+
+// Records are padded to a multiple of 8 bytes, so keys are always aligned.
+static constexpr size_t align_up(size_t val) {
+    return (val + 7) & ~size_t(7);
+}
+
+uint64_t glyph_archive::fingerprint(std::string_view text) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+uint64_t glyph_archive::font_id(std::string_view postscript_name, double size) {
+    uint64_t bits;
+    memcpy(&bits, &size, sizeof(bits));
+    return (fingerprint(postscript_name) ^ bits) * 0x100000001b3ull;
+}
+
+void glyph_archive::unmap() {
+    if (mapped) {
+        munmap(const_cast<char*>(mapped), mapped_size);
+        mapped = nullptr;
+        mapped_size = 0;
+    }
+}
+
+void glyph_archive::open(std::string archive_path, uint64_t archive_version,
+                         size_t archive_max_size) {
+    unmap();
+    index.clear();
+    pending.clear();
+    path = std::move(archive_path);
+    version = archive_version;
+    max_size = archive_max_size;
+    file_size = 0;
+    discard = false;
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1) {
+        return;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) == -1 || info.st_size < static_cast<off_t>(sizeof(header))) {
+        discard = true;
+        close(fd);
+        return;
+    }
+
+    const size_t size = info.st_size;
+    void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (ptr == MAP_FAILED) {
+        discard = true;
+        return;
+    }
+
+    mapped = static_cast<const char*>(ptr);
+    mapped_size = size;
+
+    header file_header;
+    memcpy(&file_header, mapped, sizeof(header));
+
+    if (file_header.magic != magic || file_header.format != format ||
+        file_header.version != version) {
+        unmap();
+        discard = true;
+        return;
+    }
+
+    // Index every complete record. Anything after the last complete record
+    // is truncated when we next save.
+    size_t offset = sizeof(header);
+
+    while (offset + sizeof(record) <= size) {
+        record entry;
+        memcpy(&entry, mapped + offset, sizeof(record));
+
+        const size_t pixels_size = entry.stride * std::max<int16_t>(entry.height, 0);
+        const size_t record_size = align_up(sizeof(record) + pixels_size);
+
+        // Bitmaps are uploaded one pixel wider than their width, reject
+        // records that would read past their rows.
+        if (entry.width < 0 || entry.height < 0 || record_size > size - offset ||
+            entry.stride < (static_cast<uint64_t>(entry.width) + 1) * 4) {
+            break;
+        }
+
+        if (!index.find(entry.key)) {
+            index.insert(entry.key, offset);
+        }
+
+        offset += record_size;
+    }
+
+    file_size = offset;
+}
+
+bool glyph_archive::find(const key_type &key, bitmap &found) {
+    const size_t *offset = index.find(key);
+
+    if (!offset) {
+        return false;
+    }
+
+    // Offsets past the end of the mapped file refer to unsaved records.
+    const char *data = *offset < file_size ? mapped + *offset :
+                                             pending.data() + (*offset - file_size);
+
+    record entry;
+    memcpy(&entry, data, sizeof(record));
+
+    found.pixels = reinterpret_cast<const unsigned char*>(data + sizeof(record));
+    found.stride = entry.stride;
+    found.left_bearing = entry.left_bearing;
+    found.ascent = entry.ascent;
+    found.width = entry.width;
+    found.height = entry.height;
+    return true;
+}
+
+void glyph_archive::add(const key_type &key, const bitmap &glyph, size_t row_size) {
+    if (path.empty() || index.find(key)) {
+        return;
+    }
+
+    const size_t pixels_size = row_size * glyph.height;
+    const size_t record_size = align_up(sizeof(record) + pixels_size);
+
+    if (file_size + pending.size() + record_size > max_size) {
+        return;
+    }
+
+    record entry;
+    memset(&entry, 0, sizeof(record));
+    entry.key = key;
+    entry.left_bearing = glyph.left_bearing;
+    entry.ascent = glyph.ascent;
+    entry.width = glyph.width;
+    entry.height = glyph.height;
+    entry.stride = row_size;
+
+    const size_t offset = pending.size();
+    pending.resize(offset + record_size);
+
+    char *data = pending.data() + offset;
+    memcpy(data, &entry, sizeof(record));
+
+    for (size_t row=0; row<static_cast<size_t>(glyph.height); ++row) {
+        memcpy(data + sizeof(record) + (row * row_size),
+               glyph.pixels + (row * glyph.stride),
+               row_size);
+    }
+
+    index.insert(key, file_size + offset);
+}
+
+// Writes all of data, retrying partial writes.
+static bool write_all(int fd, const void *data, size_t size) {
+    const char *begin = static_cast<const char*>(data);
+
+    while (size) {
+        ssize_t written = write(fd, begin, size);
+
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        begin += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+void glyph_archive::save() {
+    if (path.empty() || pending.empty()) {
+        return;
+    }
+
+    // Other instances may have the archive mapped, writing to it in place
+    // could change or truncate their mappings. Instead write a new archive
+    // next to it, and atomically replace the old one. Discarded archives are
+    // replaced, otherwise any truncated records are dropped, the complete
+    // records are kept, and the new records are appended.
+    std::string temp_path = path + ".XXXXXX";
+    int fd = mkostemp(temp_path.data(), O_CLOEXEC);
+
+    if (fd == -1) {
+        return;
+    }
+
+    bool written = fchmod(fd, 0644) == 0;
+
+    if (discard || file_size == 0) {
+        header file_header = {magic, format, version};
+        written = written && write_all(fd, &file_header, sizeof(header));
+    } else {
+        written = written && write_all(fd, mapped, file_size);
+    }
+
+    written = written && write_all(fd, pending.data(), pending.size());
+    written = close(fd) == 0 && written;
+
+    if (!written || rename(temp_path.c_str(), path.c_str()) == -1) {
+        unlink(temp_path.c_str());
+        return;
+    }
+
+    // The saved records stay in memory, the index still refers to them.
+    // They're mapped in place by the next session. Our mapping of the old
+    // file remains valid.
+    discard = false;
+}
@@ -0,0 +1,161 @@
+//
+//  Neovim Mac
+//  glyph_archive.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef GLYPH_ARCHIVE_HPP
+#define GLYPH_ARCHIVE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "grapheme_table.hpp"
+#include "hash_table.hpp"
+
+/// A persistent, memory mapped cache of rasterized glyphs.
+///
+/// Glyphs rasterized in one session are appended to the archive file when the
+/// archive is saved, and looked up in place in the mapped file in the next.
+/// Archived bitmaps are uploaded to the texture cache as is, skipping
+/// rasterization entirely.
+///
+/// The file starts with a header holding a format version and a caller
+/// provided environment version, which should change whenever rasterization
+/// could produce different results, for example after a system update. Files
+/// with a different version are discarded. Records follow the header, each a
+/// key, the bitmap metrics, and the pixels. Saves write a new file and
+/// rename it over the old one, so other instances mapping the archive are
+/// unaffected. Truncated or malformed records are ignored.
+///
+/// Archives are a cache. Any IO error leaves the archive empty, or unsaved,
+/// but is otherwise ignored.
+///
+/// Thread safety: Not thread safe. Used on the main thread.
+class glyph_archive {
+public:
+    /// Identifies an archived glyph.
+    struct key_type {
+        size_t hash;
+        uint64_t font;
+        nvim::grapheme_cluster graphemes;
+        uint32_t background;
+        uint32_t foreground;
+
+        key_type() = default;
+
+        /// @param font         A persistent font identifier, see font_id().
+        /// @param graphemes    The glyph's text.
+        /// @param background   The background color, or a dilation bucket.
+        /// @param foreground   The foreground color.
+        key_type(uint64_t font, const nvim::grapheme_cluster &graphemes,
+                 uint32_t background, uint32_t foreground):
+            font(font), graphemes(graphemes),
+            background(background), foreground(foreground) {
+            uint64_t words[3];
+            memcpy(words, graphemes.data(), sizeof(words));
+            hash = (words[0] * 0x9e3779b97f4a7c15ull) ^
+                   (words[1] * 0xc2b2ae3d27d4eb4full) ^
+                   (words[2] * 0x165667b19e3779f9ull) ^
+                   (font * 0xff51afd7ed558ccdull) ^
+                   (static_cast<uint64_t>(background) << 32 | foreground);
+        }
+    };
+
+    /// An archived bitmap. Pixels are RGBA, rows are stride bytes apart.
+    struct bitmap {
+        const unsigned char *pixels;
+        size_t stride;
+        int16_t left_bearing;
+        int16_t ascent;
+        int16_t width;
+        int16_t height;
+    };
+
+private:
+    struct header {
+        uint32_t magic;
+        uint32_t format;
+        uint64_t version;
+    };
+
+    struct record {
+        key_type key;
+        int16_t left_bearing;
+        int16_t ascent;
+        int16_t width;
+        int16_t height;
+        uint64_t stride;
+    };
+
+    static constexpr uint32_t magic = 0x4147564e; // "NVGA"
+    static constexpr uint32_t format = 1;
+
+    std::string path;
+    uint64_t version = 0;
+    const char *mapped = nullptr;
+    size_t mapped_size = 0;
+    size_t max_size = 0;
+    size_t file_size = 0;
+    bool discard = false;
+
+    hash_table<key_type, size_t> index;
+    std::vector<char> pending;
+
+    void unmap();
+
+public:
+    glyph_archive() = default;
+    glyph_archive(const glyph_archive&) = delete;
+    glyph_archive& operator=(const glyph_archive&) = delete;
+
+    ~glyph_archive() {
+        unmap();
+    }
+
+    /// Returns a hash of text that's stable between sessions.
+    static uint64_t fingerprint(std::string_view text);
+
+    /// Returns a persistent identifier for a font, given its PostScript name
+    /// and point size.
+    static uint64_t font_id(std::string_view postscript_name, double size);
+
+    /// Opens and maps the archive file at path.
+    /// @param path     The archive file's path. It's created on save.
+    /// @param version  The environment version, see above.
+    /// @param max_size The size in bytes the file may grow to. Once reached,
+    ///                 new glyphs are no longer archived.
+    void open(std::string path, uint64_t version, size_t max_size);
+
+    /// The number of glyphs in the archive, including unsaved glyphs.
+    size_t size() const {
+        return index.size();
+    }
+
+    /// Looks up an archived glyph.
+    /// @returns True if the glyph was found. Pixels point into mapped memory,
+    ///          or to unsaved glyphs, and remain valid until the next call to
+    ///          add() or save().
+    bool find(const key_type &key, bitmap &found);
+
+    /// Adds a glyph to the archive. It's written to disk by save().
+    /// Does nothing if the glyph is already archived, or the archive is full.
+    /// @param key      The glyph's key.
+    /// @param glyph    The glyph's bitmap.
+    /// @param row_size The number of bytes archived from each row of the
+    ///                 bitmap. Archived bitmaps are tightly packed, their
+    ///                 stride is row_size.
+    void add(const key_type &key, const bitmap &glyph, size_t row_size);
+
+    /// Replaces the archive file with one holding the glyphs it was opened
+    /// with, followed by the glyphs added since.
+    void save();
+};
+
+#endif // GLYPH_ARCHIVE_HPP
@@ -0,0 +1,245 @@
+//
+//  Neovim Mac
+//  grapheme_table.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef GRAPHEME_TABLE_HPP
+#define GRAPHEME_TABLE_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+#include "hash_table.hpp"
+#include "unfair_lock.hpp"
+
+namespace nvim {
+
+/// A sequence of Unicode code points that represent a single grapheme.
+/// Holds up to six (maxcombine in Neovim) UTF-8 encoded code points.
+using grapheme_cluster = std::array<char, 24>;
+
+/// An append only table of interned grapheme clusters.
+///
+/// Graphemes are identified by a 24 bit index. Entries are stored in fixed
+/// size chunks that are never moved or freed, so lookups are lock free, and
+/// the returned views are valid for the lifetime of the table. Interning
+/// takes a lock, and is safe to call from any thread.
+///
+/// The table only grows. That's fine for graphemes, there are only so many
+/// distinct multi code point graphemes a user will ever see.
+class grapheme_table {
+private:
+    struct entry {
+        grapheme_cluster text;
+        size_t size;
+    };
+
+    struct key_type {
+        size_t hash;
+        grapheme_cluster text;
+
+        key_type() = default;
+
+        explicit key_type(std::string_view view): text{} {
+            memcpy(text.data(), view.data(), view.size());
+
+            uint64_t words[3];
+            memcpy(words, text.data(), sizeof(words));
+            hash = (words[0] * 0x9e3779b97f4a7c15ull) ^
+                   (words[1] * 0xc2b2ae3d27d4eb4full) ^
+                   (words[2] * 0x165667b19e3779f9ull) ^ view.size();
+        }
+    };
+
+    static constexpr uint32_t chunk_size = 4096;
+    static constexpr uint32_t max_chunks = 4096;
+
+    std::unique_ptr<std::atomic<entry*>[]> chunks;
+    hash_table<key_type, uint32_t> index;
+    uint32_t count;
+    unfair_lock lock;
+
+public:
+    /// The maximum number of interned graphemes.
+    static constexpr uint32_t capacity = chunk_size * max_chunks;
+
+    /// Returned by intern() if the table is full.
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    grapheme_table(): chunks(new std::atomic<entry*>[max_chunks]), count(0) {
+        for (uint32_t i=0; i<max_chunks; ++i) {
+            chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    grapheme_table(const grapheme_table&) = delete;
+    grapheme_table& operator=(const grapheme_table&) = delete;
+
+    ~grapheme_table() {
+        for (uint32_t i=0; i<max_chunks; ++i) {
+            delete[] chunks[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    /// The table shared by every grid.
+    static grapheme_table& shared() {
+        static grapheme_table table;
+        return table;
+    }
+
+    /// Returns the index of text, interning it if necessary.
+    /// Text longer than a grapheme_cluster is trimmed.
+    /// @returns The grapheme's index, or npos if the table is full.
+    uint32_t intern(std::string_view text) {
+        text = text.substr(0, sizeof(grapheme_cluster));
+        key_type key(text);
+
+        std::lock_guard guard(lock);
+
+        if (const uint32_t *existing = index.find(key)) {
+            return *existing;
+        }
+
+        if (count == capacity) {
+            return npos;
+        }
+
+        uint32_t id = count;
+        entry *chunk = chunks[id / chunk_size].load(std::memory_order_relaxed);
+
+        if (!chunk) {
+            chunk = new entry[chunk_size];
+            chunks[id / chunk_size].store(chunk, std::memory_order_release);
+        }
+
+        chunk[id % chunk_size] = entry{key.text, text.size()};
+        index.insert(key, id);
+        count += 1;
+        return id;
+    }
+
+    /// Returns the interned grapheme with the given index.
+    /// Precondition: The index was returned by intern().
+    std::string_view get(uint32_t id) const {
+        const entry *chunk = chunks[id / chunk_size].load(std::memory_order_acquire);
+        const entry &found = chunk[id % chunk_size];
+        return std::string_view(found.text.data(), found.size);
+    }
+
+    /// The number of interned graphemes.
+    size_t size() {
+        std::lock_guard guard(lock);
+        return count;
+    }
+};
+
+/// A compact grapheme representation.
+///
+/// Graphemes of up to four bytes, which includes every single code point, are
+/// stored inline as their UTF-8 bytes, in memory order. Empty graphemes are
+/// zero. Longer graphemes are interned in a grapheme_table, in which case the
+/// first byte is 0xFF, which never occurs in UTF-8, and the remaining bytes
+/// hold the table index.
+class grapheme_id {
+private:
+    uint32_t value;
+
+    static constexpr unsigned char interned_tag = 0xFF;
+
+    unsigned char first_byte() const {
+        unsigned char first;
+        memcpy(&first, &value, 1);
+        return first;
+    }
+
+public:
+    /// The empty grapheme.
+    constexpr grapheme_id(): value(0) {}
+
+    /// Constructs the grapheme id of a single ASCII character.
+    /// Equivalent to grapheme_id(std::string_view(&ascii, 1), table).
+    explicit grapheme_id(char ascii): value(0) {
+        memcpy(&value, &ascii, 1);
+    }
+
+    /// Constructs a grapheme id from UTF-8 text, interning it in table if it
+    /// doesn't fit inline. If the table is full, the grapheme is replaced
+    /// with U+FFFD, the replacement character.
+    grapheme_id(std::string_view text, grapheme_table &table): value(0) {
+        if (text.size() <= sizeof(value) &&
+            std::find(text.begin(), text.end(), '\0') == text.end()) {
+            memcpy(&value, text.data(), text.size());
+            return;
+        }
+
+        uint32_t index = table.intern(text);
+
+        if (index == grapheme_table::npos) {
+            memcpy(&value, "\xef\xbf\xbd", 3);
+            return;
+        }
+
+        unsigned char bytes[4] = {
+            interned_tag,
+            static_cast<unsigned char>(index),
+            static_cast<unsigned char>(index >> 8),
+            static_cast<unsigned char>(index >> 16)
+        };
+
+        memcpy(&value, bytes, sizeof(value));
+    }
+
+    /// True if the grapheme is stored in a grapheme_table.
+    bool is_interned() const {
+        return first_byte() == interned_tag;
+    }
+
+    /// True if the grapheme is empty.
+    bool empty() const {
+        return value == 0;
+    }
+
+    /// The grapheme's UTF-8 text. Inline graphemes are viewed in place, so
+    /// the view is only valid for the lifetime of this object.
+    std::string_view view(const grapheme_table &table) const {
+        if (is_interned()) {
+            unsigned char bytes[4];
+            memcpy(bytes, &value, sizeof(value));
+            uint32_t index = bytes[1] | (bytes[2] << 8) | (bytes[3] << 16);
+            return table.get(index);
+        }
+
+        const char *data = reinterpret_cast<const char*>(&value);
+        return std::string_view(data, std::find(data, data + 4, '\0') - data);
+    }
+
+    /// The grapheme's UTF-8 text, zero padded to a grapheme_cluster.
+    grapheme_cluster cluster(const grapheme_table &table) const {
+        grapheme_cluster cluster = {};
+        std::string_view text = view(table);
+        memcpy(cluster.data(), text.data(), text.size());
+        return cluster;
+    }
+
+    friend bool operator==(grapheme_id left, grapheme_id right) {
+        return left.value == right.value;
+    }
+
+    friend bool operator!=(grapheme_id left, grapheme_id right) {
+        return left.value != right.value;
+    }
+};
+
+} // namespace nvim
+
+#endif // GRAPHEME_TABLE_HPP
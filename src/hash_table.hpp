@@ -0,0 +1,276 @@
+//
+//  Neovim Mac
+//  hash_table.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef HASH_TABLE_HPP
+#define HASH_TABLE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// A flat open addressing hash table.
+//
+// Keys and values are stored inline in a single array of slots, alongside a
+// parallel array of tag bytes. A tag is one of:
+//   - empty     - The slot has never been used.
+//   - deleted   - The slot's entry was erased (a tombstone).
+//   - full      - The high bit is set, the low 7 bits hold bits of the hash.
+//
+// Lookups probe linearly through the tags, and only compare keys when the tag
+// matches, so most probes never touch the slot array. Capacity is always a
+// power of two and the table is kept at most 7/8ths full, including
+// tombstones.
+//
+// The table is specialized for caches:
+//   - Keys must be trivially copyable and provide a precomputed `hash` member.
+//     Keys are compared bytewise, so they must not contain padding.
+//   - There is no single element erase. Entries are erased in bulk with
+//     filter(), which leaves tombstones behind rather than rehashing.
+//   - Entries can be referred to by their slot index. Slot indexes are stable
+//     until the table is rehashed, which is tracked by generation().
+
+template<typename Key, typename Value>
+class hash_table {
+private:
+    static_assert(std::is_trivially_copyable_v<Key>);
+    static_assert(std::is_trivially_copyable_v<Value>);
+
+    struct slot {
+        Key key;
+        Value value;
+    };
+
+    static constexpr uint8_t tag_empty = 0x00;
+    static constexpr uint8_t tag_deleted = 0x01;
+    static constexpr uint8_t tag_full = 0x80;
+
+    std::unique_ptr<uint8_t[]> tags;
+    std::unique_ptr<slot[]> slots;
+    size_t mask;
+    size_t count;
+    size_t used;
+    uint64_t rehashes;
+
+    // The key hashes aren't guaranteed to be of great quality, so mix them
+    // with a Fibonacci multiplier. The index comes from the high bits.
+    static size_t mix(size_t hash) {
+        return hash * 11400714819323198485ull;
+    }
+
+    static uint8_t make_tag(size_t mixed) {
+        return static_cast<uint8_t>(tag_full | (mixed >> 57));
+    }
+
+    size_t index(size_t mixed) const {
+        return (mixed >> 32) & mask;
+    }
+
+    static bool equal(const Key &left, const Key &right) {
+        return memcmp(&left, &right, sizeof(Key)) == 0;
+    }
+
+    size_t capacity() const {
+        return tags ? mask + 1 : 0;
+    }
+
+    void allocate(size_t new_capacity) {
+        tags = std::make_unique<uint8_t[]>(new_capacity);
+        slots.reset(new slot[new_capacity]);
+        mask = new_capacity - 1;
+        count = 0;
+        used = 0;
+    }
+
+    size_t insert_unique(const Key &key, const Value &value) {
+        size_t mixed = mix(key.hash);
+        size_t i = index(mixed);
+
+        while (tags[i] & tag_full) {
+            i = (i + 1) & mask;
+        }
+
+        used += tags[i] == tag_empty;
+        count += 1;
+        tags[i] = make_tag(mixed);
+        slots[i] = slot{key, value};
+        return i;
+    }
+
+    // Rehashes into a table of the given capacity, dropping tombstones.
+    void rehash(size_t new_capacity) {
+        auto old_tags = std::move(tags);
+        auto old_slots = std::move(slots);
+        size_t old_capacity = mask + 1;
+
+        allocate(new_capacity);
+        rehashes += 1;
+
+        for (size_t i=0; i<old_capacity; ++i) {
+            if (old_tags[i] & tag_full) {
+                insert_unique(old_slots[i].key, old_slots[i].value);
+            }
+        }
+    }
+
+public:
+    /// Returned by find_slot() if the key is not in the table.
+    static constexpr size_t npos = -1;
+
+    /// Constructs an empty hash table that can hold up to initial_capacity
+    /// elements without rehashing.
+    explicit hash_table(size_t initial_capacity = 0):
+        mask(0), count(0), used(0), rehashes(0) {
+        if (initial_capacity) {
+            reserve(initial_capacity);
+        }
+    }
+
+    hash_table(hash_table &&other) noexcept:
+        tags(std::move(other.tags)),
+        slots(std::move(other.slots)),
+        mask(std::exchange(other.mask, 0)),
+        count(std::exchange(other.count, 0)),
+        used(std::exchange(other.used, 0)),
+        rehashes(other.rehashes) {}
+
+    hash_table& operator=(hash_table &&other) noexcept {
+        tags = std::move(other.tags);
+        slots = std::move(other.slots);
+        mask = std::exchange(other.mask, 0);
+        count = std::exchange(other.count, 0);
+        used = std::exchange(other.used, 0);
+        rehashes = std::max(rehashes, other.rehashes) + 1;
+        return *this;
+    }
+
+    /// Returns the number of elements in the table.
+    size_t size() const {
+        return count;
+    }
+
+    /// Returns the number of slots. Valid slot indexes are less than this.
+    size_t slot_count() const {
+        return capacity();
+    }
+
+    /// Returns the number of times the table has been rehashed. Slot indexes
+    /// obtained in one generation are invalid in any other generation.
+    uint64_t generation() const {
+        return rehashes;
+    }
+
+    /// Ensures the table can hold at least size elements without rehashing.
+    void reserve(size_t size) {
+        size_t new_capacity = 16;
+
+        while (new_capacity - (new_capacity / 8) < size) {
+            new_capacity *= 2;
+        }
+
+        if (new_capacity > capacity()) {
+            if (tags) {
+                rehash(new_capacity);
+            } else {
+                allocate(new_capacity);
+            }
+        }
+    }
+
+    /// Returns a pointer to the value associated with key, or nullptr if the
+    /// key is not in the table.
+    const Value* find(const Key &key) const {
+        size_t i = find_slot(key);
+        return i != npos ? &slots[i].value : nullptr;
+    }
+
+    /// Returns the slot index of the given key, or npos if the key is not in
+    /// the table.
+    size_t find_slot(const Key &key) const {
+        if (!count) {
+            return npos;
+        }
+
+        size_t mixed = mix(key.hash);
+        uint8_t tag = make_tag(mixed);
+
+        for (size_t i = index(mixed);; i = (i + 1) & mask) {
+            if (tags[i] == tag && equal(slots[i].key, key)) {
+                return i;
+            }
+
+            if (tags[i] == tag_empty) {
+                return npos;
+            }
+        }
+    }
+
+    /// Returns the key in the given slot.
+    /// Precondition: The slot index is valid in the current generation.
+    const Key& key_at(size_t slot) const {
+        return slots[slot].key;
+    }
+
+    /// Returns the value in the given slot.
+    /// Precondition: The slot index is valid in the current generation.
+    const Value& value_at(size_t slot) const {
+        return slots[slot].value;
+    }
+
+    /// Returns the value in the given slot.
+    /// Precondition: The slot index is valid in the current generation.
+    Value& value_at(size_t slot) {
+        return slots[slot].value;
+    }
+
+    /// Inserts a key value pair into the table and returns its slot index.
+    /// Precondition: The key is not already in the table.
+    size_t insert(const Key &key, const Value &value) {
+        size_t limit = capacity() - (capacity() / 8);
+
+        if (used + 1 > limit) {
+            // If most of the used slots are tombstones, rehashing in place
+            // is enough to make room.
+            if (count + 1 <= limit / 2) {
+                rehash(capacity());
+            } else {
+                reserve(std::max<size_t>(count + 1, capacity()));
+            }
+        }
+
+        return insert_unique(key, value);
+    }
+
+    /// Invokes callback on every value in the table. The callback can modify
+    /// the value in place, and returns false if the entry should be erased.
+    template<typename Callable>
+    void filter(Callable callback) {
+        for (size_t i=0; i<capacity(); ++i) {
+            if ((tags[i] & tag_full) && !callback(slots[i].value)) {
+                tags[i] = tag_deleted;
+                count -= 1;
+            }
+        }
+    }
+
+    /// Erases every element in the table. The capacity is unchanged.
+    void clear() {
+        if (tags) {
+            memset(tags.get(), tag_empty, capacity());
+        }
+
+        count = 0;
+        used = 0;
+        rehashes += 1;
+    }
+};
+
+#endif // HASH_TABLE_HPP
@@ -0,0 +1,141 @@
+//
+//  Neovim Mac
+//  latency_tracker.cpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+
+#include "latency_tracker.hpp"
+#include "log.h"
+
+uint64_t latency_tracker::now() {
+    // CACurrentMediaTime() is mach_absolute_time() in seconds.
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+uint64_t latency_tracker::input_started() {
+    std::lock_guard guard(lock);
+    uint64_t id = next_id++;
+
+    if (inputs.size() == max_inputs) {
+        inputs.pop_front();
+    }
+
+    inputs.push_back(input_record{id, now(), 0, 0});
+
+    os_signpost_interval_begin(latency, id, "Input", "id=%llu", id);
+    os_signpost_interval_begin(latency, id, "KeyToPhoton", "id=%llu", id);
+    return id;
+}
+
+uint64_t latency_tracker::last_input() {
+    std::lock_guard guard(lock);
+    return next_id - 1;
+}
+
+void latency_tracker::input_acknowledged(uint64_t id, uint64_t serial) {
+    std::lock_guard guard(lock);
+
+    for (input_record &input : inputs) {
+        if (input.id <= id && !input.serial) {
+            input.serial = serial + 1;
+            os_signpost_interval_end(latency, input.id, "Input", "serial=%llu", serial);
+        }
+    }
+}
+
+void latency_tracker::flushed(uint64_t tick) {
+    std::lock_guard guard(lock);
+
+    // Serials are offset by one, so zero means unacknowledged. The current
+    // notification follows the acknowledgement if its serial is greater than
+    // the number of notifications queued before it.
+    for (input_record &input : inputs) {
+        if (input.serial && !input.tick && decoded >= input.serial) {
+            input.tick = tick;
+        }
+    }
+}
+
+void latency_tracker::presented(uint64_t tick, uint64_t time) {
+    std::lock_guard guard(lock);
+
+    auto completed = [&](const input_record &input) {
+        if (!input.tick || input.tick > tick) {
+            return false;
+        }
+
+        uint64_t elapsed = time > input.start ? time - input.start : 0;
+
+        if (samples.size() < max_samples) {
+            samples.push_back(elapsed);
+        } else {
+            samples[next_sample] = elapsed;
+            next_sample = (next_sample + 1) % max_samples;
+        }
+
+        os_signpost_interval_end(latency, input.id, "KeyToPhoton",
+                                 "tick=%llu latency=%llu", tick, elapsed);
+        return true;
+    };
+
+    inputs.erase(std::remove_if(inputs.begin(), inputs.end(), completed),
+                 inputs.end());
+}
+
+void latency_tracker::set_glyph_stats(const glyph_cache_stats &stats) {
+    std::lock_guard guard(lock);
+    glyphs = stats;
+}
+
+static double percent(uint64_t count, uint64_t total) {
+    return total ? (100.0 * count) / total : 0;
+}
+
+std::string latency_tracker::report() {
+    std::vector<uint64_t> sorted;
+    glyph_cache_stats stats;
+
+    {
+        std::lock_guard guard(lock);
+        sorted = samples;
+        stats = glyphs;
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+
+    // Nearest rank percentiles.
+    auto percentile = [&](size_t pct) -> double {
+        size_t rank = (pct * sorted.size() + 99) / 100;
+        return sorted[std::max<size_t>(rank, 1) - 1] / 1e6;
+    };
+
+    char buffer[512];
+    int length = 0;
+
+    if (sorted.size()) {
+        length = snprintf(buffer, sizeof(buffer),
+                          "Key to photon: p50 %.1fms, p99 %.1fms, %zu samples\n",
+                          percentile(50), percentile(99), sorted.size());
+    } else {
+        length = snprintf(buffer, sizeof(buffer), "Key to photon: no samples\n");
+    }
+
+    uint64_t hits = stats.memoized + stats.cached;
+    uint64_t lookups = hits + stats.archived + stats.rasterized;
+
+    snprintf(buffer + length, sizeof(buffer) - length,
+             "Glyph cache: %.2f%% hits, %llu memoized, %llu cached, "
+             "%llu archived, %llu rasterized",
+             percent(hits, lookups), stats.memoized, stats.cached,
+             stats.archived, stats.rasterized);
+
+    return buffer;
+}
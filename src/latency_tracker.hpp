@@ -0,0 +1,118 @@
+//
+//  Neovim Mac
+//  latency_tracker.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef LATENCY_TRACKER_HPP
+#define LATENCY_TRACKER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "unfair_lock.hpp"
+
+/// Glyph cache counters. See glyph_manager::stats().
+struct glyph_cache_stats {
+    uint64_t memoized;      ///< Lookups memoized in cells.
+    uint64_t cached;        ///< Lookups found in the glyph cache.
+    uint64_t archived;      ///< Glyphs loaded from the glyph archive.
+    uint64_t rasterized;    ///< Glyphs rasterized.
+};
+
+/// Measures key to photon latency, the time from a key press being handed to
+/// process::input() to the first frame showing Neovim's response on screen.
+///
+/// Inputs go through four states:
+///   1. Started, when the input is queued with input_started().
+///   2. Acknowledged, when Neovim responds to the request carrying the input.
+///   3. Flushed, by the first flush decoded after the acknowledgement. The
+///      input's response is assumed to be part of this flush.
+///   4. Presented, once a frame drawing that flush, or a later one, is on
+///      screen. The input's latency is recorded.
+///
+/// Flushes have to follow the acknowledgement in Neovim's output, not just in
+/// time, as notifications are decoded on their own queue. Acknowledgements
+/// carry the number of notifications queued before them, which is compared to
+/// the number of notifications decoded.
+///
+/// Latencies of recent inputs are kept and summarized by report(), along with
+/// the latest glyph cache counters.
+///
+/// Every state change also ends an os_signpost interval, see log.h.
+///
+/// Thread safety: Thread safe. notification_decoded() and flushed() should be
+/// called on the thread decoding notifications.
+class latency_tracker {
+private:
+    struct input_record {
+        uint64_t id;
+        uint64_t start;
+        uint64_t serial;
+        uint64_t tick;
+    };
+
+    // Inputs that are never presented, for example those that don't cause a
+    // redraw, would otherwise accumulate.
+    static constexpr size_t max_inputs = 256;
+    static constexpr size_t max_samples = 512;
+
+    unfair_lock lock;
+    std::deque<input_record> inputs;
+    std::vector<uint64_t> samples;
+    size_t next_sample = 0;
+    uint64_t next_id = 1;
+    uint64_t decoded = 0;
+    glyph_cache_stats glyphs = {};
+
+public:
+    latency_tracker() = default;
+    latency_tracker(const latency_tracker&) = delete;
+    latency_tracker& operator=(const latency_tracker&) = delete;
+
+    /// Returns the current time in nanoseconds, on the clock used by
+    /// CACurrentMediaTime() and presented drawables.
+    static uint64_t now();
+
+    /// Starts a new input.
+    /// @returns The input's id. Ids start at one and increase by one.
+    uint64_t input_started();
+
+    /// Returns the id of the last input started, or zero.
+    uint64_t last_input();
+
+    /// Acknowledges every input up to and including the given id.
+    /// @param id       The id of the last input acknowledged.
+    /// @param serial   The number of notifications queued before the
+    ///                 acknowledgement.
+    void input_acknowledged(uint64_t id, uint64_t serial);
+
+    /// Call before decoding a notification.
+    /// @returns The notification's serial number. Serial numbers start at one.
+    uint64_t notification_decoded() {
+        return ++decoded;
+    }
+
+    /// Marks acknowledged inputs as flushed.
+    /// @param tick The draw tick of the flushed grid set.
+    void flushed(uint64_t tick);
+
+    /// Records the latencies of inputs flushed at or before tick.
+    /// @param tick The draw tick of the presented grid set.
+    /// @param time When the frame was presented, see now().
+    void presented(uint64_t tick, uint64_t time);
+
+    /// Sets the glyph cache counters included in reports.
+    void set_glyph_stats(const glyph_cache_stats &stats);
+
+    /// Returns a human readable summary of recent latencies, as p50 and p99
+    /// percentiles, and glyph cache hit rates.
+    std::string report();
+};
+
+#endif // LATENCY_TRACKER_HPP
@@ -11,8 +11,15 @@
 #define LOG_H
 
 #include <os/log.h>
+#include <os/signpost.h>
 
 /// Logger for RPC related messages.
 extern os_log_t rpc;
 
+/// Logger for latency signposts. Intervals cover each stage from input to
+/// presentation: Input, Redraw, Flush, GetGrids, Encode, Commit, and the
+/// overall KeyToPhoton. Input ids, notification serials and draw ticks are
+/// used as signpost ids, or logged, to tie stages together.
+extern os_log_t latency;
+
 #endif // LOG_H
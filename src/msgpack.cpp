@@ -238,8 +238,147 @@ std::optional<integer> read_numeric(const unsigned char *data, size_t length) {
     return value;
 }
 
+// The header of a packed object.
+//   size     - The number of bytes spanned by the object, excluding any nested
+//              objects. For strings, binary, and extensions, includes the data.
+//   children - The number of nested objects that immediately follow.
+struct object_header {
+    size_t size;
+    size_t children;
+};
+
+template<typename T>
+size_t load_length(const unsigned char *data) {
+    T storage;
+    memcpy(&storage, data, sizeof(T));
+    return byteswap(storage);
+}
+
+// Parses the header of the object at data. Returns std::nullopt if the header
+// is truncated. The object's data may still be truncated, check header.size.
+std::optional<object_header> parse_header(const unsigned char *data, size_t size) {
+    if (!size) {
+        return std::nullopt;
+    }
+
+    const unsigned char byte = data[0];
+
+    // Returns the header of an object whose length is stored in a T.
+    auto sized = [&](auto tag, size_t extra, size_t multiplier,
+                     bool is_container) -> std::optional<object_header> {
+        using T = decltype(tag);
+
+        if (size < 1 + sizeof(T)) {
+            return std::nullopt;
+        }
+
+        size_t length = load_length<T>(data + 1);
+
+        if (is_container) {
+            return object_header{1 + sizeof(T), length * multiplier};
+        } else {
+            return object_header{1 + sizeof(T) + extra + length, 0};
+        }
+    };
+
+    switch (byte) {
+        case 0x00 ... 0x7f:
+        case 0xc0 ... 0xc3:
+        case 0xe0 ... 0xff:
+            return object_header{1, 0};
+
+        case 0x80 ... 0x8f:
+            return object_header{1, (byte & 0b00001111u) * 2ul};
+
+        case 0x90 ... 0x9f:
+            return object_header{1, byte & 0b00001111u};
+
+        case 0xa0 ... 0xbf:
+            return object_header{1ul + (byte & 0b00011111u), 0};
+
+        case 0xc4: return sized(uint8_t(),  0, 0, false);
+        case 0xc5: return sized(uint16_t(), 0, 0, false);
+        case 0xc6: return sized(uint32_t(), 0, 0, false);
+        case 0xc7: return sized(uint8_t(),  1, 0, false);
+        case 0xc8: return sized(uint16_t(), 1, 0, false);
+        case 0xc9: return sized(uint32_t(), 1, 0, false);
+
+        case 0xca: return object_header{5, 0};
+        case 0xcb: return object_header{9, 0};
+        case 0xcc: return object_header{2, 0};
+        case 0xcd: return object_header{3, 0};
+        case 0xce: return object_header{5, 0};
+        case 0xcf: return object_header{9, 0};
+        case 0xd0: return object_header{2, 0};
+        case 0xd1: return object_header{3, 0};
+        case 0xd2: return object_header{5, 0};
+        case 0xd3: return object_header{9, 0};
+        case 0xd4: return object_header{3, 0};
+        case 0xd5: return object_header{4, 0};
+        case 0xd6: return object_header{6, 0};
+        case 0xd7: return object_header{10, 0};
+        case 0xd8: return object_header{18, 0};
+
+        case 0xd9: return sized(uint8_t(),  0, 0, false);
+        case 0xda: return sized(uint16_t(), 0, 0, false);
+        case 0xdb: return sized(uint32_t(), 0, 0, false);
+        case 0xdc: return sized(uint16_t(), 0, 1, true);
+        case 0xdd: return sized(uint32_t(), 0, 1, true);
+        case 0xde: return sized(uint16_t(), 0, 2, true);
+        case 0xdf: return sized(uint32_t(), 0, 2, true);
+
+        default:
+            __builtin_unreachable();
+    }
+}
+
+// Walks object headers starting at data + offset, until remaining objects have
+// been passed. Returns false if the input ran out first. On return, offset and
+// remaining describe how far we got.
+bool walk_objects(const unsigned char *data, size_t size,
+                  size_t &offset, size_t &remaining) {
+    while (remaining) {
+        auto header = parse_header(data + offset, size - offset);
+
+        if (!header || header->size > size - offset) {
+            return false;
+        }
+
+        offset += header->size;
+        remaining += header->children;
+        remaining -= 1;
+    }
+
+    return true;
+}
+
 } // namespace
 
+size_t scanner::scan(const void *data, size_t size) {
+    auto bytes = static_cast<const unsigned char*>(data);
+
+    if (!walk_objects(bytes, size, offset, remaining)) {
+        return 0;
+    }
+
+    size_t length = offset;
+    offset = 0;
+    remaining = 1;
+    return length;
+}
+
+bool reader::skip() {
+    size_t offset = 0;
+    size_t remaining = 1;
+
+    if (!walk_objects(ptr, available(), offset, remaining)) {
+        return false;
+    }
+
+    ptr += offset;
+    return true;
+}
+
 std::string to_string(const object &obj) {
     to_string_visitor visitor;
     std::visit(visitor, obj);
@@ -558,8 +697,10 @@ unpack_object: // Label avoids excess indentation
         // stack.pop() returned nullptr - nothing is left to unpack.
         co_yield &top_level_object;
 
-        // We've been resumed reset everything before we restart.
-        allocator.dealloc_all();
+        // We've been resumed reset everything before we restart. Resetting
+        // the allocator keeps large messages down to a single backing buffer,
+        // so unpacking never needs malloc once the buffer has grown to fit.
+        allocator.reset();
         promise.obj = nullptr;
         obj = &top_level_object;
     }
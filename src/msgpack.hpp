@@ -16,6 +16,7 @@
 #include <cstring>
 #include <optional>
 #include <string>
+#include <utility>
 #include <variant>
 #include <vector>
 #include <coroutine>
@@ -28,6 +29,8 @@
 /// Summary:
 ///   msg::object   - Represents a MessagePack Object.
 ///   msg::unpacker - Deserializes a MessagePack byte stream into C++ objects.
+///   msg::scanner  - Finds the boundaries of objects in a MessagePack stream.
+///   msg::reader   - Reads MessagePack data in place, without unpacking it.
 ///   msg::packer   - Serializes C++ objects into a MessagePack byte stream.
 
 namespace msg {
@@ -510,6 +513,205 @@ inline uint64_t byteswap(uint64_t val) {
 
 } // namesapce detail
 
+/// Finds the boundaries of objects in a MessagePack byte stream.
+///
+/// Scanners walk object headers without unpacking or copying anything, which
+/// makes them much cheaper than unpackers. They're used to split a stream into
+/// complete objects, which can then be handled in place with a msg::reader.
+///
+/// Scanning is resumable. If the input holds an incomplete object, scan()
+/// remembers how far it got, and picks up from there when called again with
+/// the same data and more bytes appended. Example:
+///
+///     while (size_t length = scanner.scan(buffer.data(), buffer.size())) {
+///         use_object(buffer.data(), length);
+///         buffer.consume(length);
+///     }
+class scanner {
+private:
+    size_t offset;
+    size_t remaining;
+
+public:
+    scanner(): offset(0), remaining(1) {}
+
+    /// Scans for the end of the first object in data.
+    ///
+    /// @param data Pointer to the first byte of the object. If the previous
+    ///             call returned 0, data must hold the same bytes it did then,
+    ///             followed by any new bytes.
+    /// @param size The size of the input buffer.
+    ///
+    /// @returns The size in bytes of the first object, or 0 if the object is
+    ///          incomplete. Once a size is returned, the scanner resets and
+    ///          the next call should pass the data following the object.
+    size_t scan(const void *data, size_t size);
+};
+
+/// Reads MessagePack data in place.
+///
+/// Readers are cursors into a buffer holding complete MessagePack objects.
+/// They're an alternative to unpacking for hot paths, where the cost of
+/// building an object tree is significant. Strings and binary data returned
+/// by readers refer to the underlying buffer.
+///
+/// Read functions return std::nullopt, and do not advance, if the next object
+/// is not of the requested type or is truncated.
+class reader {
+private:
+    const unsigned char *ptr;
+    const unsigned char *last;
+
+    template<typename T>
+    T load(size_t offset) const {
+        detail::unsigned_equivalent<T> storage;
+        memcpy(&storage, ptr + offset, sizeof(T));
+        storage = detail::byteswap(storage);
+
+        T value;
+        memcpy(&value, &storage, sizeof(T));
+        return value;
+    }
+
+    size_t available() const {
+        return last - ptr;
+    }
+
+    std::optional<size_t> read_length(unsigned char fix_mask,
+                                      unsigned char fix_min,
+                                      unsigned char fix_max,
+                                      unsigned char first_byte,
+                                      bool has_8bit) {
+        if (!available()) {
+            return std::nullopt;
+        }
+
+        const unsigned char byte = *ptr;
+
+        if (byte >= fix_min && byte <= fix_max) {
+            ptr += 1;
+            return byte & fix_mask;
+        }
+
+        size_t index = byte - first_byte;
+        size_t width = has_8bit ? (1 << index) : (2 << index);
+
+        if (byte < first_byte || index > (has_8bit ? 2 : 1) || available() < width + 1) {
+            return std::nullopt;
+        }
+
+        size_t length;
+
+        switch (width) {
+            case 1:  length = load<uint8_t>(1);  break;
+            case 2:  length = load<uint16_t>(1); break;
+            default: length = load<uint32_t>(1); break;
+        }
+
+        ptr += width + 1;
+        return length;
+    }
+
+public:
+    reader(): ptr(nullptr), last(nullptr) {}
+
+    reader(const void *data, size_t size):
+        ptr(static_cast<const unsigned char*>(data)),
+        last(static_cast<const unsigned char*>(data) + size) {}
+
+    /// True if there's no data left to read.
+    bool empty() const {
+        return ptr == last;
+    }
+
+    /// A pointer to the next unread byte.
+    const char* position() const {
+        return reinterpret_cast<const char*>(ptr);
+    }
+
+    /// The number of unread bytes.
+    size_t size() const {
+        return available();
+    }
+
+    /// Skips the next size bytes.
+    /// Precondition: size <= this->size().
+    void advance(size_t size) {
+        ptr += size;
+    }
+
+    /// Reads an array header, returns the number of elements in the array.
+    /// The elements follow and should be read, or skipped, individually.
+    std::optional<size_t> read_array() {
+        return read_length(0x0f, 0x90, 0x9f, 0xdc, false);
+    }
+
+    /// Reads a map header, returns the number of key value pairs in the map.
+    std::optional<size_t> read_map() {
+        return read_length(0x0f, 0x80, 0x8f, 0xde, false);
+    }
+
+    /// Reads a string. The string refers to the underlying buffer.
+    std::optional<msg::string> read_string() {
+        const unsigned char *begin = ptr;
+        std::optional<size_t> length = read_length(0x1f, 0xa0, 0xbf, 0xd9, true);
+
+        if (!length || available() < *length) {
+            ptr = begin;
+            return std::nullopt;
+        }
+
+        msg::string string(reinterpret_cast<const char*>(ptr), *length);
+        ptr += *length;
+        return string;
+    }
+
+    /// Reads an integer.
+    std::optional<integer> read_integer() {
+        if (!available()) {
+            return std::nullopt;
+        }
+
+        const unsigned char byte = *ptr;
+
+        if (byte <= 0x7f || byte >= 0xe0) {
+            ptr += 1;
+            return byte <= 0x7f ? integer(byte) : integer(-256 | byte);
+        }
+
+        if (byte < 0xcc || byte > 0xd3) {
+            return std::nullopt;
+        }
+
+        size_t width = 1 << ((byte - 0xcc) & 3);
+
+        if (available() < width + 1) {
+            return std::nullopt;
+        }
+
+        std::optional<integer> value;
+
+        switch (byte) {
+            case 0xcc: value = load<uint8_t>(1);  break;
+            case 0xcd: value = load<uint16_t>(1); break;
+            case 0xce: value = load<uint32_t>(1); break;
+            case 0xcf: value = load<uint64_t>(1); break;
+            case 0xd0: value = load<int8_t>(1);   break;
+            case 0xd1: value = load<int16_t>(1);  break;
+            case 0xd2: value = load<int32_t>(1);  break;
+            case 0xd3: value = load<int64_t>(1);  break;
+        }
+
+        ptr += width + 1;
+        return value;
+    }
+
+    /// Skips the next object, including any nested objects.
+    /// @returns False if the object is truncated, in which case the reader
+    ///          does not advance.
+    bool skip();
+};
+
 /// Serializes C++ objects into a stream of MessagePack encoded bytes.
 ///
 /// Packers store their output stream in a circular_buffer. The interface of the
@@ -614,6 +816,13 @@ public:
         buffer.clear();
     }
 
+    /// Exchanges the packed byte stream with other. Lets a writer take the
+    /// packed bytes without copying them, while we carry on packing into
+    /// other's memory.
+    void swap_buffer(circular_buffer &other) {
+        std::swap(buffer, other);
+    }
+
     /// Explicitly pack a numeric value as PackType. This function does not
     /// optimize for the number of bytes it produces - it will always produce
     /// sizeof(T) + 1 bytes. This avoids some overhead.
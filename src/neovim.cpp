@@ -7,16 +7,21 @@
 //  See LICENSE.txt for details.
 //
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <spawn.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <algorithm>
+#include <cstdio>
 #include <limits>
 #include <thread>
 
 #include "clipboard.hpp"
 #include "log.h"
 #include "neovim.hpp"
+#include "perfect_hash.hpp"
 #include "spawn.hpp"
 #include "version.h"
 
@@ -49,6 +54,11 @@ namespace nvim {
 // additional bookkeeping to track timed out requests.
 static constexpr uint32_t null_msgid = std::numeric_limits<uint32_t>::max();
 
+// Keyboard input is sent with ids at or above input_msgid, offset by the id of
+// the last input the request carries. Their responses acknowledge inputs, see
+// latency_tracker. Response handler ids never get this large.
+static constexpr uint32_t input_msgid = 0x80000000;
+
 /// Allocate a new response context. Should be freed with free_context().
 process::response_context* process::response_handler_table::alloc_context() {
     if (freelist.size()) {
@@ -147,16 +157,25 @@ uint32_t process::store_handler(dispatch_time_t timeout,
     return handler_table->store_context(context);
 }
 
-process::process() {
+process::process(): input_buffer(65536),
+                    notification_ring(notification_ring_size),
+                    notification_drain_scheduled(false) {
     queue = nullptr;
+    ui_queue = nullptr;
     read_source = nullptr;
     write_source = nullptr;
     read_fd = -1;
     write_fd = -1;
+    capture_fd = -1;
+    notifications_queued = 0;
     semaphore = dispatch_semaphore_create(0);
 }
 
 process::~process() {
+    if (capture_fd != -1) {
+        close(capture_fd);
+    }
+
     if (!queue) return;
 
     assert(dispatch_source_testcancel(read_source));
@@ -164,6 +183,7 @@ process::~process() {
     assert(read_fd != -1 && write_fd != -1);
 
     dispatch_release(queue);
+    dispatch_release(ui_queue);
     dispatch_release(read_source);
     dispatch_release(write_source);
     dispatch_release(semaphore);
@@ -223,12 +243,28 @@ int process::connect(std::string_view addr) {
     return io_init(sock, sock);
 }
 
+int process::capture(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd == -1) {
+        return errno;
+    }
+
+    if (capture_fd != -1) {
+        close(capture_fd);
+    }
+
+    capture_fd = fd;
+    return 0;
+}
+
 /// Initializes and starts the IO loop.
-/// Creates the dispatch queue, dispatch sources and response handler table.
+/// Creates the dispatch queues, dispatch sources and response handler table.
 ///
 /// After this function call:
 ///  - When readfd is readable, io_can_read() is called.
 ///  - When writefd is writable, io_can_write() is called.
+///  - Notifications are handled on the UI queue, see queue_notification().
 ///
 /// The read source is activated immediately and is never suspended.
 /// The write source is only active while there is data waiting to be written.
@@ -243,6 +279,7 @@ int process::io_init(int readfd, int writefd) {
     read_fd = readfd;
     write_fd = writefd;
     queue = dispatch_queue_create(nullptr, DISPATCH_QUEUE_SERIAL);
+    ui_queue = dispatch_queue_create(nullptr, DISPATCH_QUEUE_SERIAL);
 
     // Response contexts may be referenced by dispatch_after blocks (timeout
     // handlers), which can outlive the process object. To prevent dangling
@@ -271,9 +308,13 @@ int process::io_init(int readfd, int writefd) {
         static_cast<process*>(context)->io_can_write();
     });
 
+    // Shutdown on the UI queue, after any notifications still in flight.
     dispatch_source_set_cancel_handler_f(read_source, [](void *context) {
         process *ptr = static_cast<process*>(context);
-        ptr->ui.shutdown();
+
+        dispatch_async_f(ptr->ui_queue, ptr, [](void *context) {
+            static_cast<process*>(context)->ui.shutdown();
+        });
     });
 
     dispatch_source_set_cancel_handler_f(write_source, [](void *context) {
@@ -289,39 +330,218 @@ int process::io_init(int readfd, int writefd) {
     return 0;
 }
 
+/// Reads everything available on read_fd straight into the input buffer.
+///
+/// The read source's data is an estimate of the number of bytes available, so
+/// the first read is sized to fit them all. The descriptor is blocking, so we
+/// only read again while FIONREAD reports more data. Draining the descriptor
+/// means a large redraw batch is handled in one dispatch round trip. Reads per
+/// event are capped, so a flood of input can't grow the buffer unboundedly.
 void process::io_can_read() {
-    ssize_t bytes = read(read_fd, read_buffer, sizeof(read_buffer));
+    size_t available = dispatch_source_get_data(read_source);
+    size_t total = 0;
+
+    for (;;) {
+        size_t size = std::clamp(available, min_read_size, max_read_size);
+        char *buffer = input_buffer.prepare(size);
+        ssize_t bytes = read(read_fd, buffer, size);
 
-    if (bytes <= 0) {
-        if (bytes == -1) {
-            return io_error();
+        if (bytes <= 0) {
+            if (bytes == -1) {
+                return io_error();
+            }
+
+            ui.window.close();
+            return io_cancel();
         }
 
-        ui.window.close();
-        return io_cancel();
+        input_buffer.commit(bytes);
+        total += bytes;
+
+        if (capture_fd != -1) {
+            io_capture(buffer, bytes);
+        }
+
+        int pending = 0;
+
+        if (total >= max_read_size ||
+            ioctl(read_fd, FIONREAD, &pending) == -1 || pending <= 0) {
+            break;
+        }
+
+        available = pending;
+    }
+
+    while (size_t length = input_scanner.scan(input_buffer.data(),
+                                              input_buffer.size())) {
+        on_rpc_packet(input_buffer.data(), length);
+        input_buffer.consume(length);
+    }
+}
+
+/// Appends data read from Neovim to the capture file.
+/// Writes are synchronous, capturing slows reads down, but keeps the capture
+/// complete up to the last read. On error, recording stops.
+void process::io_capture(const char *data, size_t size) {
+    while (size) {
+        ssize_t written = write(capture_fd, data, size);
+
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            os_log_error(rpc, "Capture error: %i: %s\n", errno, strerror(errno));
+            close(capture_fd);
+            capture_fd = -1;
+            return;
+        }
+
+        data += written;
+        size -= written;
+    }
+}
+
+/// Handles a complete RPC message.
+/// Notifications are handed over to the UI queue, responses and requests are
+/// unpacked and handled on the RPC queue.
+void process::on_rpc_packet(const char *data, size_t size) {
+    msg::reader reader(data, size);
+    std::optional<size_t> length = reader.read_array();
+    std::optional<msg::integer> type;
+
+    if (length && *length == 3 && (type = reader.read_integer()) && *type == 2) {
+        notifications_queued += 1;
+        return queue_notification(data, size);
     }
 
-    unpacker.feed(read_buffer, bytes);
+    unpacker.feed(data, size);
 
     while (msg::object *obj = unpacker.unpack()) {
         on_rpc_message(*obj);
     }
 }
 
+/// Handles a complete notification on the UI queue.
+/// Redraw notifications are decoded in place, avoiding the cost of unpacking
+/// large grid_line events. Other notifications are unpacked as usual.
+void process::on_notification_packet(const char *data, size_t size) {
+    msg::reader reader(data, size);
+    reader.read_array();
+    reader.read_integer();
+
+    const uint64_t serial = ui.get_latency_tracker()->notification_decoded();
+
+    if (std::optional<msg::string> name = reader.read_string()) {
+        if (*name == "redraw") {
+            os_signpost_interval_begin(latency, serial, "Redraw",
+                                       "serial=%llu size=%zu", serial, size);
+            ui.redraw(reader);
+            os_signpost_interval_end(latency, serial, "Redraw");
+            return;
+        }
+    }
+
+    notification_unpacker.feed(data, size);
+
+    while (msg::object *obj = notification_unpacker.unpack()) {
+        on_rpc_message(*obj);
+    }
+}
+
+/// Hands a notification over to the UI queue.
+///
+/// Notifications are decoded on their own serial queue, so that a large
+/// redraw batch doesn't hold up reading, or RPC responses. The RPC queue
+/// copies notifications into the notification ring, and the UI queue drains
+/// them in order. At most one drain block is scheduled at a time.
+///
+/// If the ring is full, or the notification is too large to ever fit, we
+/// block until the UI queue has handled it. Any notifications already in the
+/// ring are handled first.
+void process::queue_notification(const char *data, size_t size) {
+    if (notification_ring.push(data, size)) {
+        if (!notification_drain_scheduled.exchange(true)) {
+            dispatch_async_f(ui_queue, this, [](void *context) {
+                static_cast<process*>(context)->drain_notifications();
+            });
+        }
+
+        return;
+    }
+
+    struct notification {
+        process *self;
+        const char *data;
+        size_t size;
+    };
+
+    notification context = {this, data, size};
+
+    dispatch_sync_f(ui_queue, &context, [](void *ptr) {
+        notification *context = static_cast<notification*>(ptr);
+        context->self->drain_notifications();
+        context->self->on_notification_packet(context->data, context->size);
+    });
+}
+
+/// Handles every notification in the notification ring. Called on the UI queue.
+void process::drain_notifications() {
+    for (;;) {
+        while (packet_ring::packet packet = notification_ring.front()) {
+            on_notification_packet(packet.data, packet.size);
+            notification_ring.pop();
+        }
+
+        // Notifications pushed before we clear the flag didn't schedule a
+        // drain of their own, so we have to pick them up.
+        notification_drain_scheduled.exchange(false);
+
+        if (notification_ring.empty() ||
+            notification_drain_scheduled.exchange(true)) {
+            return;
+        }
+    }
+}
+
+/// Writes packed data to write_fd.
+///
+/// Requests are packed into the packer under write_lock, but written from
+/// write_buffer without holding it. Callers making requests only wait for
+/// other callers to finish packing, never for a write to complete.
 void process::io_can_write() {
-    std::lock_guard lock(write_lock);
-    ssize_t bytes = write(write_fd, packer.data(), packer.size());
+    if (!write_buffer.size() && !io_take_packed()) {
+        return;
+    }
+
+    ssize_t bytes = write(write_fd, write_buffer.data(), write_buffer.size());
 
     if (bytes == -1) {
         return io_error();
     }
 
-    packer.consume(bytes);
+    write_buffer.consume(bytes);
+
+    if (!write_buffer.size()) {
+        io_take_packed();
+    }
+}
+
+/// Moves everything packed so far into the empty write_buffer.
+/// If there's nothing to write, the write source is suspended.
+/// @returns True if write_buffer has data to write.
+bool process::io_take_packed() {
+    std::lock_guard lock(write_lock);
+    pack_pending_input();
+    packer.swap_buffer(write_buffer);
 
-    if (!packer.size()) {
-        dispatch_suspend(write_source);
-        write_state = dispatch_source_state::suspended;
+    if (write_buffer.size()) {
+        return true;
     }
+
+    dispatch_suspend(write_source);
+    write_state = dispatch_source_state::suspended;
+    return false;
 }
 
 void process::io_error() {
@@ -387,6 +607,11 @@ void process::on_rpc_response(msg::array array) {
         return;
     }
 
+    if (msgid >= input_msgid) {
+        return ui.get_latency_tracker()->input_acknowledged(msgid - input_msgid,
+                                                            notifications_queued);
+    }
+
     std::lock_guard lock(*handler_table);
 
     if (!handler_table->has_handler(msgid)) {
@@ -421,12 +646,24 @@ void process::on_rpc_notification(msg::array array) {
     msg::string name = array[1].get<msg::string>();
     msg::array args = array[2].get<msg::array>();
 
-    if (name == "redraw") {
-        return ui.redraw(args);
-    } else if (name == "colorscheme") {
-        return ui.colorscheme_update(args);
-    } else if (name == "vimenter") {
-        return ui.vimenter();
+    using notification_handler = void(*)(process*, msg::array);
+
+    static constexpr auto handlers = make_perfect_hash_map<notification_handler>({
+        {"redraw", [](process *nvim, msg::array args) {
+            nvim->ui.redraw(args);
+        }},
+        {"colorscheme", [](process *nvim, msg::array args) {
+            nvim->ui.colorscheme_update(args);
+        }},
+        {"vimenter", [](process *nvim, msg::array args) {
+            nvim->ui.vimenter();
+        }},
+    });
+
+    static_assert(handlers.valid());
+
+    if (notification_handler handler = handlers.find(name)) {
+        return handler(this, args);
     }
 
     os_log_info(rpc, "Unhanled notification - Name=%.*s, Args=%s",
@@ -444,7 +681,9 @@ void process::on_rpc_request(msg::array array) {
         return rpc_respond(msgid, nullptr, nullptr);
     } else if (name == "clipboard_get") {
         auto data = clipboard_get();
-        return rpc_respond(msgid, nullptr, data);
+        return rpc_respond(msgid, nullptr, data.as_tuple());
+    } else if (name == "stats") {
+        return rpc_respond(msgid, nullptr, stats());
     }
 
     rpc_respond(msgid, "Unknown method", nullptr);
@@ -453,10 +692,50 @@ void process::on_rpc_request(msg::array array) {
                 msg::to_string(args).c_str());
 }
 
+/// Resumes the write source if it's suspended. Requires write_lock.
+void process::resume_writes() {
+    if (write_state == dispatch_source_state::suspended) {
+        dispatch_resume(write_source);
+        write_state = dispatch_source_state::resumed;
+    }
+}
+
+/// Packs batched keyboard and mouse input. Requires write_lock.
+/// Called before packing any other message, so that input is never reordered.
+void process::pack_pending_input() {
+    if (pending_keys.size()) {
+        uint64_t last_input = ui.get_latency_tracker()->last_input();
+
+        packer.start_array(4);
+        packer.pack_uint64(0);
+        packer.pack_uint64(input_msgid + (last_input % input_msgid));
+        packer.pack_string("nvim_input");
+        packer.start_array(1);
+        packer.pack_string(pending_keys);
+        pending_keys.clear();
+    }
+
+    if (pending_drag) {
+        packer.start_array(4);
+        packer.pack_uint64(0);
+        packer.pack_uint64(null_msgid);
+        packer.pack_string("nvim_input_mouse");
+        packer.start_array(6);
+        packer.pack_string(pending_drag->button);
+        packer.pack_string("drag");
+        packer.pack_string(pending_drag->modifiers);
+        packer.pack_uint64(pending_drag->grid);
+        packer.pack_uint64(pending_drag->row);
+        packer.pack_uint64(pending_drag->col);
+        pending_drag.reset();
+    }
+}
+
 template<typename ...Args>
 void process::rpc_request(uint32_t msgid,
                           std::string_view method, const Args& ...args) {
     std::lock_guard lock(write_lock);
+    pack_pending_input();
 
     packer.start_array(4);
     packer.pack_uint64(0);
@@ -465,16 +744,14 @@ void process::rpc_request(uint32_t msgid,
     packer.start_array(sizeof...(Args));
     (packer.pack(args), ...);
 
-    if (write_state == dispatch_source_state::suspended) {
-        dispatch_resume(write_source);
-        write_state = dispatch_source_state::resumed;
-    }
+    resume_writes();
 }
 
 template<typename Error, typename Response>
 void process::rpc_respond(uint32_t msgid,
                           const Error &error, const Response &response) {
     std::lock_guard lock(write_lock);
+    pack_pending_input();
 
     packer.start_array(4);
     packer.pack_uint64(1);
@@ -482,27 +759,7 @@ void process::rpc_respond(uint32_t msgid,
     packer.pack(error);
     packer.pack(response);
 
-    if (write_state == dispatch_source_state::suspended) {
-        dispatch_resume(write_source);
-        write_state = dispatch_source_state::resumed;
-    }
-}
-
-/// Packs a string into a uint64_t at compile time.
-/// Note: The string must be less than 8 bytes long.
-static constexpr uint64_t constant(std::string_view shortstr) {
-    size_t size = shortstr.size();
-    uint64_t val = 0;
-    uint64_t shift = 0;
-
-    // Hackish. Assumes little endian memory layouts.
-    // It'll have to do while we wait for std::bitcast.
-    for (size_t i=0; i<size; ++i) {
-        val |= ((uint64_t)shortstr[i] << shift);
-        shift += 8;
-    }
-
-    return val;
+    resume_writes();
 }
 
 /// Maps a Vim mode shortname to a nvim::mode enum.
@@ -615,6 +872,9 @@ void process::ui_attach_request(size_t width, size_t height, ui_options opts) {
     rpc_request(null_msgid, "nvim_set_client_info",
                 "Neovim Mac", version, "ui", methods, attributes);
 
+    rpc_request(null_msgid, "nvim_command",
+                "command! NeovimMacStats call neovim_mac#Stats()");
+
     std::array<std::pair<msg::string, bool>, 8> options{{
         {"ext_cmdline",     opts.ext_cmdline},
         {"ext_hlstate",     opts.ext_hlstate},
@@ -648,7 +908,7 @@ void process::ui_attach_wait(size_t width, size_t height,
         return;
     }
 
-    dispatch_sync_f(queue, this, [](void *ptr) {
+    dispatch_sync_f(ui_queue, this, [](void *ptr) {
         process *self = static_cast<process*>(ptr);
 
         // If a grid is availible, signal now, otherwise wait for a flush.
@@ -667,7 +927,27 @@ void process::try_resize(size_t width, size_t height) {
 }
 
 void process::input(std::string_view input) {
-    rpc_request(null_msgid, "nvim_input", input);
+    std::lock_guard lock(write_lock);
+
+    if (pending_drag) {
+        pack_pending_input();
+    }
+
+    pending_keys.append(input);
+    ui.get_latency_tracker()->input_started();
+    resume_writes();
+}
+
+std::string process::stats() {
+    redraw_stats redraws = ui.get_redraw_scheduler().stats();
+    std::string report = ui.get_latency_tracker()->report();
+
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "\nRedraws: %llu flushes, %llu redraws, %llu merged, %llu dropped",
+             redraws.flushes, redraws.redraws, redraws.merged, redraws.dropped);
+
+    return report.append(buffer);
 }
 
 void process::feedkeys(std::string_view keys) {
@@ -704,6 +984,80 @@ void process::paste(std::string_view data) {
     rpc_request(null_msgid, "nvim_paste", data, false, -1);
 }
 
+/// Returns the length of the next chunk of a streamed paste.
+static size_t paste_chunk_length(std::string_view data, size_t max_length) {
+    if (data.size() <= max_length) {
+        return data.size();
+    }
+
+    size_t newline = data.rfind('\n', max_length - 1);
+
+    if (newline != std::string_view::npos) {
+        return newline + 1;
+    }
+
+    // No line break, back up to the start of a UTF-8 character.
+    size_t length = max_length;
+
+    while (length && (data[length] & 0xc0) == 0x80) {
+        length -= 1;
+    }
+
+    return length ? length : max_length;
+}
+
+void process::stream_paste(std::string_view data,
+                           std::shared_ptr<const void> owner) {
+    auto stream = std::make_shared<paste_stream>();
+    stream->owner = std::move(owner);
+    stream->remaining = data;
+    stream->started = false;
+    paste_next_chunk(std::move(stream));
+}
+
+void process::paste_next_chunk(std::shared_ptr<paste_stream> stream) {
+    size_t length = paste_chunk_length(stream->remaining, paste_chunk_size);
+    std::string_view chunk = stream->remaining.substr(0, length);
+    stream->remaining.remove_prefix(length);
+
+    bool first = !stream->started;
+    bool last = stream->remaining.empty();
+    stream->started = true;
+
+    // See :help nvim_paste for the phases. A whole paste is phase -1.
+    int phase = first ? (last ? -1 : 1) : (last ? 3 : 2);
+
+    if (last) {
+        return rpc_request(null_msgid, "nvim_paste", chunk, false, phase);
+    }
+
+    auto id = store_handler([this, stream](const msg::object &error,
+                                           const msg::object &result,
+                                           bool timed_out) {
+        // Neovim returns false if the paste was cancelled, we should stop.
+        if (!error.is<msg::null>() || !result.is<msg::boolean>() ||
+            !result.get<msg::boolean>()) {
+            return os_log_info(rpc, "Streamed paste stopped - Error=%s",
+                               msg::to_string(error).c_str());
+        }
+
+        // Handlers are called with the handler table locked, the next chunk
+        // registers a handler of its own. Send it once we've returned.
+        struct context {
+            process *nvim;
+            std::shared_ptr<paste_stream> stream;
+        };
+
+        dispatch_async_f(queue, new context{this, stream}, [](void *ptr) {
+            auto *ctx = static_cast<context*>(ptr);
+            ctx->nvim->paste_next_chunk(std::move(ctx->stream));
+            delete ctx;
+        });
+    });
+
+    rpc_request(id, "nvim_paste", chunk, false, phase);
+}
+
 void process::eval(std::string_view expr,
                    dispatch_time_t timeout, response_handler handler) {
     auto id = store_handler(timeout, std::move(handler));
@@ -715,9 +1069,30 @@ void process::error_writeln(std::string_view error) {
 }
 
 void process::input_mouse(std::string_view button, std::string_view action,
-                          std::string_view modifiers, size_t row, size_t col) {
-    rpc_request(null_msgid, "nvim_input_mouse",
-                button, action, modifiers, 0, row, col);
+                          std::string_view modifiers, size_t grid,
+                          size_t row, size_t col) {
+    if (action != "drag") {
+        return rpc_request(null_msgid, "nvim_input_mouse",
+                           button, action, modifiers, grid, row, col);
+    }
+
+    std::lock_guard lock(write_lock);
+
+    // Pending keys are never set together with a pending drag.
+    bool merge = pending_drag && pending_drag->button == button &&
+                 pending_drag->modifiers == modifiers &&
+                 pending_drag->grid == grid;
+
+    if (merge) {
+        pending_drag->row = row;
+        pending_drag->col = col;
+    } else {
+        pack_pending_input();
+        pending_drag = mouse_drag{std::string(button), std::string(modifiers),
+                                  grid, row, col};
+    }
+
+    resume_writes();
 }
 
 void process::drop_text(const std::vector<std::string_view> &text) {
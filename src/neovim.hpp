@@ -10,13 +10,17 @@
 #ifndef NEOVIM_HPP
 #define NEOVIM_HPP
 
+#include <atomic>
 #include <dispatch/dispatch.h>
 #include <functional>
 #include <deque>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include "msgpack.hpp"
+#include "packet_ring.hpp"
 #include "unfair_lock.hpp"
 #include "ui.hpp"
 
@@ -219,6 +223,15 @@ private:
         cancelled
     };
 
+    // Bounds on the size of a single read, see io_can_read(). The upper bound
+    // also caps the bytes read per read source event.
+    static constexpr size_t min_read_size = 16384;
+    static constexpr size_t max_read_size = 4194304;
+
+    // The size of the notification ring. Notifications that don't fit are
+    // handed over synchronously, see queue_notification().
+    static constexpr size_t notification_ring_size = 4194304;
+
     nvim::ui_controller ui;
     dispatch_queue_t queue;
     dispatch_source_t read_source;
@@ -228,23 +241,60 @@ private:
     dispatch_source_state write_state;
     int read_fd;
     int write_fd;
-    char read_buffer[16384];
+    int capture_fd;
+    circular_buffer input_buffer;
+    msg::scanner input_scanner;
     msg::packer packer;
+    circular_buffer write_buffer;
     msg::unpacker unpacker;
+    dispatch_queue_t ui_queue;
+    packet_ring notification_ring;
+    std::atomic<bool> notification_drain_scheduled;
+    uint64_t notifications_queued;
+    msg::unpacker notification_unpacker;
     unfair_lock write_lock;
     response_handler_table *handler_table;
 
+    /// A mouse drag waiting to be packed, see input_mouse().
+    struct mouse_drag {
+        std::string button;
+        std::string modifiers;
+        size_t grid;
+        size_t row;
+        size_t col;
+    };
+
+    // Input waiting to be packed, guarded by write_lock. See input().
+    std::string pending_keys;
+    std::optional<mouse_drag> pending_drag;
+
     int  io_init(int readfd, int writefd);
     void io_can_read();
     void io_can_write();
+    bool io_take_packed();
     void io_error();
     void io_cancel();
+    void io_capture(const char *data, size_t size);
+
+    /// A paste being streamed through nvim_paste, see stream_paste().
+    struct paste_stream {
+        std::shared_ptr<const void> owner;
+        std::string_view remaining;
+        bool started;
+    };
 
     void ui_attach_request(size_t width, size_t height, ui_options options);
+    void paste_next_chunk(std::shared_ptr<paste_stream> stream);
+    void pack_pending_input();
+    void resume_writes();
 
     uint32_t store_handler(response_handler &&handler);
     uint32_t store_handler(dispatch_time_t timeout, response_handler &&handler);
 
+    void on_rpc_packet(const char *data, size_t size);
+    void on_notification_packet(const char *data, size_t size);
+    void queue_notification(const char *data, size_t size);
+    void drain_notifications();
     void on_rpc_message(const msg::object &obj);
     void on_rpc_response(msg::array obj);
     void on_rpc_request(msg::array obj);
@@ -264,11 +314,32 @@ public:
 
     /// Returns a pointer to the most up to date global grid object.
     /// Calling this function invalidates pointers previously returned by this
-    /// function.
+    /// function and by get_grids().
     const nvim::grid* get_global_grid() {
         return ui.get_global_grid();
     }
 
+    /// Returns a pointer to the most up to date grid set.
+    /// Calling this function invalidates pointers previously returned by this
+    /// function and by get_global_grid().
+    const nvim::grid_set* get_grids() {
+        return ui.get_grids();
+    }
+
+    /// Returns the scheduler that paces redraws.
+    redraw_scheduler& get_redraw_scheduler() {
+        return ui.get_redraw_scheduler();
+    }
+
+    /// Returns the latency tracker, see latency_tracker.
+    const std::shared_ptr<latency_tracker>& get_latency_tracker() {
+        return ui.get_latency_tracker();
+    }
+
+    /// Returns a human readable summary of latency, glyph cache and redraw
+    /// statistics. Neovim requests it with :NeovimMacStats.
+    std::string stats();
+
     /// Returns the current Neovim options.
     nvim::ui_options get_ui_options() {
         return ui.get_ui_options();
@@ -294,27 +365,16 @@ public:
         return ui.get_colorscheme();
     }
 
-    /// The tabline lock. Clients should hold this lock when working with tabs.
-    unfair_lock& get_tab_lock() {
-        return ui.get_tab_lock();
-    }
-
-    /// Returns a view into the internal array of tabpages.
-    /// Note: Clients should acquire and hold the tabline lock during access.
-    msg::array_view<tabpage*> get_tabs() {
-        return ui.get_tabs();
+    /// Returns the most recently published tabline.
+    /// Calling this function invalidates references previously returned by
+    /// this function. Only call from the main thread.
+    const tabline& get_tabline() {
+        return ui.get_tabline();
     }
 
-    /// Returns the selected tabpage.
-    /// Note: Clients should acquire and hold the tabline lock during access.
-    tabpage* get_selected_tab() {
-        return ui.get_selected_tab();
-    }
-
-    /// Frees the given tabpage.
-    /// Note: Clients should acquire and hold the tabline lock before freeing.
-    void free_tabpage(tabpage *tab) {
-        ui.free_tabpage(tab);
+    /// Returns the version of the tabline last returned by get_tabline().
+    uint64_t get_tabline_version() const {
+        return ui.get_tabline_version();
     }
 
     /// Set the window controller.
@@ -337,6 +397,16 @@ public:
     /// @returns An errno code if an error occurred, 0 if no error occurred.
     int connect(std::string_view addr);
 
+    /// Records everything Neovim sends to a capture file.
+    ///
+    /// A capture is the raw MessagePack stream read from Neovim, exactly as it
+    /// was read, so it can be replayed without a Neovim process. See
+    /// redraw_replay. Recording stops if a write fails.
+    /// @param path The capture file's path. Existing files are replaced.
+    /// @returns An errno code if an error occurred, 0 if no error occurred.
+    /// Note: Call before spawn / connect.
+    int capture(const char *path);
+
     /// Synchronously attaches to the remote UI process.
     /// @param width    Requested screen columns.
     /// @param height   Requested screen rows.
@@ -373,6 +443,10 @@ public:
 
     /// Calls API method nvim_input.
     /// Used for raw keyboard input. Input should be escaped.
+    ///
+    /// Input is batched. Keys typed before the pending keys are written are
+    /// sent as a single nvim_input call. Batched keys are always sent before
+    /// any later request.
     /// @param input Keyboard input.
     void input(std::string_view input);
 
@@ -411,6 +485,21 @@ public:
     /// @param data Multi-line input, may be binary and contain NUL bytes.
     void paste(std::string_view data);
 
+    /// The maximum size of a chunk of a streamed paste.
+    static constexpr size_t paste_chunk_size = 1048576;
+
+    /// Streams a paste through nvim_paste in chunks of up to paste_chunk_size.
+    ///
+    /// Every chunk waits for Neovim's response to the previous one, so at most
+    /// one chunk is buffered. The paste stops early if Neovim cancels it.
+    /// Chunks end on line breaks where possible, and never split a UTF-8
+    /// character.
+    ///
+    /// @param data  Multi-line input. It's not copied, it must stay valid for
+    ///              the lifetime of owner.
+    /// @param owner Keeps data alive until the paste ends.
+    void stream_paste(std::string_view data, std::shared_ptr<const void> owner);
+
     /// Calls API method nvim_error_writeln.
     /// Writes a message to the nvim error buffer. Appends a new line character
     /// and flushes the buffer.
@@ -449,14 +538,18 @@ public:
     /// @param action   For non wheel mouse buttons, one of "press", "drag"
     ///                 or "release". For mouse wheel, pass the direction,
     ///                 "left", "right", "up", or "down".
-    /// @param row      Mouse row position.
-    /// @param col      Mouse column position.
+    /// @param grid     The grid under the mouse, or 0 without ext_multigrid.
+    /// @param row      Mouse row position, relative to grid.
+    /// @param col      Mouse column position, relative to grid.
+    ///
+    /// Consecutive drags with the same button, modifiers and grid are merged,
+    /// only the last position is sent.
     ///
     /// Note: All indexes are zero based.
     void input_mouse(std::string_view button,
                      std::string_view action,
                      std::string_view modifiers,
-                     size_t row, size_t col);
+                     size_t grid, size_t row, size_t col);
 
     /// Tests how many of the given files are currently open.
     /// @param paths    Absolute paths of the files to consider.
@@ -72,3 +72,7 @@ endfunction
 function! neovim_mac#Colorscheme(values) abort
     call rpcnotify(1, "colorscheme", a:values)
 endfunction
+
+function! neovim_mac#Stats() abort
+    echo rpcrequest(1, "stats")
+endfunction
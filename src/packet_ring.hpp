@@ -0,0 +1,158 @@
+//
+//  Neovim Mac
+//  packet_ring.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef PACKET_RING_HPP
+#define PACKET_RING_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+/// A lock free, single producer single consumer queue of variable sized packets.
+///
+/// Packets are copied into a fixed size ring buffer. Each packet is stored as
+/// an 8 byte size header followed by its data, padded to a multiple of 8 bytes.
+/// Packets are never split, if a packet doesn't fit before the end of the
+/// buffer, the remaining space is skipped with a wrap marker.
+///
+/// Thread safety:
+///   - push() is called by the producer.
+///   - front(), pop() and empty() are called by the consumer.
+class packet_ring {
+public:
+    /// A view of a queued packet. Valid until the packet is popped.
+    struct packet {
+        const char *data;
+        size_t size;
+
+        explicit operator bool() const {
+            return data != nullptr;
+        }
+    };
+
+private:
+    static constexpr uint64_t wrap_marker = UINT64_MAX;
+    static constexpr size_t header_size = sizeof(uint64_t);
+
+    std::unique_ptr<char[]> buffer;
+    size_t buffer_capacity;
+
+    // Monotonically increasing positions, masked on use. Kept on separate
+    // cache lines so the producer and consumer don't contend.
+    alignas(64) std::atomic<size_t> write_pos;
+    alignas(64) std::atomic<size_t> read_pos;
+
+    static size_t record_size(size_t size) {
+        return header_size + ((size + 7) & ~size_t(7));
+    }
+
+    static size_t round_capacity(size_t capacity) {
+        size_t rounded = 64;
+
+        while (rounded < capacity) {
+            rounded *= 2;
+        }
+
+        return rounded;
+    }
+
+    uint64_t read_header(size_t offset) const {
+        uint64_t header;
+        memcpy(&header, buffer.get() + offset, header_size);
+        return header;
+    }
+
+    void write_header(size_t offset, uint64_t header) {
+        memcpy(buffer.get() + offset, &header, header_size);
+    }
+
+public:
+    /// Constructs a ring of at least capacity bytes.
+    /// Capacity is rounded up to a power of two.
+    explicit packet_ring(size_t capacity):
+        buffer_capacity(round_capacity(capacity)), write_pos(0), read_pos(0) {
+        buffer.reset(new char[buffer_capacity]);
+    }
+
+    packet_ring(const packet_ring&) = delete;
+    packet_ring& operator=(const packet_ring&) = delete;
+
+    /// The size of the ring in bytes.
+    size_t capacity() const {
+        return buffer_capacity;
+    }
+
+    /// Queues a copy of a packet.
+    /// @returns False if there is not enough free space. Packets larger than
+    ///          capacity() - 8 bytes never fit.
+    bool push(const char *data, size_t size) {
+        size_t record = record_size(size);
+        size_t head = write_pos.load(std::memory_order_relaxed);
+        size_t tail = read_pos.load(std::memory_order_acquire);
+        size_t offset = head & (buffer_capacity - 1);
+        size_t contiguous = buffer_capacity - offset;
+        size_t needed = record > contiguous ? record + contiguous : record;
+
+        if (needed > buffer_capacity - (head - tail)) {
+            return false;
+        }
+
+        if (record > contiguous) {
+            write_header(offset, wrap_marker);
+            head += contiguous;
+            offset = 0;
+        }
+
+        write_header(offset, size);
+        memcpy(buffer.get() + offset + header_size, data, size);
+        write_pos.store(head + record, std::memory_order_release);
+        return true;
+    }
+
+    /// Returns the oldest queued packet, or a null packet if the ring is empty.
+    packet front() {
+        size_t tail = read_pos.load(std::memory_order_relaxed);
+        size_t head = write_pos.load(std::memory_order_acquire);
+
+        if (tail == head) {
+            return packet{nullptr, 0};
+        }
+
+        size_t offset = tail & (buffer_capacity - 1);
+        uint64_t size = read_header(offset);
+
+        // A wrapping packet is always published with its wrap marker, so
+        // there's a packet at the start of the buffer.
+        if (size == wrap_marker) {
+            read_pos.store(tail + buffer_capacity - offset,
+                           std::memory_order_release);
+            offset = 0;
+            size = read_header(0);
+        }
+
+        return packet{buffer.get() + offset + header_size, size};
+    }
+
+    /// Removes the oldest queued packet.
+    /// Note: Must follow a call to front() that returned a packet.
+    void pop() {
+        size_t tail = read_pos.load(std::memory_order_relaxed);
+        uint64_t size = read_header(tail & (buffer_capacity - 1));
+        read_pos.store(tail + record_size(size), std::memory_order_release);
+    }
+
+    /// Returns true if no packets are queued.
+    bool empty() const {
+        return read_pos.load(std::memory_order_relaxed) ==
+               write_pos.load(std::memory_order_acquire);
+    }
+};
+
+#endif // PACKET_RING_HPP
@@ -0,0 +1,137 @@
+//
+//  Neovim Mac
+//  perfect_hash.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef PERFECT_HASH_HPP
+#define PERFECT_HASH_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+/// Packs a string into a uint64_t at compile time.
+/// Note: The string must be less than 8 bytes long.
+constexpr uint64_t constant(std::string_view shortstr) {
+    size_t size = shortstr.size();
+    uint64_t val = 0;
+    uint64_t shift = 0;
+
+    // Hackish. Assumes little endian memory layouts.
+    // It'll have to do while we wait for std::bitcast.
+    for (size_t i=0; i<size; ++i) {
+        val |= ((uint64_t)(unsigned char)shortstr[i] << shift);
+        shift += 8;
+    }
+
+    return val;
+}
+
+// A constant string to value map, built at compile time.
+//
+// The map is a power of two sized table with at most one entry per slot. When
+// the map is constructed, hash seeds are tried in turn until one is found that
+// maps every key to a distinct slot. Lookups are then a hash, and a single
+// string comparison to reject keys that are not in the map.
+//
+// The hash only looks at the length and the first and last 8 bytes of a key,
+// so its cost is independent of the number of keys. Keys that only differ in
+// their middle bytes can't be separated, in which case valid() returns false.
+//
+// Maps should be constructed with make_perfect_hash_map() in a constexpr
+// context, and checked with a static_assert on valid().
+
+template<typename Value, size_t Size>
+class perfect_hash_map {
+private:
+    struct entry {
+        std::string_view key;
+        Value value = Value();
+    };
+
+    static constexpr size_t capacity() {
+        size_t capacity = 1;
+
+        while (capacity < Size * 4) {
+            capacity *= 2;
+        }
+
+        return capacity;
+    }
+
+    std::array<entry, capacity()> slots;
+    uint64_t seed;
+
+    static constexpr size_t index(std::string_view key, uint64_t seed) {
+        size_t size = key.size();
+        uint64_t head = constant(key.substr(0, std::min<size_t>(size, 8)));
+        uint64_t tail = constant(key.substr(size > 8 ? size - 8 : 0));
+
+        uint64_t hash = (head ^ seed) * 11400714819323198485ull;
+        hash ^= (tail + size) * 14029467366897019727ull;
+        hash ^= hash >> 29;
+        return (hash >> 32) & (capacity() - 1);
+    }
+
+    template<typename Entries>
+    constexpr bool build(const Entries &entries, uint64_t try_seed) {
+        slots = {};
+
+        for (const auto& [key, value] : entries) {
+            entry &slot = slots[index(key, try_seed)];
+
+            if (!slot.key.empty() || key.empty()) {
+                return false;
+            }
+
+            slot = entry{key, value};
+        }
+
+        return true;
+    }
+
+public:
+    template<typename Entries>
+    constexpr explicit perfect_hash_map(const Entries &entries): slots(), seed(0) {
+        for (uint64_t try_seed=1; try_seed<=256; ++try_seed) {
+            if (build(entries, try_seed)) {
+                seed = try_seed;
+                return;
+            }
+        }
+
+        slots = {};
+    }
+
+    /// False if no collision free hash seed was found.
+    constexpr bool valid() const {
+        return seed != 0;
+    }
+
+    /// Returns the value associated with key, or a value initialized Value
+    /// if key is not in the map.
+    constexpr Value find(std::string_view key) const {
+        const entry &slot = slots[index(key, seed)];
+
+        if (slot.key == key) {
+            return slot.value;
+        }
+
+        return Value();
+    }
+};
+
+/// Returns a perfect_hash_map of the given key value pairs.
+/// Keys must be unique and non empty.
+template<typename Value, size_t Size>
+constexpr auto make_perfect_hash_map(const std::pair<std::string_view, Value> (&entries)[Size]) {
+    return perfect_hash_map<Value, Size>(entries);
+}
+
+#endif // PERFECT_HASH_HPP
@@ -0,0 +1,206 @@
+//
+//  Neovim Mac
+//  redraw_replay.cpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "redraw_replay.hpp"
+
+namespace nvim {
+
+using replay_clock = std::chrono::steady_clock;
+
+int redraw_replay::load(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1) {
+        return errno;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) == -1) {
+        int error = errno;
+        close(fd);
+        return error;
+    }
+
+    std::string data(info.st_size, '\0');
+    size_t offset = 0;
+
+    while (offset < data.size()) {
+        ssize_t bytes = read(fd, data.data() + offset, data.size() - offset);
+
+        if (bytes <= 0) {
+            int error = bytes == 0 ? EIO : errno;
+            close(fd);
+            return error;
+        }
+
+        offset += bytes;
+    }
+
+    close(fd);
+    capture = std::move(data);
+    return 0;
+}
+
+replay_stats redraw_replay::run(ui_controller &ui,
+                                const std::function<void(const grid_set*)> &encode) {
+    struct packet {
+        const char *data;
+        size_t size;
+    };
+
+    replay_stats stats;
+    stats.bytes = capture.size();
+
+    // Stage 1: Frame messages, and keep the notifications. This is the work
+    // process::io_can_read() and process::on_rpc_packet() do.
+    std::vector<packet> notifications;
+    msg::scanner scanner;
+    auto start = replay_clock::now();
+
+    for (size_t offset = 0; offset < capture.size();) {
+        const char *data = capture.data() + offset;
+        size_t length = scanner.scan(data, capture.size() - offset);
+
+        if (!length) {
+            break;
+        }
+
+        msg::reader reader(data, length);
+        std::optional<size_t> size = reader.read_array();
+        std::optional<msg::integer> type;
+
+        if (size && *size == 3 && (type = reader.read_integer()) && *type == 2) {
+            notifications.push_back(packet{data, length});
+        }
+
+        stats.packets += 1;
+        offset += length;
+    }
+
+    stats.scan_time = replay_clock::now() - start;
+    stats.notifications = notifications.size();
+
+    // Stage 2: Unpack every notification into an object tree.
+    msg::unpacker unpacker;
+    start = replay_clock::now();
+
+    for (const packet &notification : notifications) {
+        unpacker.feed(notification.data, notification.size);
+        while (unpacker.unpack());
+        stats.unpacked_bytes += notification.size;
+    }
+
+    stats.unpack_time = replay_clock::now() - start;
+
+    // Stages 3 and 4: Decode redraw notifications in place, and encode a frame
+    // after every flush. Neovim ends each redraw batch with a flush, so we
+    // only look for flushes once per notification.
+    dispatch_semaphore_t flushed = dispatch_semaphore_create(0);
+    replay_stats::duration frame_time{};
+
+    for (const packet &notification : notifications) {
+        msg::reader reader(notification.data, notification.size);
+        reader.read_array();
+        reader.read_integer();
+
+        std::optional<msg::string> name = reader.read_string();
+
+        if (!name || *name != "redraw") {
+            continue;
+        }
+
+        ui.signal_on_flush(flushed);
+        start = replay_clock::now();
+        ui.redraw(reader);
+
+        auto redraw_time = replay_clock::now() - start;
+        stats.redraw_time += redraw_time;
+        stats.redraw_bytes += notification.size;
+        frame_time += redraw_time;
+
+        if (dispatch_semaphore_wait(flushed, DISPATCH_TIME_NOW) != 0) {
+            continue;
+        }
+
+        if (encode) {
+            start = replay_clock::now();
+            encode(ui.get_grids());
+
+            auto encode_time = replay_clock::now() - start;
+            stats.encode_time += encode_time;
+            frame_time += encode_time;
+        }
+
+        stats.frame_times.push_back(frame_time);
+        frame_time = replay_stats::duration{};
+    }
+
+    ui.signal_on_flush(nullptr);
+    dispatch_release(flushed);
+
+    std::sort(stats.frame_times.begin(), stats.frame_times.end());
+    stats.frames = stats.frame_times.size();
+    return stats;
+}
+
+replay_stats::duration replay_stats::percentile(double pct) const {
+    if (frame_times.empty()) {
+        return duration{};
+    }
+
+    // Nearest rank.
+    double rank = std::ceil((pct / 100.0) * frame_times.size());
+    size_t index = std::clamp<size_t>(static_cast<size_t>(rank), 1, frame_times.size());
+    return frame_times[index - 1];
+}
+
+static double milliseconds(replay_stats::duration time) {
+    return std::chrono::duration<double, std::milli>(time).count();
+}
+
+static double megabytes_per_second(size_t bytes, replay_stats::duration time) {
+    double seconds = std::chrono::duration<double>(time).count();
+    return seconds ? (bytes / (1024.0 * 1024.0)) / seconds : 0;
+}
+
+static double per_second(size_t count, replay_stats::duration time) {
+    double seconds = std::chrono::duration<double>(time).count();
+    return seconds ? count / seconds : 0;
+}
+
+std::string replay_stats::report() const {
+    char buffer[1024];
+
+    snprintf(buffer, sizeof(buffer),
+             "Replayed %zu bytes, %zu messages, %zu notifications, %zu frames\n"
+             "  scan:   %9.3f ms  %9.1f MB/s\n"
+             "  unpack: %9.3f ms  %9.1f MB/s\n"
+             "  redraw: %9.3f ms  %9.1f MB/s\n"
+             "  encode: %9.3f ms  %9.1f frames/s\n"
+             "  frame time (ms): p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+             bytes, packets, notifications, frames,
+             milliseconds(scan_time), megabytes_per_second(bytes, scan_time),
+             milliseconds(unpack_time), megabytes_per_second(unpacked_bytes, unpack_time),
+             milliseconds(redraw_time), megabytes_per_second(redraw_bytes, redraw_time),
+             milliseconds(encode_time), per_second(frames, encode_time),
+             milliseconds(percentile(50)), milliseconds(percentile(90)),
+             milliseconds(percentile(99)), milliseconds(percentile(100)));
+
+    return buffer;
+}
+
+} // namespace nvim
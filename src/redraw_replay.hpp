@@ -0,0 +1,90 @@
+//
+//  Neovim Mac
+//  redraw_replay.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef REDRAW_REPLAY_HPP
+#define REDRAW_REPLAY_HPP
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ui.hpp"
+
+namespace nvim {
+
+/// Timings of a replay, see redraw_replay.
+struct replay_stats {
+    using duration = std::chrono::nanoseconds;
+
+    size_t bytes = 0;           ///< The size of the capture.
+    size_t packets = 0;         ///< The number of RPC messages in the capture.
+    size_t notifications = 0;   ///< The number of notifications replayed.
+    size_t unpacked_bytes = 0;  ///< The size of the notifications replayed.
+    size_t redraw_bytes = 0;    ///< The size of the redraw notifications.
+    size_t frames = 0;          ///< The number of flushes.
+
+    duration scan_time{};       ///< Time spent framing messages.
+    duration unpack_time{};     ///< Time spent unpacking notifications.
+    duration redraw_time{};     ///< Time spent in ui_controller::redraw.
+    duration encode_time{};     ///< Time spent encoding frames.
+
+    /// The time taken by each frame, sorted. A frame is the redraw events
+    /// leading up to a flush, and the frame's encode.
+    std::vector<duration> frame_times;
+
+    /// Returns the frame time at or below which pct percent of frames fall.
+    duration percentile(double pct) const;
+
+    /// Returns a human readable summary.
+    std::string report() const;
+};
+
+/// Replays a capture of Neovim's output, without a Neovim process.
+///
+/// Captures are recorded by process::capture(). Replays follow the path a
+/// live process takes: messages are framed with msg::scanner, and redraw
+/// notifications are decoded in place by ui_controller::redraw. Every
+/// notification is also unpacked with msg::unpacker, which is how other
+/// notifications are handled, so regressions in either decoder show up.
+/// Responses and requests in the capture are skipped.
+///
+/// Each stage is timed separately, see replay_stats.
+class redraw_replay {
+private:
+    std::string capture;
+
+public:
+    /// Reads the capture file at path.
+    /// @returns An errno code if an error occurred, 0 if no error occurred.
+    int load(const char *path);
+
+    /// Replays the capture in data.
+    void assign(std::string data) {
+        capture = std::move(data);
+    }
+
+    /// Returns the capture's contents.
+    std::string_view data() const {
+        return capture;
+    }
+
+    /// Replays the capture.
+    /// @param ui       The UI controller to replay into. Any pending flush
+    ///                 signal is overwritten.
+    /// @param encode   Called after every flush, with the completed grids.
+    ///                 Should draw the grids as a window would. May be empty.
+    replay_stats run(ui_controller &ui,
+                     const std::function<void(const grid_set*)> &encode);
+};
+
+} // namespace nvim
+
+#endif // REDRAW_REPLAY_HPP
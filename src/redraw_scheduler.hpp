@@ -0,0 +1,125 @@
+//
+//  Neovim Mac
+//  redraw_scheduler.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef REDRAW_SCHEDULER_HPP
+#define REDRAW_SCHEDULER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/// Redraw scheduler counters. See redraw_scheduler::stats().
+struct redraw_stats {
+    uint64_t flushes;   ///< The number of flushes.
+    uint64_t redraws;   ///< The number of redraws.
+    uint64_t merged;    ///< Flushes merged into an already pending redraw.
+    uint64_t dropped;   ///< Refreshes skipped because a redraw was running late.
+};
+
+/// Paces redraws to the display's refresh rate.
+///
+/// Neovim can flush several times per display refresh. Flushes mark a redraw as
+/// pending, and only the first flush of a pending redraw asks the client to
+/// schedule one. The client redraws on the next display refresh, picking up
+/// the most recent grid set, so flushes that arrive in the meantime are merged
+/// into the redraw.
+///
+/// At most one redraw is in flight at a time. If a refresh comes around while
+/// the previous refresh's redraw is yet to run, the refresh is dropped.
+///
+/// Thread safety:
+///   - flushed() is called on the thread receiving Neovim's flushes.
+///   - refresh() is called by the display refresh callback.
+///   - begin_redraw() and cancel_refresh() are called on the thread that
+///     redraws.
+class redraw_scheduler {
+private:
+    std::atomic<bool> pending;
+    std::atomic<bool> in_flight;
+    std::atomic<uint64_t> flush_count;
+    std::atomic<uint64_t> redraw_count;
+    std::atomic<uint64_t> merged_count;
+    std::atomic<uint64_t> dropped_count;
+
+public:
+    redraw_scheduler(): pending(false), in_flight(false), flush_count(0),
+                        redraw_count(0), merged_count(0), dropped_count(0) {}
+
+    redraw_scheduler(const redraw_scheduler&) = delete;
+    redraw_scheduler& operator=(const redraw_scheduler&) = delete;
+
+    /// Call on every flush.
+    /// @returns True if the client should schedule a redraw, false if the
+    ///          flush was merged into an already pending redraw.
+    bool flushed() {
+        flush_count.fetch_add(1, std::memory_order_relaxed);
+
+        if (pending.exchange(true)) {
+            merged_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        return true;
+    }
+
+    /// Call on every display refresh.
+    /// @returns True if begin_redraw() should be called, false if the previous
+    ///          call is yet to happen.
+    bool refresh() {
+        if (in_flight.exchange(true)) {
+            if (pending.load()) {
+                dropped_count.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            return false;
+        }
+
+        return true;
+    }
+
+    /// Call in response to refresh().
+    /// @returns True if a redraw is pending. The caller should then redraw
+    ///          with the most recent grid set. If false, the client is idle,
+    ///          and can stop refreshing until the next call to flushed()
+    ///          returns true.
+    bool begin_redraw() {
+        in_flight.store(false);
+
+        if (pending.exchange(false)) {
+            redraw_count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        return false;
+    }
+
+    /// Call in response to refresh() instead of begin_redraw(), if the client
+    /// can't redraw right now, for example because its window is hidden. A
+    /// pending redraw stays pending, later flushes are merged into it, and
+    /// the next refresh() returns true again.
+    void cancel_refresh() {
+        in_flight.store(false);
+    }
+
+    /// Returns true if a redraw is pending.
+    bool is_pending() const {
+        return pending.load();
+    }
+
+    /// Returns a snapshot of the scheduler's counters.
+    redraw_stats stats() const {
+        redraw_stats stats;
+        stats.flushes = flush_count.load(std::memory_order_relaxed);
+        stats.redraws = redraw_count.load(std::memory_order_relaxed);
+        stats.merged = merged_count.load(std::memory_order_relaxed);
+        stats.dropped = dropped_count.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+#endif // REDRAW_SCHEDULER_HPP
@@ -21,7 +21,41 @@ struct uniform_data {
     uint32_t cursor_color;
     uint32_t cursor_line_width;
     uint32_t cursor_cell_width;
-    uint32_t grid_width;
+    uint32_t palette_size;
+};
+
+/// The colors of a highlight, as used by the shaders. Backgrounds and lines
+/// refer to their highlight ID, so a palette change only requires uploading
+/// a new palette. Glyphs carry their own colors, the glyph cache rasterizes
+/// glyphs with them.
+struct palette_entry {
+    uint32_t background;
+    uint32_t special;
+};
+
+/// Per grid draw parameters. With ext_multigrid, each grid is drawn
+/// separately, offset by its position in the global grid.
+struct grid_uniform_data {
+    /// The position of the grid's top left cell in the global grid.
+    simd_short2 origin;
+
+    /// The grid's width in cells.
+    uint32_t width;
+};
+
+/// Draw parameters for a grid rendered to an offscreen texture.
+struct grid_texture_data {
+    /// The position of the grid's top left cell in the global grid.
+    simd_short2 origin;
+
+    /// The grid's size in cells.
+    simd_short2 size;
+
+    /// The range of grid rows to draw, [x, y).
+    simd_short2 rows;
+
+    /// A vertical translation in pixels, used to animate scrolling.
+    float offset;
 };
 
 /// A rasterized glyph stored in a Metal texture.
@@ -36,18 +70,23 @@ struct glyph_rect {
     ///   x - The x position in pixel coordinates.
     ///   y - The y position in pixel coordinates.
     ///   z - The cache page the glyph is on.
-    simd_short3 texture_origin;
+    ///   w - 1 if the glyph is a coverage mask that is tinted with the glyph
+    ///       color, 0 if the glyph was rasterized in color.
+    simd_short4 texture_origin;
 };
 
 struct glyph_data {
     simd_short2 grid_position;
     uint32_t cell_width;
     glyph_rect rect;
+    uint32_t color;
 
     glyph_data() = default;
 
-    glyph_data(simd_short2 grid_position, uint32_t cell_width, glyph_rect rect):
-        grid_position(grid_position), cell_width(cell_width), rect(rect) {}
+    glyph_data(simd_short2 grid_position, uint32_t cell_width,
+               glyph_rect rect, uint32_t color):
+        grid_position(grid_position), cell_width(cell_width),
+        rect(rect), color(color) {}
 };
 
 struct line_metrics {
@@ -62,11 +101,12 @@ struct line_metrics {
 };
 
 /// Describes an underline, undercurl, or a strikethrough.
-/// Lines have the same width as cells. Adjacent line_data objects as used to
-/// draw continuous lines that are longer than a cell.
+/// Lines are encoded as runs, a line_data object covers width adjacent cells
+/// with the same kind of line drawn in the same highlight.
 struct line_data {
     simd_short2 grid_position;
-    uint32_t color;
+    uint16_t highlight;
+    uint16_t width;
     int16_t ytranslate;
     uint16_t period;
     uint16_t thickness;
@@ -74,20 +114,22 @@ struct line_data {
 
     line_data() = default;
 
-    /// Constructs a new line_data object.
-    /// @param grid_position    The grid position of the line.
-    /// @param color            The color of the line.
+    /// Constructs a new line_data object covering a single cell.
+    /// @param grid_position    The grid position of the line's first cell.
+    /// @param highlight        The palette index of the line's color.
     /// @param metrics          The line's metrics.
-    /// @param count            The position of the cell in the overall line.
+    /// @param count            The position of the first cell in the overall line.
     ///
-    /// The count paramter is a zero based index of the cell's position in the
-    /// overall line. For example, given the 5th cell in a row with an underline
-    /// stretching from the 4th cell to the 8th, count would be 1. This is
-    /// required to correctly render dotted lines. For solid lines, pass 0.
-    line_data(simd_short2 grid_position, uint32_t color,
+    /// The count paramter is a zero based index of the first cell's position
+    /// in the overall line. For example, given a run starting at the 5th cell
+    /// in a row with an undercurl stretching from the 4th cell to the 8th,
+    /// count would be 1. The shader uses it to keep dotted lines in phase
+    /// across runs. For solid lines, pass 0.
+    line_data(simd_short2 grid_position, uint16_t highlight,
               line_metrics metrics, uint16_t count = 0):
         grid_position(grid_position),
-        color(color),
+        highlight(highlight),
+        width(1),
         ytranslate(metrics.ytranslate),
         period(metrics.period),
         thickness(metrics.thickness),
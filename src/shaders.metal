@@ -23,10 +23,17 @@ struct line_rasterizer_data {
     float period;
 };
 
+struct texture_rasterizer_data {
+    float4 position [[position]];
+    float2 texture_position;
+};
+
 struct glyph_rasterizer_data {
     float4 position [[position]];
     float2 texture_position;
     uint32_t texture_index;
+    float4 color [[flat]];
+    uint32_t tinted [[flat]];
 };
 
 // Our vertex data represents rectangles as an origin + size tuple. To translate
@@ -45,21 +52,34 @@ constant float2 cursor_transforms[5][4] = {
     {{ 0, -1}, { 0,  0}, { 0, -1}, { 0,  0}},
     {{ 0,  0}, { 0,  1}, { 0,  0}, { 0,  1}},
     {{-1,  0}, {-1,  0}, { 0,  0}, { 0,  0}},
+    {{ 0,  0}, { 0,  0}, { 0,  0}, { 0,  0}},
 };
 
+// Returns the palette entry of a highlight ID. Undefined highlight IDs use the
+// default highlight, as in grid_set::attributes.
+static inline palette_entry palette_lookup(constant uniform_data &uniforms,
+                                           constant palette_entry *palette,
+                                           uint32_t highlight) {
+    return palette[highlight < uniforms.palette_size ? highlight : 0];
+}
+
 vertex extern grid_rasterizer_data background_render(uint vertex_id [[vertex_id]],
                                                      uint instance_id [[instance_id]],
                                                      constant uniform_data &uniforms [[buffer(0)]],
-                                                     constant uint32_t *cell_colors [[buffer(1)]]) {
-    uint32_t row = instance_id / uniforms.grid_width;
-    uint32_t col = instance_id % uniforms.grid_width;
+                                                     constant uint16_t *cell_highlights [[buffer(1)]],
+                                                     constant grid_uniform_data &grid [[buffer(2)]],
+                                                     constant palette_entry *palette [[buffer(3)]]) {
+    uint32_t row = instance_id / grid.width;
+    uint32_t col = instance_id % grid.width;
 
-    float2 cell_vertex = float2(col, row) + transforms[vertex_id];
+    float2 cell_vertex = float2(col, row) + float2(grid.origin.xy) + transforms[vertex_id];
     float2 position = float2(-1, 1) + (uniforms.cell_size * cell_vertex);
 
+    uint32_t background = palette_lookup(uniforms, palette, cell_highlights[instance_id]).background;
+
     grid_rasterizer_data data;
     data.position = float4(position.xy, 0, 1);
-    data.color = unpack_unorm4x8_srgb_to_float(cell_colors[instance_id]);
+    data.color = unpack_unorm4x8_srgb_to_float(background);
     return data;
 }
 
@@ -69,7 +89,8 @@ vertex extern grid_rasterizer_data background_render(uint vertex_id [[vertex_id]
 ///   2. A bottom anchored horizontal bar.
 ///   3. A left anchored vertical bar.
 ///   4. A top anchored horizontal bar.
-/// Draw all four instances to create a block outline.
+///   5. A block covering the entire cursor cell.
+/// Draw the first four instances to create a block outline.
 vertex extern grid_rasterizer_data cursor_render(uint vertex_id [[vertex_id]],
                                                  uint instance_id [[instance_id]],
                                                  constant uniform_data &uniforms [[buffer(0)]]) {
@@ -101,14 +122,16 @@ vertex extern grid_rasterizer_data cursor_render(uint vertex_id [[vertex_id]],
 vertex extern line_rasterizer_data line_render(uint vertex_id [[vertex_id]],
                                                uint instance_id [[instance_id]],
                                                constant uniform_data &uniforms [[buffer(0)]],
-                                               constant line_data *lines [[buffer(1)]]) {
+                                               constant line_data *lines [[buffer(1)]],
+                                               constant grid_uniform_data &grid [[buffer(2)]],
+                                               constant palette_entry *palette [[buffer(3)]]) {
     constant line_data &line = lines[instance_id];
-    int16_t row = line.grid_position.y;
-    int16_t col = line.grid_position.x;
+    int16_t row = line.grid_position.y + grid.origin.y;
+    int16_t col = line.grid_position.x + grid.origin.x;
 
-    // Lines have the same width as a cell.
+    // Lines span width cells.
     // Their height is given by their thickness.
-    float2 line_size = float2(uniforms.cell_pixel_size.x, line.thickness);
+    float2 line_size = float2(uniforms.cell_pixel_size.x * line.width, line.thickness);
 
     // The offset of the line's top left corner in pixel coordinates.
     float2 line_offset = uniforms.cell_pixel_size * float2(col, row);
@@ -117,12 +140,15 @@ vertex extern line_rasterizer_data line_render(uint vertex_id [[vertex_id]],
     float2 pixel_position = line_offset + (line_size * transforms[vertex_id]);
     float2 position = float2(-1, 1) + (pixel_position * uniforms.pixel_size);
 
-    float line_position = line.count + transforms[vertex_id].x;
+    // The vertex position in cells from the start of the overall line. Dotted
+    // lines are interpolated across the run, starting from the phase of the
+    // run's first cell.
+    float line_position = line.count + (transforms[vertex_id].x * line.width);
     float period = uniforms.cell_pixel_size.x * line_position / line.period;
 
     line_rasterizer_data data;
     data.position = float4(position.xy, 0, 1);
-    data.color = unpack_unorm4x8_srgb_to_float(line.color);
+    data.color = unpack_unorm4x8_srgb_to_float(palette_lookup(uniforms, palette, line.highlight).special);
     data.period = select(0.5, period, line.period);
     return data;
 }
@@ -130,10 +156,11 @@ vertex extern line_rasterizer_data line_render(uint vertex_id [[vertex_id]],
 vertex extern glyph_rasterizer_data glyph_render(uint vertex_id [[vertex_id]],
                                                  uint instance_id [[instance_id]],
                                                  constant uniform_data &uniforms [[buffer(0)]],
-                                                 constant glyph_data *glyphs [[buffer(1)]]) {
+                                                 constant glyph_data *glyphs [[buffer(1)]],
+                                                 constant grid_uniform_data &grid [[buffer(2)]]) {
     constant glyph_data &glyph = glyphs[instance_id];
-    int16_t col = glyph.grid_position.x;
-    int16_t row = glyph.grid_position.y;
+    int16_t col = glyph.grid_position.x + grid.origin.x;
+    int16_t row = glyph.grid_position.y + grid.origin.y;
 
     // The position of the cell's top right corner in pixel coordinates.
     float2 cell_position = uniforms.cell_pixel_size * float2(col, row);
@@ -168,6 +195,32 @@ vertex extern glyph_rasterizer_data glyph_render(uint vertex_id [[vertex_id]],
     data.position = float4(position.xy, 0, 1);
     data.texture_position = float2(glyph.rect.texture_origin.xy) + texture_offset;
     data.texture_index = glyph.rect.texture_origin.z;
+    data.color = unpack_unorm4x8_srgb_to_float(glyph.color);
+    data.tinted = glyph.rect.texture_origin.w > 0 ? 1 : 0;
+    return data;
+}
+
+/// Draws rows of a grid rendered to an offscreen texture.
+/// Grid textures have the same cell size as the drawable, so they're copied
+/// pixel for pixel, translated vertically by the grid's offset.
+vertex extern texture_rasterizer_data grid_texture_render(uint vertex_id [[vertex_id]],
+                                                          constant uniform_data &uniforms [[buffer(0)]],
+                                                          constant grid_texture_data &grid [[buffer(2)]]) {
+    float2 rows_begin = float2(0, grid.rows.x);
+    float2 rows_size = float2(grid.size.x, grid.rows.y - grid.rows.x);
+
+    // The vertex position in grid cells, and in pixels in the grid texture.
+    float2 cell_vertex = rows_begin + (rows_size * transforms[vertex_id]);
+    float2 texture_position = uniforms.cell_pixel_size * cell_vertex;
+
+    float2 pixel_position = uniforms.cell_pixel_size * float2(grid.origin.xy) + texture_position;
+    pixel_position.y += grid.offset;
+
+    float2 position = float2(-1, 1) + (pixel_position * uniforms.pixel_size);
+
+    texture_rasterizer_data data;
+    data.position = float4(position.xy, 0, 1);
+    data.texture_position = texture_position;
     return data;
 }
 
@@ -186,5 +239,19 @@ fragment float4 glyph_fill(glyph_rasterizer_data in [[stage_in]],
                                       address::clamp_to_zero,
                                       coord::pixel);
 
-    return texture.sample(texture_sampler, in.texture_position, in.texture_index);
+    float4 texel = texture.sample(texture_sampler, in.texture_position, in.texture_index);
+
+    // Coverage masks store coverage in the alpha channel. Color glyphs are
+    // opaque, so they're unaffected by blending.
+    return in.tinted ? float4(in.color.rgb, texel.a) : texel;
+}
+
+fragment float4 grid_texture_fill(texture_rasterizer_data in [[stage_in]],
+                                  texture2d<float> texture [[texture(0)]]) {
+    constexpr sampler texture_sampler(mag_filter::nearest,
+                                      min_filter::nearest,
+                                      address::clamp_to_zero,
+                                      coord::pixel);
+
+    return texture.sample(texture_sampler, in.texture_position);
 }
@@ -0,0 +1,88 @@
+//
+//  Neovim Mac
+//  triple_buffer.hpp
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/// Publishes immutable snapshots from one writer thread to one reader thread.
+///
+/// Uses the same scheme as the UI controller's grid sets. There are three
+/// slots, the writer fills the writing slot and publishes it by swapping it
+/// with the complete slot. The reader takes the complete slot by swapping it
+/// with the slot it last read. Neither side ever blocks, and the reader always
+/// gets the latest published snapshot, intermediate snapshots are skipped.
+///
+/// Slots are reused, the writing slot holds an old snapshot, so writers
+/// should overwrite it completely before publishing.
+///
+/// Thread safety: writing() and publish() must be called from one thread,
+/// read() and read_tick() from another.
+template<typename T>
+class triple_buffer {
+private:
+    struct slot {
+        T value;
+        uint64_t tick;
+    };
+
+    slot slots[3];
+    std::atomic<slot*> complete;
+    slot *writing_slot;
+    slot *reading_slot;
+    uint64_t write_tick;
+
+public:
+    triple_buffer(): slots{}, write_tick(0) {
+        complete = &slots[0];
+        writing_slot = &slots[1];
+        reading_slot = &slots[2];
+    }
+
+    triple_buffer(const triple_buffer&) = delete;
+    triple_buffer& operator=(const triple_buffer&) = delete;
+
+    /// Returns the slot the writer fills before calling publish().
+    T& writing() {
+        return writing_slot->value;
+    }
+
+    /// Publishes the writing slot, making it available to the reader.
+    /// @returns The tick of the published snapshot, ticks start at 1.
+    uint64_t publish() {
+        writing_slot->tick = ++write_tick;
+        writing_slot = complete.exchange(writing_slot);
+        return write_tick;
+    }
+
+    /// Returns the most recently published snapshot.
+    /// The returned reference is valid until the next call to read().
+    /// If nothing was published, returns a default constructed T.
+    const T& read() {
+        uint64_t tick = reading_slot->tick;
+
+        for (;;) {
+            reading_slot = complete.exchange(reading_slot);
+
+            if (reading_slot->tick >= tick) {
+                return reading_slot->value;
+            }
+        }
+    }
+
+    /// Returns the tick of the snapshot last returned by read(), or 0 if no
+    /// snapshot was published at the time.
+    uint64_t read_tick() const {
+        return reading_slot->tick;
+    }
+};
+
+#endif // TRIPLE_BUFFER_HPP
@@ -8,11 +8,14 @@
 //
 
 #include <algorithm>
+#include <cmath>
 #include <utility>
 #include <iostream>
 #include <type_traits>
 
+#include "block_fill.hpp"
 #include "log.h"
+#include "perfect_hash.hpp"
 #include "ui.hpp"
 
 namespace nvim {
@@ -35,6 +38,12 @@ inline const cell_attributes* hl_get_entry(const highlight_table &table,
     return &table[0];
 }
 
+/// Returns the highlight ID stored in cells for the given highlight ID.
+/// Cells store 16 bit IDs. Larger IDs are replaced by the default highlight.
+inline uint16_t hl_cell_id(size_t hlid) {
+    return hlid <= UINT16_MAX ? static_cast<uint16_t>(hlid) : 0;
+}
+
 /// Create new entry for the given id.
 /// If the ID has been used before, the old entry is replaced.
 /// Any gaps created in the table are filled by default initialized entries.
@@ -53,7 +62,7 @@ inline cell_attributes* hl_new_entry(highlight_table &table, size_t hlid) {
     }
 
     cell_attributes default_attrs = table[0];
-    table.resize(hlid, default_attrs);
+    table.resize(hlid + 1, default_attrs);
     return &table.back();
 }
 
@@ -135,16 +144,24 @@ void apply(ui_controller *controller,
     }
 }
 
+/// Handles a redraw event given its name and parameter tuples.
+using event_handler = void(*)(ui_controller*, const msg::string&,
+                              const msg::array&);
+
+/// An event_handler that applies member_function to each parameter tuple.
+template<auto member_function>
+void dispatch(ui_controller *controller,
+              const msg::string &name, const msg::array &args) {
+    apply(controller, member_function, name, args);
+}
+
+/// An event_handler for events we deliberately ignore.
+void ignore(ui_controller*, const msg::string&, const msg::array&) {}
+
 } // namespace
 
 grid* ui_controller::get_grid(size_t index) {
-    // We don't support ext_multigrid, so index should always be 1.
-    // If it isn't, we don't exaclty fail gracefully.
-    if (index != 1) {
-        std::abort();
-    }
-    
-    return writing;
+    return writing->get(index);
 }
 
 void ui_controller::redraw_event(const msg::object &event_object) {
@@ -160,57 +177,76 @@ void ui_controller::redraw_event(const msg::object &event_object) {
     //  - The remainining elements are an array of argument tuples.
     msg::string name = event->at(0).get<msg::string>();
     msg::array args = event->subarray(1);
-    
-    if (name == "grid_line") {
-        return apply(this, &ui_controller::grid_line, name, args);
-    } else if (name == "grid_resize") {
-        return apply(this, &ui_controller::grid_resize, name, args);
-    } else if (name == "grid_scroll") {
-        return apply(this, &ui_controller::grid_scroll, name, args);
-    } else if (name == "flush") {
-        return apply(this, &ui_controller::flush, name, args);
-    } else if (name == "grid_clear") {
-        return apply(this, &ui_controller::grid_clear, name, args);
-    } else if (name == "hl_attr_define") {
-        return apply(this, &ui_controller::hl_attr_define, name, args);
-    } else if (name == "default_colors_set") {
-        return apply(this, &ui_controller::default_colors_set, name, args);
-    } else if (name == "mode_info_set") {
-        return apply(this, &ui_controller::mode_info_set, name, args);
-    } else if (name == "mode_change") {
-        return apply(this, &ui_controller::mode_change, name, args);
-    } else if (name == "grid_cursor_goto") {
-        return apply(this, &ui_controller::grid_cursor_goto, name, args);
-    } else if (name == "tabline_update") {
-        return apply(this, &ui_controller::tabline_update, name, args);
-    } else if (name == "set_title") {
-        return apply(this, &ui_controller::set_title, name, args);
-    }
 
     // When options change, we should inform the delegate. Neovim tends to
     // send redundant option change events, so only call the delegate if the
     // options actually changed.
-    if (name == "option_set") {
-        std::lock_guard lock(option_lock);
-        ui_options oldopts = ui_opts;
-        apply(this, &ui_controller::set_option, name, args);
-
-        if (ui_opts != oldopts && send_option_change()) {
-            window.options_set();
+    constexpr event_handler option_set = [](ui_controller *controller,
+                                            const msg::string &name,
+                                            const msg::array &args) {
+        std::lock_guard lock(controller->option_lock);
+        ui_options oldopts = controller->ui_opts;
+        apply(controller, &ui_controller::set_option, name, args);
+
+        if (controller->ui_opts != oldopts && controller->send_option_change()) {
+            controller->window.options_set();
         }
-        
-        return;
+    };
+
+    // Neovim 0.5 added a zindex parameter to win_float_pos.
+    constexpr event_handler win_float_pos = [](ui_controller *controller,
+                                               const msg::string &name,
+                                               const msg::array &args) {
+        for (const msg::object &object : args) {
+            apply_one(controller, &ui_controller::win_float_pos, name, object);
+            const msg::array *tuple = object.get_if<msg::array>();
+
+            if (tuple && tuple->size() >= 8 && tuple->at(0).is<msg::integer>() &&
+                                               tuple->at(7).is<msg::integer>()) {
+                grid *grid = controller->get_grid(tuple->at(0).get<msg::integer>());
+                grid->zindex = tuple->at(7).get<msg::integer>().as<int32_t>();
+            }
+        }
+    };
+
+    // Event names are mapped to handlers with a perfect hash, so dispatch
+    // doesn't slow down as events are added.
+    static constexpr auto handlers = make_perfect_hash_map<event_handler>({
+        {"grid_line",          dispatch<&ui_controller::grid_line>},
+        {"grid_resize",        dispatch<&ui_controller::grid_resize>},
+        {"grid_scroll",        dispatch<&ui_controller::grid_scroll>},
+        {"flush",              dispatch<&ui_controller::flush>},
+        {"grid_clear",         dispatch<&ui_controller::grid_clear>},
+        {"hl_attr_define",     dispatch<&ui_controller::hl_attr_define>},
+        {"default_colors_set", dispatch<&ui_controller::default_colors_set>},
+        {"mode_info_set",      dispatch<&ui_controller::mode_info_set>},
+        {"mode_change",        dispatch<&ui_controller::mode_change>},
+        {"grid_cursor_goto",   dispatch<&ui_controller::grid_cursor_goto>},
+        {"tabline_update",     dispatch<&ui_controller::tabline_update>},
+        {"set_title",          dispatch<&ui_controller::set_title>},
+        {"option_set",         option_set},
+        {"win_pos",            dispatch<&ui_controller::win_pos>},
+        {"win_float_pos",      win_float_pos},
+        {"win_hide",           dispatch<&ui_controller::win_hide>},
+        {"win_close",          dispatch<&ui_controller::win_hide>},
+        {"win_external_pos",   dispatch<&ui_controller::win_hide>},
+        {"win_viewport",       dispatch<&ui_controller::win_viewport>},
+        {"msg_set_pos",        dispatch<&ui_controller::msg_set_pos>},
+        {"grid_destroy",       dispatch<&ui_controller::grid_destroy>},
+
+        // The following events are ignored for now.
+        {"mouse_on",           ignore},
+        {"mouse_off",          ignore},
+        {"set_icon",           ignore},
+        {"hl_group_set",       ignore},
+    });
+
+    static_assert(handlers.valid());
+
+    if (event_handler handler = handlers.find(name)) {
+        return handler(this, name, args);
     }
 
-    // The following events are ignored for now.
-    if (name == "mouse_on"     ||
-        name == "mouse_off"    ||
-        name == "set_icon"     ||
-        name == "hl_group_set" ||
-        name == "win_viewport" ) {
-        return;
-    }
-    
     os_log_info(rpc, "Redraw info: Unhandled event - Name=%.*s Args=%s",
                 (int)std::min(name.size(), 128ul), name.data(),
                 msg::to_string(args).c_str());
@@ -222,11 +258,88 @@ void ui_controller::redraw(msg::array events) {
     }
 }
 
+void ui_controller::redraw(msg::reader events) {
+    std::optional<size_t> count = events.read_array();
+
+    if (!count) {
+        return os_log_error(rpc, "Redraw error: Event list type error - Type=%s",
+                            type_string(events).c_str());
+    }
+
+    for (size_t i=0; i<*count; ++i) {
+        if (!redraw_event(events)) {
+            return os_log_error(rpc, "Redraw error: Truncated redraw event");
+        }
+    }
+}
+
+/// Handles the event at the front of events, and advances past it.
+/// @returns False if the event is truncated.
+bool ui_controller::redraw_event(msg::reader &events) {
+    msg::reader event_begin = events;
+    std::optional<size_t> length = events.read_array();
+    std::optional<msg::string> name;
+
+    if (length && *length) {
+        name = events.read_string();
+    }
+
+    if (name && *name == "grid_line") {
+        for (size_t i=1; i<*length; ++i) {
+            msg::reader args = events;
+
+            if (!events.skip()) {
+                return false;
+            }
+
+            grid_line_in_place(args);
+        }
+
+        return true;
+    }
+
+    // Other events are comparatively rare, unpack and handle them as usual.
+    events = event_begin;
+
+    if (!events.skip()) {
+        return false;
+    }
+
+    event_unpacker.feed(event_begin.position(),
+                        events.position() - event_begin.position());
+
+    while (msg::object *event = event_unpacker.unpack()) {
+        redraw_event(*event);
+    }
+
+    return true;
+}
+
+/// Returns the type string of the object at the front of reader.
+/// The object is unpacked, so this should only be used for error reporting.
+std::string ui_controller::type_string(msg::reader reader) {
+    const char *begin = reader.position();
+
+    if (!reader.skip()) {
+        return "(truncated)";
+    }
+
+    std::string type;
+    event_unpacker.feed(begin, reader.position() - begin);
+
+    while (msg::object *object = event_unpacker.unpack()) {
+        type = msg::type_string(*object);
+    }
+
+    return type;
+}
+
 void ui_controller::grid_resize(size_t grid_id, size_t width, size_t height) {
     grid *grid = get_grid(grid_id);
     grid->grid_width = width;
     grid->grid_height = height;
     grid->cells.resize(width * height);
+    grid->mark_dirty();
 }
 
 template<typename ...Ts>
@@ -238,16 +351,15 @@ static bool type_check(const msg::array &array) {
 /// Represents a cell update from the grid_line event.
 struct cell_update {
     msg::string text;
-    const cell_attributes *hlattr;
+    uint16_t hlid;
     size_t repeat;
     
-    cell_update(): hlattr(nullptr), repeat(0) {}
+    cell_update(): hlid(0), repeat(0) {}
 
     /// Set the cell_update from a msg::object.
     /// @param object   An object from the cells array in a grid_line event.
-    /// @param hl_table  The highlight table.
     /// @returns True if object type checked correctly, otherwise false.
-    bool set(const msg::object &object, const highlight_table &hl_table) {
+    bool set(const msg::object &object) {
         if (!object.is<msg::array>()) {
             return false;
         }
@@ -262,14 +374,14 @@ struct cell_update {
         
         if (type_check<msg::string, msg::integer>(array)) {
             text = array[0].get<msg::string>();
-            hlattr = hl_get_entry(hl_table, array[1].get<msg::integer>());
+            hlid = hl_cell_id(array[1].get<msg::integer>());
             repeat = 1;
             return true;
         }
             
         if (type_check<msg::string, msg::integer, msg::integer>(array)) {
             text = array[0].get<msg::string>();
-            hlattr = hl_get_entry(hl_table, array[1].get<msg::integer>());
+            hlid = hl_cell_id(array[1].get<msg::integer>());
             repeat = array[2].get<msg::integer>();
             return true;
         }
@@ -278,6 +390,41 @@ struct cell_update {
     }
 };
 
+/// Writes a cell update to the row position given by line.
+/// @returns False if the update could not be applied, and the rest of the
+///          grid_line event should be dropped.
+bool ui_controller::put_cells(line_cursor &line, msg::string text,
+                              uint16_t hlid, size_t repeat) {
+    if (repeat > line.remaining || !line.remaining) {
+        os_log_error(rpc, "Redraw error: Row overflow - Event=grid_line");
+        return false;
+    }
+
+    // Empty cells are the right cell of a double width char.
+    if (text.size() == 0) {
+        // This should never happen. We'll be defensive about it.
+        if (line.current == line.rowbegin) {
+            return false;
+        }
+
+        nvim::cell *left = line.current - 1;
+        left->flags |= cell_attributes::doublewidth;
+        *line.current = nvim::cell();
+        line.current->hl_id = left->hl_id;
+        line.current->flags = left->flags;
+
+        // Double width chars never repeat.
+        line.current += 1;
+        line.remaining -= 1;
+    } else {
+        block_fill(line.current, nvim::cell(text, hlid), repeat);
+        line.current += repeat;
+        line.remaining -= repeat;
+    }
+
+    return true;
+}
+
 void ui_controller::grid_line(size_t grid_id, size_t row,
                               size_t col, msg::array cells) {
     grid *grid = get_grid(grid_id);
@@ -287,47 +434,124 @@ void ui_controller::grid_line(size_t grid_id, size_t row,
     }
     
     cell *rowbegin = grid->get(row, 0);
-    cell *cell = rowbegin + col;
+    line_cursor line{rowbegin, rowbegin + col, grid->width() - col};
+    grid->mark_dirty(row, row + 1);
     
-    size_t remaining = grid->width() - col;
     cell_update update;
     
     for (const msg::object &object : cells) {
-        if (!update.set(object, hl_table)) {
+        if (!update.set(object)) {
             return os_log_error(rpc, "Redraw error: Cell update type error - "
                                      "Event=grid_line, Type=%s",
                                      msg::type_string(object).c_str());
         }
-        
-        if (update.repeat > remaining) {
-            return os_log_error(rpc, "Redraw error: Row overflow - "
-                                     "Event=grid_line");
+
+        if (!put_cells(line, update.text, update.hlid, update.repeat)) {
+            return;
+        }
+    }
+}
+
+/// Returns the length of the run of cells at the start of data that are
+/// encoded as [0x91, 0xa1, char]. That is, single printable ASCII characters
+/// that continue the previous cell's highlight. Runs are at most max cells.
+static size_t ascii_run(const char *data, size_t size, size_t max) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+    const size_t count = std::min(size / 3, max);
+
+    for (size_t i=0; i<count; ++i, bytes += 3) {
+        if (bytes[0] != 0x91 || bytes[1] != 0xa1 ||
+            bytes[2] < 0x20 || bytes[2] > 0x7e) {
+            return i;
         }
+    }
 
-        // Empty cells are the right cell of a double width char.
-        if (update.text.size() == 0) {
-            // This should never happen. We'll be defensive about it.
-            if (cell == rowbegin) {
-                return;
-            }
-            
-            nvim::cell *left = cell - 1;
-            left->attrs.flags |= cell_attributes::doublewidth;
-            cell->attrs = left->attrs;
-            cell->size = 0;
-
-            // Double width chars never repeat.
-            cell += 1;
-            remaining -= 1;
-        } else {
-            *cell = nvim::cell(update.text, update.hlattr);
+    return count;
+}
 
-            for (int i=1; i<update.repeat; ++i) {
-                cell[i] = *cell;
+/// Handles a grid_line parameter tuple, decoding it in place.
+/// Equivalent to calling grid_line() with the unpacked tuple.
+void ui_controller::grid_line_in_place(msg::reader args) {
+    msg::reader args_begin = args;
+    std::optional<size_t> length = args.read_array();
+    std::optional<msg::integer> grid_id;
+    std::optional<msg::integer> row;
+    std::optional<msg::integer> col;
+    std::optional<size_t> cells;
+
+    if (!length || *length < 4     ||
+        !(grid_id = args.read_integer()) ||
+        !(row = args.read_integer())     ||
+        !(col = args.read_integer())     ||
+        !(cells = args.read_array())) {
+        return os_log_error(rpc, "Redraw error: Argument type error - "
+                                 "Event=grid_line, ArgTypes=%s",
+                                 type_string(args_begin).c_str());
+    }
+
+    grid *grid = get_grid(*grid_id);
+
+    if (*row >= grid->height() || *col >= grid->width()) {
+        return log_grid_out_of_bounds(grid, "grid_line", *row, *col);
+    }
+
+    cell *rowbegin = grid->get(*row, 0);
+    line_cursor line{rowbegin, rowbegin + *col, grid->width() - *col};
+    grid->mark_dirty(*row, *row + 1);
+
+    // Cells without a highlight ID use the previous cell's highlight.
+    uint16_t hlid_current = 0;
+
+    for (size_t i=0; i<*cells; ++i) {
+        // Most cells are ASCII characters in the same highlight as the cell
+        // before them. Runs of them are written as a block, without going
+        // through the general decoder.
+        const char *run = args.position();
+        const size_t run_length = ascii_run(run, args.size(), std::min(*cells - i,
+                                                                       line.remaining));
+
+        if (run_length) {
+            for (size_t j=0; j<run_length; ++j) {
+                line.current[j] = nvim::cell(run[(j * 3) + 2], hlid_current);
             }
 
-            cell += update.repeat;
-            remaining -= update.repeat;
+            line.current += run_length;
+            line.remaining -= run_length;
+            args.advance(run_length * 3);
+            i += run_length - 1;
+            continue;
+        }
+
+        msg::reader cell_begin = args;
+        std::optional<size_t> size = args.read_array();
+        std::optional<msg::string> text;
+        std::optional<msg::integer> hlid = msg::integer(0);
+        std::optional<msg::integer> repeat = msg::integer(1);
+
+        if (size && *size >= 1 && *size <= 3) {
+            text = args.read_string();
+        }
+
+        if (text && *size >= 2) {
+            hlid = args.read_integer();
+        }
+
+        if (text && hlid && *size == 3) {
+            repeat = args.read_integer();
+        }
+
+        if (!text || !hlid || !repeat) {
+            return os_log_error(rpc, "Redraw error: Cell update type error - "
+                                     "Event=grid_line, Type=%s",
+                                     type_string(cell_begin).c_str());
+        }
+
+        if (*size >= 2) {
+            hlid_current = hl_cell_id(*hlid);
+        }
+
+        if (!put_cells(line, *text, hlid_current, *repeat)) {
+            return;
         }
     }
 }
@@ -335,12 +559,8 @@ void ui_controller::grid_line(size_t grid_id, size_t row,
 void ui_controller::grid_clear(size_t grid_id) {
     grid *grid = get_grid(grid_id);
 
-    cell empty;
-    empty.attrs.background = hl_table[0].background;
-
-    for (cell &cell : grid->cells) {
-        cell = empty;
-    }
+    block_fill(grid->cells.data(), nvim::cell(), grid->cells.size());
+    grid->mark_dirty();
 }
 
 void ui_controller::grid_cursor_goto(size_t grid_id, size_t row, size_t col) {
@@ -355,6 +575,7 @@ void ui_controller::grid_cursor_goto(size_t grid_id, size_t row, size_t col) {
     
     grid->cursor_row = row;
     grid->cursor_col = col;
+    writing->cursor_grid_id = grid_id;
 }
 
 void ui_controller::grid_scroll(size_t grid_id, size_t top, size_t bottom,
@@ -375,6 +596,14 @@ void ui_controller::grid_scroll(size_t grid_id, size_t top, size_t bottom,
         return log_grid_out_of_bounds(grid, "grid_scroll", bottom, right);
     }
     
+    // Scrolls of whole rows move the rows' ticks rather than marking them as
+    // written, so clients can move what they've already drawn.
+    if (left == 0 && right == grid->width()) {
+        grid->scroll_rows(top, bottom, rows);
+    } else {
+        grid->mark_dirty(top, bottom);
+    }
+
     long count;
     long row_width;
     cell *dest;
@@ -399,17 +628,282 @@ void ui_controller::grid_scroll(size_t grid_id, size_t top, size_t bottom,
     }
 }
 
+void grid::scroll_rows(size_t top, size_t bottom, long rows) {
+    std::fill(dirty_rows.begin() + top, dirty_rows.begin() + bottom, true);
+
+    // The rows scrolled into view are undefined until Neovim redraws them,
+    // so they're treated as written.
+    auto begin = row_ticks.begin() + top;
+    auto end = row_ticks.begin() + bottom;
+    size_t count = std::min<size_t>(rows >= 0 ? rows : -rows, bottom - top);
+
+    if (rows >= 0) {
+        std::rotate(begin, begin + count, end);
+        std::fill(end - count, end, draw_tick + 1);
+    } else {
+        std::rotate(begin, end - count, end);
+        std::fill(begin, begin + count, draw_tick + 1);
+    }
+
+    if (scroll_log.size() == scroll_log_capacity) {
+        scroll_history_tick = scroll_log.front().tick;
+        scroll_log.erase(scroll_log.begin());
+    }
+
+    scroll_log.push_back(grid_scroll_record{
+        draw_tick + 1, (int32_t)top, (int32_t)bottom, (int32_t)rows
+    });
+}
+
+void grid::mark_stale(const grid &completed) {
+    if (dirty_rows.size() != completed.dirty_rows.size()) {
+        dirty_rows.assign(completed.dirty_rows.size(), true);
+        return;
+    }
+
+    for (size_t row=0; row<dirty_rows.size(); ++row) {
+        if (completed.dirty_rows[row]) {
+            dirty_rows[row] = true;
+        }
+    }
+}
+
+void grid::update(const grid &completed) {
+    // The client may already be drawing the completed grid, and memoizing
+    // glyphs in its cells, so cells are copied with cell::copy_contents.
+    if (grid_width != completed.grid_width ||
+        grid_height != completed.grid_height) {
+        grid_width = completed.grid_width;
+        grid_height = completed.grid_height;
+        cells.resize(completed.cells.size());
+        row_ticks.resize(grid_height);
+        dirty_rows.assign(grid_height, true);
+    }
+
+    cursor_row = completed.cursor_row;
+    cursor_col = completed.cursor_col;
+    draw_tick = completed.draw_tick;
+    grid_id = completed.grid_id;
+    anchor_grid = completed.anchor_grid;
+    anchor_row = completed.anchor_row;
+    anchor_col = completed.anchor_col;
+    anchor = completed.anchor;
+    hidden = completed.hidden;
+    zindex = completed.zindex;
+    grid_origin = completed.grid_origin;
+    window_viewport = completed.window_viewport;
+    scroll_log = completed.scroll_log;
+    scroll_history_tick = completed.scroll_history_tick;
+
+    for (size_t row=0; row<grid_height; ++row) {
+        if (dirty_rows[row]) {
+            const cell *src = completed.get(row, 0);
+            cell *dest = get(row, 0);
+
+            for (size_t col=0; col<grid_width; ++col) {
+                dest[col].copy_contents(src[col]);
+            }
+
+            row_ticks[row] = completed.row_ticks[row];
+            dirty_rows[row] = false;
+        }
+    }
+}
+
+grid* grid_set::get(size_t id) {
+    auto [iter, inserted] = grids.try_emplace(id);
+
+    if (inserted) {
+        iter->second.grid_id = id;
+        iter->second.draw_tick = draw_tick;
+    }
+
+    return &iter->second;
+}
+
+void grid_set::layout() {
+    draw_order.clear();
+
+    // Floats may be anchored to other floats, so resolve anchors recursively.
+    // Neovim doesn't create anchor cycles, but we limit the depth regardless.
+    auto resolve = [&](auto &resolve, grid &grid, int depth) -> grid_point {
+        if (grid.anchor < grid_anchor::float_nw || grid.anchor > grid_anchor::float_se) {
+            return grid.grid_origin;
+        }
+
+        grid_point anchor_origin = {0, 0};
+        auto iter = grids.find(grid.anchor_grid);
+
+        if (iter != grids.end() && &iter->second != &grid && depth < 8) {
+            anchor_origin = resolve(resolve, iter->second, depth + 1);
+        }
+
+        int32_t row = anchor_origin.row + (int32_t)std::floor(grid.anchor_row);
+        int32_t col = anchor_origin.column + (int32_t)std::floor(grid.anchor_col);
+
+        if (grid.anchor == grid_anchor::float_sw || grid.anchor == grid_anchor::float_se) {
+            row -= (int32_t)grid.grid_height;
+        }
+
+        if (grid.anchor == grid_anchor::float_ne || grid.anchor == grid_anchor::float_se) {
+            col -= (int32_t)grid.grid_width;
+        }
+
+        grid.grid_origin = grid_point{std::max(row, 0), std::max(col, 0)};
+        return grid.grid_origin;
+    };
+
+    for (auto &[id, grid] : grids) {
+        if (grid.anchor != grid_anchor::none && !grid.hidden) {
+            resolve(resolve, grid, 0);
+            draw_order.push_back(&grid);
+        }
+    }
+
+    // The global grid is drawn first, then windows, floats, and the message
+    // grid, by zindex. Grid IDs break ties, so the order is stable.
+    std::sort(draw_order.begin(), draw_order.end(), [](const grid *left,
+                                                       const grid *right) {
+        bool left_global = left->anchor == grid_anchor::global;
+        bool right_global = right->anchor == grid_anchor::global;
+
+        if (left_global != right_global) {
+            return left_global;
+        }
+
+        if (left->zindex != right->zindex) {
+            return left->zindex < right->zindex;
+        }
+
+        return left->grid_id < right->grid_id;
+    });
+}
+
+void grid_set::mark_stale(const grid_set &completed) {
+    for (auto &[id, grid] : grids) {
+        if (const nvim::grid *other = completed.find(id)) {
+            grid.mark_stale(*other);
+        }
+    }
+}
+
+void grid_set::update(const grid_set &completed) {
+    for (auto iter = grids.begin(); iter != grids.end();) {
+        if (completed.grids.count(iter->first)) {
+            ++iter;
+        } else {
+            iter = grids.erase(iter);
+        }
+    }
+
+    for (const auto &[id, grid] : completed.grids) {
+        get(id)->update(grid);
+    }
+
+    update_palette(completed.palette, completed.palette_stamps,
+                   completed.palette_version, completed.palette_gen);
+
+    cursor_attrs = completed.cursor_attrs;
+    cursor_grid_id = completed.cursor_grid_id;
+    draw_tick = completed.draw_tick;
+
+    draw_order.clear();
+
+    for (const grid *grid : completed.draw_order) {
+        draw_order.push_back(&grids.at(grid->grid_id));
+    }
+}
+
+void grid_set::update_palette(const std::vector<cell_attributes> &table,
+                              const std::vector<uint64_t> &stamps,
+                              uint64_t version, uint64_t generation) {
+    if (palette_version == version) {
+        return;
+    }
+
+    // Highlight tables never shrink, entries past our old size are new.
+    const size_t old_size = palette.size();
+    palette.resize(table.size());
+    palette_stamps.resize(table.size());
+
+    for (size_t i=0; i<table.size(); ++i) {
+        if (i >= old_size || stamps[i] > palette_version) {
+            palette[i] = table[i];
+            palette_stamps[i] = stamps[i];
+        }
+    }
+
+    palette_version = version;
+    palette_gen = generation;
+}
+
+const grid* grid_set::grid_at(grid_point point) const {
+    for (size_t i=draw_order.size(); i; --i) {
+        if (draw_order[i - 1]->contains(point)) {
+            return draw_order[i - 1];
+        }
+    }
+
+    return global_grid();
+}
+
+const grid* grid_set::cursor_grid() const {
+    const grid *grid = find(cursor_grid_id);
+
+    if (!grid || !grid->cells_size()) {
+        return global_grid();
+    }
+
+    return grid;
+}
+
+nvim::cursor grid_set::cursor() const {
+    const grid *grid = cursor_grid();
+    size_t row = std::min(grid->cursor_row, grid->grid_height - 1);
+    size_t col = std::min(grid->cursor_col, grid->grid_width - 1);
+    const cell *cell = grid->get(row, col);
+    return nvim::cursor(row, col, cell, attributes(*cell), cursor_attrs);
+}
+
 void ui_controller::flush() {
-    grid *completed = writing;
+    grid_set *completed = writing;
     completed->draw_tick += 1;
-    
+
+    const uint64_t tick = completed->draw_tick;
+    os_signpost_interval_begin(latency, tick, "Flush", "tick=%llu", tick);
+
+    // Cells are drawn with the highlight table as of this flush.
+    completed->update_palette(hl_table, hl_stamps, hl_version, hl_generation);
+
+    // Modified rows were given this flush's tick when they were written.
+    for (auto &[id, grid] : completed->grids) {
+        grid.draw_tick = completed->draw_tick;
+    }
+
+    completed->layout();
+
+    // The rows modified this frame are now stale in every other grid. Only the
+    // writer touches dirty_rows, so this is safe while the client is drawing.
+    for (grid_set &set : triple_buffered) {
+        if (&set != completed) {
+            set.mark_stale(*completed);
+        }
+    }
+
+    for (auto &[id, grid] : completed->grids) {
+        grid.dirty_rows.assign(grid.grid_height, false);
+    }
+
     writing = complete.exchange(completed);
-    *writing = *completed;
+    writing->update(*completed);
+
+    tracker->flushed(tick);
+    os_signpost_interval_end(latency, tick, "Flush");
 
     if (signal_flush) {
         dispatch_semaphore_signal(signal_flush);
         signal_flush = nullptr;
-    } else {
+    } else if (scheduler.flushed()) {
         window.redraw();
     }
 }
@@ -441,10 +935,84 @@ void ui_controller::default_colors_set(uint32_t fg, uint32_t bg, uint32_t sp) {
     for (cell_attributes &attrs : hl_table) {
         adjust_defaults(def, attrs);
     }
-    
-    for (cell &cell : writing->cells) {
-        adjust_defaults(def, cell.attrs);
+
+    // Cells refer to highlights by ID, so they don't need to be touched.
+    // The new palette generation tells renderers to redraw with the new
+    // colors, without any rows being copied between grid sets.
+    hl_version += 1;
+    hl_generation += 1;
+    std::fill(hl_stamps.begin(), hl_stamps.end(), hl_version);
+}
+
+void ui_controller::win_pos(size_t grid_id, msg::extension win,
+                            size_t row, size_t col,
+                            size_t width, size_t height) {
+    grid *grid = get_grid(grid_id);
+    grid->anchor = grid_anchor::window;
+    grid->grid_origin = grid_point{(int32_t)row, (int32_t)col};
+    grid->zindex = 0;
+    grid->hidden = false;
+}
+
+void ui_controller::win_float_pos(size_t grid_id, msg::extension win,
+                                  msg::string anchor, size_t anchor_grid,
+                                  double anchor_row, double anchor_col,
+                                  bool focusable) {
+    grid_anchor float_anchor;
+
+    if (anchor == "NW") {
+        float_anchor = grid_anchor::float_nw;
+    } else if (anchor == "NE") {
+        float_anchor = grid_anchor::float_ne;
+    } else if (anchor == "SW") {
+        float_anchor = grid_anchor::float_sw;
+    } else if (anchor == "SE") {
+        float_anchor = grid_anchor::float_se;
+    } else {
+        return os_log_error(rpc, "Redraw error: Unknown float anchor - "
+                                 "Event=win_float_pos, Anchor=%.*s",
+                                 (int)std::min(anchor.size(), 8ul), anchor.data());
+    }
+
+    grid *grid = get_grid(grid_id);
+    grid->anchor = float_anchor;
+    grid->anchor_grid = anchor_grid;
+    grid->anchor_row = anchor_row;
+    grid->anchor_col = anchor_col;
+    grid->zindex = 50;
+    grid->hidden = false;
+}
+
+void ui_controller::win_hide(size_t grid_id) {
+    if (grid_id != 1) {
+        get_grid(grid_id)->hidden = true;
+    }
+}
+
+void ui_controller::win_viewport(size_t grid_id, msg::extension win,
+                                 size_t topline, size_t botline,
+                                 size_t curline, size_t curcol) {
+    get_grid(grid_id)->window_viewport = grid_viewport{
+        topline, botline, curline, curcol
+    };
+}
+
+void ui_controller::msg_set_pos(size_t grid_id, size_t row, bool scrolled,
+                                msg::string sep_char) {
+    grid *grid = get_grid(grid_id);
+    grid->anchor = grid_anchor::message;
+    grid->grid_origin = grid_point{(int32_t)row, 0};
+    grid->zindex = 200;
+    grid->hidden = false;
+}
+
+void ui_controller::grid_destroy(size_t grid_id) {
+    if (grid_id == 1) {
+        return os_log_error(rpc, "Redraw error: Attempted to destroy the "
+                                 "global grid - Event=grid_destroy");
     }
+
+    writing->grids.erase(grid_id);
 }
 
 static inline void set_rgb_color(rgb_color &color, const msg::object &object) {
@@ -459,7 +1027,16 @@ static inline void set_rgb_color(rgb_color &color, const msg::object &object) {
 }
 
 void ui_controller::hl_attr_define(size_t hlid, msg::map definition) {
+    // Redefining a highlight changes the colors of cells already drawn with
+    // it. New highlights only grow the table.
+    if (hlid < hl_table.size()) {
+        hl_generation += 1;
+    }
+
     cell_attributes *attrs = hl_new_entry(hl_table, hlid);
+    hl_version += 1;
+    hl_stamps.resize(hl_table.size());
+    hl_stamps[hlid] = hl_version;
     
     for (const auto& [key, value] : definition) {
         if (!key.is<msg::string>()) {
@@ -803,31 +1380,10 @@ static std::optional<tabpage_data> to_tabpage_data(msg::object object) {
     return data;
 }
 
-static tabpage* get_tabpage(std::unordered_map<int, tabpage> &tabpage_map,
-                            msg::extension handle_object) {
-    auto handle = to_tabpage_handle(handle_object);
-
-    if (!handle) {
-        return nullptr;
-    }
-
-    auto iter = tabpage_map.find(*handle);
-
-    if (iter == tabpage_map.end()) {
-        return nullptr;
-    }
-
-    return &(iter->second);
-}
-
 void ui_controller::tabline_update(msg::extension selected, msg::array tabs) {
-    size_t previous_tabs_count = tabpages.size();
-    auto previous_tabpage_selected = tabpage_selected;
-    bool have_changes = false;
-
-    for (auto &kv : tabpage_map) {
-        kv.second.closed = true;
-    }
+    tabline &next = tabline_snapshots.writing();
+    next.tabs.clear();
+    next.tabs.reserve(tabs.size());
 
     for (const msg::object &object : tabs) {
         auto tab_data = to_tabpage_data(object);
@@ -839,48 +1395,42 @@ void ui_controller::tabline_update(msg::extension selected, msg::array tabs) {
             continue;
         }
 
-        tabpage &tab = tabpage_map[tab_data->handle];
+        tabpage &tab = next.tabs.emplace_back();
         tab.handle = tab_data->handle;
-        tab.closed = false;
-
-        if (tab.name != tab_data->name) {
-            tab.name = tab_data->name;
-            tab.name_changed = true;
-            have_changes = true;
-        }
-
-        if (tab.filetype != tab_data->filetype) {
-            tab.filetype = tab_data->filetype;
-            tab.filetype_changed = true;
-            have_changes = true;
-        }
-
-        tabpages.push_back(&tab);
+        tab.name = tab_data->name;
+        tab.filetype = tab_data->filetype;
     }
 
-    if (tabpages.size() == previous_tabs_count) {
+    if (next.tabs.empty()) {
         return os_log_error(rpc, "Redraw error: Empty tapages array - "
                                  "Event=tabline_update");
     }
 
-    tabpage_selected = get_tabpage(tabpage_map, selected);
+    auto handle = to_tabpage_handle(selected);
+    auto iter = next.tabs.end();
+
+    if (handle) {
+        iter = std::find_if(next.tabs.begin(), next.tabs.end(),
+                            [&](const tabpage &tab) {
+            return tab.handle == *handle;
+        });
+    }
 
-    if (!tabpage_selected) {
+    if (iter == next.tabs.end()) {
         return os_log_error(rpc, "Redraw error: Missing selected tabpage - "
                                  "Event=tabline_update");
     }
 
-    auto begin = tabpages.begin();
-    auto previous_end = begin + previous_tabs_count;
-    auto end = tabpages.end();
+    next.selected = iter - next.tabs.begin();
 
-    if (!have_changes && previous_tabpage_selected == tabpage_selected &&
-        std::equal(begin, previous_end, previous_end, end)) {
-        tabpages.erase(previous_end, end);
-    } else {
-        tabpages.erase(begin, previous_end);
-        window.tabline_update();
+    if (next.selected == tabline_current.selected &&
+        next.tabs == tabline_current.tabs) {
+        return;
     }
+
+    tabline_current = next;
+    tabline_snapshots.publish();
+    window.tabline_update();
 }
 
 static int hex_char_to_decimal(char value) {
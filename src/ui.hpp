@@ -11,12 +11,19 @@
 #define UI_HPP
 
 #include <dispatch/dispatch.h>
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "grapheme_table.hpp"
+#include "latency_tracker.hpp"
 #include "msgpack.hpp"
+#include "redraw_scheduler.hpp"
+#include "triple_buffer.hpp"
 #include "unfair_lock.hpp"
 
 namespace nvim {
@@ -131,6 +138,16 @@ struct cursor_attributes {
     uint16_t blinkoff;
 };
 
+/// Cell attributes that affect font rendering.
+enum class font_attributes {
+    none,
+    bold,
+    italic,
+    bold_italic
+};
+
+/// Highlight attributes. Neovim defines highlight attributes in a table, and
+/// cells refer to them by their index. See hl_attr_define.
 struct cell_attributes {
     enum flag : uint16_t {
         bold          = 1 << 0,
@@ -147,135 +164,136 @@ struct cell_attributes {
     rgb_color foreground;
     rgb_color special;
     uint16_t flags;
-};
 
-/// Cell attributes that affect font rendering.
-enum class font_attributes {
-    none,
-    bold,
-    italic,
-    bold_italic
-};
+    /// Returns the font attributes.
+    enum font_attributes font_attributes() const {
+        static constexpr uint16_t mask = bold | italic;
+        return static_cast<enum font_attributes>(flags & mask);
+    }
+
+    /// True if the attributes include an underline, undercurl, or
+    /// strikethrough.
+    bool has_line_emphasis() const {
+        return flags & (underline | undercurl | strikethrough);
+    }
+
+    /// True if the attributes include an underline, false otherwise.
+    bool has_underline() const {
+        return flags & underline;
+    }
 
-/// A sequence of Unicode code points that represent a single grapheme.
-/// Holds up to six (maxcombine in Neovim) UTF-8 encoded code points.
-using grapheme_cluster = std::array<char, 24>;
+    /// True if the attributes include an undercurl, false otherwise.
+    bool has_undercurl() const {
+        return flags & undercurl;
+    }
+
+    /// True if the attributes include a strikethrough, false otherwise.
+    bool has_strikethrough() const {
+        return flags & strikethrough;
+    }
+};
 
 /// A grid cell.
-/// A cell consists of a grapheme and various attributes that control their
-/// appearance.
+/// A cell consists of a grapheme and the ID of its highlight attributes.
+///
+/// Cells are kept small, 16 bytes, so grids are cheap to copy and scroll, and
+/// walking a row touches as little memory as possible. Graphemes are stored
+/// as grapheme_ids, and colors and font attributes are resolved from the grid
+/// set's highlight palette when cells are drawn, see grid_set::attributes().
 class cell {
 private:
-    grapheme_cluster text;
-    uint16_t size;
-    cell_attributes attrs;
+    grapheme_id text;
+    uint16_t hl_id;
+    uint16_t flags;
+
+    // A memoized glyph cache lookup, see glyph_manager::get(). Renderers
+    // memoize lookups through const grids, so these members are mutable. A
+    // generation of zero means nothing is memoized.
+    mutable uint32_t glyph_slot;
+    mutable uint32_t glyph_generation;
 
     friend class ui_controller;
 
 public:
-    /// Zero initialized cell.
-    cell(): text{}, size{}, attrs{} {}
+    /// Zero initialized cell, an empty cell with the default highlight.
+    cell(): text(), hl_id(0), flags(0), glyph_slot(0), glyph_generation(0) {}
 
-    /// Constructs a cell with the given text and attributes.
+    /// Constructs a cell with the given text and highlight.
     ///
     /// @param cell_text    UTF-8 encoded text representing a single grapheme.
-    /// @param cell_attrs   The new cell's attributes.
+    /// @param hlid         The ID of the cell's highlight attributes.
     ///
-    /// Note: Text is stored in a grapheme_cluster and is trimmed if needed.
-    cell(msg::string cell_text, const cell_attributes *cell_attrs) {
-        text = {};
-        attrs = *cell_attrs;
-
-        if (cell_text.size() == 1 && *cell_text.data() == ' ') {
-            size = 0;
-        } else {
-            size = std::min(cell_text.size(), sizeof(grapheme_cluster));
-
-            for (size_t i=0; i<size; ++i) {
-                text[i] = cell_text[i];
-            }
+    /// Note: Text longer than a grapheme_cluster is trimmed.
+    cell(msg::string cell_text, uint16_t hlid):
+        hl_id(hlid), flags(0), glyph_slot(0), glyph_generation(0) {
+        if (!(cell_text.size() == 1 && *cell_text.data() == ' ')) {
+            text = grapheme_id(cell_text, grapheme_table::shared());
         }
     }
 
+    /// Constructs a cell containing a single ASCII character.
+    /// Equivalent to cell(msg::string(&ascii, 1), hlid).
+    cell(char ascii, uint16_t hlid):
+        text(ascii == ' ' ? grapheme_id() : grapheme_id(ascii)),
+        hl_id(hlid), flags(0), glyph_slot(0), glyph_generation(0) {}
+
     /// The cell's grapheme as a grapheme_cluster.
     grapheme_cluster grapheme() const {
-        return text;
+        return text.cluster(grapheme_table::shared());
     }
 
     /// The cell's grapheme as a std::string_view.
+    /// Note: The view may point into the cell.
     std::string_view grapheme_view() const {
-        return std::string_view(text.data(), size);
+        return text.view(grapheme_table::shared());
     }
 
     /// True if the cell is empty, false otherwise.
     /// A cell is considered empty if it is entirely white space, or if it does
     /// not have an associated grapheme.
     bool empty() const {
-        return size == 0;
-    }
-
-    /// Returns the cell's foreground color.
-    rgb_color foreground() const {
-        return attrs.foreground;
-    }
-
-    /// Returns the cell's background color.
-    rgb_color background() const {
-        return attrs.background;
-    }
-
-    /// Returns the cell's special (underline, undercurl, strikethrough) color.
-    rgb_color special() const {
-        return attrs.special;
+        return text.empty();
     }
 
-    /// Returns the cell's font attributes.
-    font_attributes font_attributes() const {
-        static constexpr uint16_t mask = cell_attributes::bold |
-                                         cell_attributes::italic;
-
-        return static_cast<enum font_attributes>(attrs.flags & mask);
+    /// The ID of the cell's highlight attributes.
+    uint16_t highlight() const {
+        return hl_id;
     }
 
-    /// True if the cell has an underline, undercurl, or strikethrough.
-    bool has_line_emphasis() const {
-        return attrs.flags & (cell_attributes::underline |
-                              cell_attributes::undercurl |
-                              cell_attributes::strikethrough);
+    /// Returns 1 for single width characters, 2 for full width characters.
+    uint32_t width() const {
+        return (bool)(flags & cell_attributes::doublewidth) + 1;
     }
 
-    /// True if the cell is underlined, false otherwise.
-    bool has_underline() const {
-        return attrs.flags & cell_attributes::underline;
+    /// Copies the text and attributes of other, and clears the glyph memo.
+    /// Unlike assignment, this does not read other's glyph memo, which may be
+    /// concurrently written to by a renderer.
+    void copy_contents(const cell &other) {
+        text = other.text;
+        hl_id = other.hl_id;
+        flags = other.flags;
+        glyph_generation = 0;
     }
 
-    /// True if the cell has an undercurl, false otherwise.
-    bool has_undercurl() const {
-        return attrs.flags & cell_attributes::undercurl;
+    /// Memoizes a glyph cache lookup.
+    void memoize_glyph(uint32_t slot, uint32_t generation) const {
+        glyph_slot = slot;
+        glyph_generation = generation;
     }
 
-    /// True if the cell has been stroke through, false otherwise.
-    bool has_strikethrough() const {
-        return attrs.flags & cell_attributes::strikethrough;
+    /// True if a glyph cache lookup was memoized in the given generation.
+    bool has_memoized_glyph(uint32_t generation) const {
+        return glyph_generation == generation;
     }
 
-    /// Returns 1 for single width characters, 2 for full width characters.
-    uint32_t width() const {
-        return (bool)(attrs.flags & cell_attributes::doublewidth) + 1;
-    }
-
-    /// Returns a newly constructed cell with the given color attributes.
-    cell recolored(rgb_color foreground,
-                   rgb_color background,
-                   rgb_color special) const {
-        nvim::cell ret = *this;
-        ret.attrs.foreground = foreground;
-        ret.attrs.background = background;
-        ret.attrs.special = special;
-        return ret;
+    /// Returns the memoized glyph cache slot.
+    uint32_t memoized_glyph() const {
+        return glyph_slot;
     }
 };
 
+static_assert(sizeof(cell) == 16);
+
 struct grid_size {
     int32_t width;
     int32_t height;
@@ -304,9 +322,10 @@ inline bool operator!=(const grid_point &left, const grid_point &right) {
 
 /// A grid's cursor.
 ///
-/// Every grid has an associated cursor. A cursor consists of a grid position,
-/// an underlying cell, and various cursor attributes. Attributes control the
-/// appearance and behavior of the cursor.
+/// Every grid set has an associated cursor, positioned in one of its grids.
+/// A cursor consists of a grid position, an underlying cell, and various
+/// cursor attributes. Attributes control the appearance and behavior of the
+/// cursor.
 class cursor {
 private:
     cursor_attributes attrs_;
@@ -321,28 +340,30 @@ public:
     cursor(): attrs_(), row_(0), col_(0), ptr_(nullptr) {}
 
     /// Construct a new cursor object.
-    /// @param row      The row position of the cursor.
-    /// @param col      The column position of the cursor.
-    /// @param ptr      A pointer to the cursor's underlying cell.
-    /// @param attrs    The cursor's attributes.
-    cursor(size_t row, size_t col, const cell *ptr, cursor_attributes attrs):
+    /// @param row          The row position of the cursor.
+    /// @param col          The column position of the cursor.
+    /// @param ptr          A pointer to the cursor's underlying cell.
+    /// @param cell_attrs   The highlight attributes of the underlying cell.
+    /// @param attrs        The cursor's attributes.
+    cursor(size_t row, size_t col, const nvim::cell *ptr,
+           const cell_attributes &cell_attrs, cursor_attributes attrs):
         attrs_(attrs), row_(row), col_(col), ptr_(ptr) {
         if (attrs_.special.is_default()) {
-            attrs_.special = ptr->special();
+            attrs_.special = cell_attrs.special;
         }
 
         if (attrs_.background.is_default()) {
             if (attrs_.foreground.is_default()) {
-                attrs_.background = ptr->foreground();
-                attrs_.foreground = ptr->background();
+                attrs_.background = cell_attrs.foreground;
+                attrs_.foreground = cell_attrs.background;
                 return;
             }
 
-            attrs_.background = ptr->background();
+            attrs_.background = cell_attrs.background;
         }
 
         if (attrs_.foreground.is_default()) {
-            attrs_.foreground = ptr->foreground();
+            attrs_.foreground = cell_attrs.foreground;
         }
     }
 
@@ -429,24 +450,113 @@ public:
     }
 };
 
+/// How a grid is positioned in the global grid. See ext_multigrid.
+enum class grid_anchor : uint8_t {
+    none,       ///< Not positioned, the grid is hidden.
+    global,     ///< The global grid, which covers the whole UI.
+    window,     ///< A window at a fixed position, see win_pos.
+    float_nw,   ///< A float whose top left corner is at the anchor point.
+    float_ne,   ///< A float whose top right corner is at the anchor point.
+    float_sw,   ///< A float whose bottom left corner is at the anchor point.
+    float_se,   ///< A float whose bottom right corner is at the anchor point.
+    message     ///< The message grid, see msg_set_pos.
+};
+
+/// A window's viewport. See the win_viewport event.
+struct grid_viewport {
+    size_t topline;
+    size_t botline;
+    size_t curline;
+    size_t curcol;
+};
+
+/// A grid_scroll of whole rows, see grid::scrolls().
+struct grid_scroll_record {
+    uint64_t tick;  ///< The draw tick of the flush that included the scroll.
+    int32_t top;    ///< The first row of the scrolled region.
+    int32_t bottom; ///< One past the last row of the scrolled region.
+    int32_t rows;   ///< The number of rows scrolled, as in grid_scroll.
+};
+
 /// A grid of cells.
 ///
 /// Grid's are conceptually a 2d array of cells. They are created and updated
 /// by a ui_controller in response to redraw events.
+///
+/// Without ext_multigrid, there is only the global grid. Otherwise every
+/// Neovim window has its own grid, which is drawn over the global grid at the
+/// window's position.
 class grid {
 private:
     std::vector<cell> cells;
     size_t grid_width;
     size_t grid_height;
-    cursor_attributes cursor_attrs;
     size_t cursor_row;
     size_t cursor_col;
     uint64_t draw_tick;
 
+    // Layout state. Floating windows are positioned relative to another grid,
+    // so the final position, grid_origin, is resolved on every flush.
+    size_t grid_id;
+    size_t anchor_grid;
+    double anchor_row;
+    double anchor_col;
+    grid_anchor anchor;
+    bool hidden;
+    int32_t zindex;
+    grid_point grid_origin;
+    grid_viewport window_viewport;
+
+    // One bit per row. While a grid is the writing grid, a set bit means the
+    // row was modified during the current frame. Otherwise, a set bit means the
+    // row is stale, it was modified since this grid was last the writing grid.
+    std::vector<bool> dirty_rows;
+
+    // The draw tick of the flush that last wrote each row's contents. Rows
+    // moved by a full width grid_scroll take their tick with them.
+    std::vector<uint64_t> row_ticks;
+
+    // Recent full width scrolls, oldest first. The log is bounded, scrolls
+    // after scroll_history_tick are always present.
+    std::vector<grid_scroll_record> scroll_log;
+    uint64_t scroll_history_tick;
+
+    static constexpr size_t scroll_log_capacity = 32;
+
     friend class ui_controller;
+    friend class grid_set;
+
+    /// Marks the rows in the range [begin, end) as written in the current
+    /// frame. Their row ticks are set to the tick of the next flush.
+    void mark_dirty(size_t begin, size_t end) {
+        std::fill(dirty_rows.begin() + begin, dirty_rows.begin() + end, true);
+        std::fill(row_ticks.begin() + begin, row_ticks.begin() + end, draw_tick + 1);
+    }
+
+    /// Marks every row as written in the current frame.
+    void mark_dirty() {
+        dirty_rows.assign(grid_height, true);
+        row_ticks.assign(grid_height, draw_tick + 1);
+    }
+
+    /// Moves the row ticks in the region [top, bottom) along with a scroll
+    /// of whole rows, and records the scroll in the scroll log.
+    void scroll_rows(size_t top, size_t bottom, long rows);
+
+    /// Marks the rows modified in the completed grid as stale in this grid.
+    void mark_stale(const grid &completed);
+
+    /// Brings this grid up to date with the completed grid.
+    /// Only stale rows are copied, unless the grid sizes differ, in which case
+    /// the entire grid is copied. Clears the dirty bitmap.
+    void update(const grid &completed);
 
 public:
-    grid(): grid_width(0), grid_height(0), draw_tick(0) {}
+    grid(): grid_width(0), grid_height(0), cursor_row(0), cursor_col(0),
+            draw_tick(0), grid_id(0), anchor_grid(1), anchor_row(0),
+            anchor_col(0), anchor(grid_anchor::none), hidden(false),
+            zindex(0), grid_origin{0, 0}, window_viewport{},
+            scroll_history_tick(0) {}
 
     const cell* begin() const {
         return cells.data();
@@ -466,14 +576,6 @@ public:
         return cells.data() + (row * grid_width) + col;
     }
 
-    /// Returns the grid's cursor.
-    nvim::cursor cursor() const {
-        return nvim::cursor(cursor_row,
-                            cursor_col,
-                            get(cursor_row, cursor_col),
-                            cursor_attrs);
-    }
-
     /// Returns the grid's width.
     size_t width() const {
         return grid_width;
@@ -484,6 +586,36 @@ public:
         return grid_height;
     }
 
+    /// Returns the grid's draw tick. The draw tick is incremented by one on
+    /// every flush, and is zero for grids that have never been flushed.
+    uint64_t tick() const {
+        return draw_tick;
+    }
+
+    /// Returns the draw tick of the flush that last wrote the given row.
+    /// A row is unchanged between two grids if its tick is not greater than
+    /// the older grid's tick(), and no scrolls() happened in between.
+    ///
+    /// Rows moved by a full width grid_scroll keep their tick. A client that
+    /// applies the moves in scrolls() to what it drew of an older grid only
+    /// needs to redraw the rows with a greater tick.
+    uint64_t row_tick(size_t row) const {
+        return row_ticks[row];
+    }
+
+    /// The full width scrolls of recent flushes, oldest first.
+    msg::array_view<const grid_scroll_record> scrolls() const {
+        return msg::array_view<const grid_scroll_record>(scroll_log.data(),
+                                                         scroll_log.size());
+    }
+
+    /// Every scroll in a flush with a tick greater than this tick is present
+    /// in scrolls(). Clients that last drew an older grid should redraw it
+    /// in full.
+    uint64_t scroll_history() const {
+        return scroll_history_tick;
+    }
+
     /// Returns The grid's size.
     nvim::grid_size size() const {
         return nvim::grid_size{(int32_t)grid_width, (int32_t)grid_height};
@@ -493,6 +625,146 @@ public:
     size_t cells_size() const {
         return cells.size();
     }
+
+    /// Returns Neovim's handle for this grid. The global grid's ID is 1.
+    size_t id() const {
+        return grid_id;
+    }
+
+    /// The position of the grid's top left cell in the global grid.
+    grid_point origin() const {
+        return grid_origin;
+    }
+
+    /// The viewport of the window displayed in this grid.
+    /// Note: Only meaningful for window grids.
+    grid_viewport viewport() const {
+        return window_viewport;
+    }
+
+    /// True if the global grid position point is in this grid.
+    bool contains(grid_point point) const {
+        int32_t row = point.row - grid_origin.row;
+        int32_t col = point.column - grid_origin.column;
+        return row >= 0 && row < (int32_t)grid_height &&
+               col >= 0 && col < (int32_t)grid_width;
+    }
+};
+
+/// The set of grids that make up the UI.
+///
+/// Grid sets are multi buffered as a whole, so the grids and their positions
+/// are always consistent with each other. Each grid tracks its own modified
+/// rows, so a flush only costs as much as the grids that actually changed.
+class grid_set {
+private:
+    std::unordered_map<size_t, grid> grids;
+    std::vector<const grid*> draw_order;
+    std::vector<cell_attributes> palette;
+    std::vector<uint64_t> palette_stamps;
+    uint64_t palette_version;
+    uint64_t palette_gen;
+    cursor_attributes cursor_attrs;
+    size_t cursor_grid_id;
+    uint64_t draw_tick;
+
+    friend class ui_controller;
+
+    /// Returns the grid with the given ID, creating it if necessary.
+    grid* get(size_t id);
+
+    /// Resolves grid positions and sorts visible grids into draw order.
+    void layout();
+
+    /// Marks the rows modified in the completed set as stale in this set.
+    void mark_stale(const grid_set &completed);
+
+    /// Brings this set up to date with the completed set. Grids are copied
+    /// with grid::update, grids missing from the completed set are removed.
+    void update(const grid_set &completed);
+
+    /// Brings the palette up to date with a highlight table.
+    ///
+    /// Each entry is stamped with the version it was last modified in, so
+    /// only entries added or modified since this set's palette version are
+    /// copied. Generation changes when existing entries are modified.
+    void update_palette(const std::vector<cell_attributes> &table,
+                        const std::vector<uint64_t> &stamps,
+                        uint64_t version, uint64_t generation);
+
+public:
+    grid_set(): palette(1), palette_stamps(1), palette_version(0),
+                palette_gen(0), cursor_attrs(),
+                cursor_grid_id(1), draw_tick(0) {
+        get(1)->anchor = grid_anchor::global;
+        layout();
+    }
+
+    grid_set(const grid_set&) = delete;
+    grid_set& operator=(const grid_set&) = delete;
+
+    /// Returns the global grid. The global grid always exists.
+    const grid* global_grid() const {
+        return &grids.at(1);
+    }
+
+    /// Returns the grid with the given ID, or null if there isn't one.
+    const grid* find(size_t id) const {
+        auto iter = grids.find(id);
+        return iter != grids.end() ? &iter->second : nullptr;
+    }
+
+    /// The visible grids in the order they should be drawn.
+    /// The global grid is always first.
+    msg::array_view<const grid* const> ordered() const {
+        return msg::array_view<const grid* const>(draw_order.data(),
+                                                  draw_order.size());
+    }
+
+    /// Returns the topmost visible grid at the given global grid position.
+    /// If no grid is found, returns the global grid.
+    const grid* grid_at(grid_point point) const;
+
+    /// Returns the grid containing the cursor.
+    const grid* cursor_grid() const;
+
+    /// Returns the cursor. The cursor position is relative to cursor_grid().
+    nvim::cursor cursor() const;
+
+    /// Returns the set's draw tick, see grid::tick().
+    uint64_t tick() const {
+        return draw_tick;
+    }
+
+    /// Returns the highlight attributes of a cell.
+    /// Cells with undefined highlight IDs use the default highlight.
+    const cell_attributes& attributes(const cell &cell) const {
+        return highlight(cell.highlight());
+    }
+
+    /// Returns the highlight attributes with the given ID.
+    /// Undefined highlight IDs return the default highlight.
+    const cell_attributes& highlight(size_t hlid) const {
+        return hlid < palette.size() ? palette[hlid] : palette[0];
+    }
+
+    /// The number of highlight IDs in the palette.
+    size_t palette_size() const {
+        return palette.size();
+    }
+
+    /// Changes whenever a palette entry is added or modified.
+    uint64_t palette_revision() const {
+        return palette_version;
+    }
+
+    /// Changes whenever an existing palette entry is modified. Anything
+    /// drawn with an older palette may have the wrong colors. Adding new
+    /// highlights doesn't change the generation, no cell could have been
+    /// drawn with them.
+    uint64_t palette_generation() const {
+        return palette_gen;
+    }
 };
 
 /// Neovim UI options. See nvim :help ui-ext-options.
@@ -526,11 +798,23 @@ enum class showtabline {
 struct tabpage {
     std::string name;
     std::string filetype;
-    void *nvtab;
     int handle;
-    bool closed;
-    bool name_changed;
-    bool filetype_changed;
+};
+
+inline bool operator==(const tabpage &left, const tabpage &right) {
+    return left.handle == right.handle &&
+           left.name == right.name &&
+           left.filetype == right.filetype;
+}
+
+inline bool operator!=(const tabpage &left, const tabpage &right) {
+    return !(left == right);
+}
+
+/// A snapshot of the externalized tabline.
+struct tabline {
+    std::vector<tabpage> tabs;
+    size_t selected = 0;
 };
 
 /// The Neovim window controller.
@@ -551,9 +835,10 @@ public:
     /// Called when the UI process exits.
     void shutdown();
 
-    /// Called when the global grid should be redrawn.
-    /// Obtain a new pointer to the global grid by calling get_global_grid(),
-    /// old grid pointers may be out of date.
+    /// Called when a redraw should be scheduled.
+    /// Called on the first flush of every pending redraw, see redraw_scheduler.
+    /// When redrawing, obtain new grid pointers by calling get_grids(), old
+    /// grid pointers may be out of date.
     void redraw();
 
     /// Called when the Neovim title changes.
@@ -584,19 +869,26 @@ private:
     dispatch_semaphore_t signal_enter;
     std::vector<cell_attributes> hl_table;
     std::vector<cursor_attributes> mode_table;
-
-    // We use a multi buffering scheme with our grid objects.
-    //   * complete - The most recent complete grid.
-    //   * writing  - The grid we're currently writing to.
-    //   * drawing  - The grid the client is currently using.
+    std::vector<uint64_t> hl_stamps;
+    uint64_t hl_version;
+    uint64_t hl_generation;
+
+    // We use a multi buffering scheme with our grid sets.
+    //   * complete - The most recent complete grid set.
+    //   * writing  - The grid set we're currently writing to.
+    //   * drawing  - The grid set the client is currently using.
     //
     // When we receive a flush event, we swap the complete and writing pointers.
-    // When the client requests the global grid, we swap the drawing and
-    // complete pointers. We track draw ticks to avoid handing out stale grids.
-    grid triple_buffered[3];
-    std::atomic<grid*> complete;
-    grid *writing;
-    grid *drawing;
+    // The new writing set is then brought up to date by copying only the rows
+    // that changed since it was last the writing set, see grid::dirty_rows.
+    // When the client requests the grids, we swap the drawing and complete
+    // pointers. We track draw ticks to avoid handing out stale grid sets.
+    grid_set triple_buffered[3];
+    std::atomic<grid_set*> complete;
+    grid_set *writing;
+    grid_set *drawing;
+    redraw_scheduler scheduler;
+    std::shared_ptr<latency_tracker> tracker;
 
     unfair_lock option_lock;
     std::string option_title;
@@ -605,15 +897,30 @@ private:
     colorscheme option_colorscheme;
     ui_options ui_opts;
 
-    unfair_lock tab_lock;
-    std::unordered_map<int, tabpage> tabpage_map;
-    std::vector<tabpage*> tabpages;
-    tabpage *tabpage_selected;
+    // Tabline updates are published as immutable snapshots, the main thread
+    // diffs them against its tabs without blocking the RPC queue. The last
+    // published tabline is kept to skip updates that change nothing.
+    triple_buffer<tabline> tabline_snapshots;
+    tabline tabline_current;
+
+    // Unpacks the redraw events that aren't decoded in place.
+    msg::unpacker event_unpacker;
+
+    /// The write position of a grid_line event within a grid row.
+    struct line_cursor {
+        cell *rowbegin;
+        cell *current;
+        size_t remaining;
+    };
 
     grid* get_grid(size_t index);
 
     void redraw_event(const msg::object &event);
 
+    bool redraw_event(msg::reader &events);
+
+    std::string type_string(msg::reader reader);
+
     void flush();
 
     void grid_resize(size_t grid, size_t width, size_t height);
@@ -622,6 +929,11 @@ private:
 
     void grid_line(size_t grid, size_t row, size_t col, msg::array cells);
 
+    void grid_line_in_place(msg::reader args);
+
+    bool put_cells(line_cursor &line, msg::string text,
+                   uint16_t hlid, size_t repeat);
+
     void grid_cursor_goto(size_t grid, size_t row, size_t col);
 
     void grid_scroll(size_t grid, size_t top, size_t bottom,
@@ -641,6 +953,23 @@ private:
 
     void tabline_update(msg::extension curtab, msg::array tabs);
 
+    void win_pos(size_t grid, msg::extension win, size_t row, size_t col,
+                 size_t width, size_t height);
+
+    void win_float_pos(size_t grid, msg::extension win, msg::string anchor,
+                       size_t anchor_grid, double anchor_row,
+                       double anchor_col, bool focusable);
+
+    void win_hide(size_t grid);
+
+    void win_viewport(size_t grid, msg::extension win, size_t topline,
+                      size_t botline, size_t curline, size_t curcol);
+
+    void msg_set_pos(size_t grid, size_t row, bool scrolled,
+                     msg::string sep_char);
+
+    void grid_destroy(size_t grid);
+
     bool send_option_change() const {
         return !signal_flush && !signal_enter;
     }
@@ -648,7 +977,9 @@ private:
 public:
     window_controller window;
 
-    ui_controller(): hl_table(1), option_title("NVIM") {
+    ui_controller(): hl_table(1), hl_stamps(1), hl_version(0),
+                     hl_generation(0), tracker(std::make_shared<latency_tracker>()),
+                     option_title("NVIM") {
         signal_flush = nullptr;
         signal_enter = nullptr;
         complete = &triple_buffered[0];
@@ -659,10 +990,10 @@ public:
     ui_controller(const ui_controller&) = delete;
     ui_controller& operator=(const ui_controller&) = delete;
 
-    /// Returns a pointer the most up to date global grid object.
+    /// Returns a pointer the most up to date grid set.
     /// Calling this function invalidates pointers previously returned by this
-    /// function.
-    const grid* get_global_grid() {
+    /// function and by get_global_grid().
+    const grid_set* get_grids() {
         uint64_t tick = drawing->draw_tick;
 
         for (;;) {
@@ -674,6 +1005,24 @@ public:
         }
     }
 
+    /// Returns the scheduler that paces redraws.
+    redraw_scheduler& get_redraw_scheduler() {
+        return scheduler;
+    }
+
+    /// Returns the latency tracker. It's shared, so that frames still in
+    /// flight can record their latencies after the UI controller is gone.
+    const std::shared_ptr<latency_tracker>& get_latency_tracker() {
+        return tracker;
+    }
+
+    /// Returns a pointer the most up to date global grid object.
+    /// Calling this function invalidates pointers previously returned by this
+    /// function and by get_grids().
+    const grid* get_global_grid() {
+        return get_grids()->global_grid();
+    }
+
     /// Signals semaphore on the next flush event.
     /// Precondition: No signals are currently pending.
     /// Note: window.redraw() is not called when a waiter is signaled.
@@ -734,33 +1083,33 @@ public:
     /// Returns the current colorscheme.
     nvim::colorscheme get_colorscheme();
 
-    /// The tabline lock. Clients should hold this lock when working with tabs.
-    unfair_lock& get_tab_lock() {
-        return tab_lock;
-    }
-
-    /// Returns a view into the internal array of tabpages.
-    /// Note: Clients should acquire and hold the tabline lock during access.
-    msg::array_view<tabpage*> get_tabs() {
-        return msg::array_view<tabpage*>(tabpages.data(), tabpages.size());
+    /// Returns the most recently published tabline.
+    /// Calling this function invalidates references previously returned by
+    /// this function. Only call from one thread, usually the main thread.
+    const tabline& get_tabline() {
+        return tabline_snapshots.read();
     }
 
-    /// Returns the selected tabpage.
-    /// Note: Clients should acquire and hold the tabline lock during access.
-    tabpage* get_selected_tab() {
-        return tabpage_selected;
-    }
-
-    /// Frees the given tabpage.
-    /// Note: Clients should acquire and hold the tabline lock before freeing.
-    void free_tabpage(tabpage *tab) {
-        tabpage_map.erase(tab->handle);
+    /// Returns the version of the tabline last returned by get_tabline().
+    /// Versions increase with every published tabline, 0 means no tabline has
+    /// been published yet.
+    uint64_t get_tabline_version() const {
+        return tabline_snapshots.read_tick();
     }
 
     /// Handle a Neovim RPC redraw notification.
     /// @param events The paramters of the RPC notification.
     void redraw(msg::array events);
 
+    /// Handle a Neovim RPC redraw notification, reading it in place.
+    ///
+    /// Equivalent to redraw(msg::array), but grid_line events, which make up
+    /// the bulk of most redraws, are decoded straight into the writing grid
+    /// without first being unpacked. Other events are unpacked one at a time.
+    ///
+    /// @param events A reader positioned at the notification's parameters.
+    void redraw(msg::reader events);
+
     /// Handle a colorscheme update.
     void colorscheme_update(msg::array args);
 };
@@ -0,0 +1,55 @@
+//
+//  Neovim Mac Test
+//  BlockFill.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <vector>
+#include <XCTest/XCTest.h>
+
+#include "block_fill.hpp"
+
+struct test_cell {
+    uint32_t values[4];
+};
+
+@interface testBlockFill : XCTestCase
+@end
+
+@implementation testBlockFill
+
+- (void)testFill {
+    const test_cell value = {{1, 2, 3, 4}};
+
+    // Cover the vectorized loop, the remainder loop, and both together.
+    for (size_t count=0; count<20; ++count) {
+        std::vector<test_cell> cells(count + 2, test_cell{});
+        block_fill(cells.data() + 1, value, count);
+
+        XCTAssertEqual(cells.front().values[0], 0);
+        XCTAssertEqual(cells.back().values[0], 0);
+
+        for (size_t i=1; i<=count; ++i) {
+            XCTAssertEqual(memcmp(&cells[i], &value, sizeof(value)), 0);
+        }
+    }
+}
+
+- (void)testFillUnaligned {
+    const test_cell value = {{5, 6, 7, 8}};
+    alignas(16) uint32_t storage[4 * 9 + 1] = {};
+    test_cell *cells = reinterpret_cast<test_cell*>(storage + 1);
+
+    block_fill(cells, value, 9);
+
+    XCTAssertEqual(storage[0], 0);
+
+    for (size_t i=0; i<9; ++i) {
+        XCTAssertEqual(memcmp(&cells[i], &value, sizeof(value)), 0);
+    }
+}
+
+@end
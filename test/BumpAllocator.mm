@@ -63,6 +63,50 @@
     XCTAssertEqual(allocator.remaining(), remaining);
 }
 
+- (void)testResetPoisons {
+    bump_allocator allocator(512);
+    char *small = static_cast<char*>(allocator.alloc(24));
+    char *large = static_cast<char*>(allocator.alloc(1024));
+    allocator.reset();
+
+    AssertRegionPoisoned(small, 24);
+    AssertRegionPoisoned(large, 1024);
+}
+
+- (void)testResetKeepsSingleBuffer {
+    bump_allocator allocator(512);
+    size_t remaining = allocator.remaining();
+
+    allocator.alloc(24);
+    allocator.reset();
+
+    XCTAssertEqual(allocator.capacity(), 512);
+    XCTAssertEqual(allocator.remaining(), remaining);
+}
+
+- (void)testResetConsolidatesBuffers {
+    bump_allocator allocator(512);
+
+    for (int i=0; i<8; ++i) {
+        allocator.alloc(400);
+    }
+
+    XCTAssertGreaterThan(allocator.capacity(), 512);
+    allocator.reset();
+
+    size_t capacity = allocator.capacity();
+    XCTAssertGreaterThanOrEqual(allocator.remaining(), 8 * 400);
+
+    // The same workload now fits in the consolidated buffer.
+    for (int i=0; i<8; ++i) {
+        AssertRegionValid(allocator.alloc(400), 400);
+    }
+
+    XCTAssertEqual(allocator.capacity(), capacity);
+    allocator.reset();
+    XCTAssertEqual(allocator.capacity(), capacity);
+}
+
 - (void)testDefaultContructor {
     bump_allocator default_contructed;
     XCTAssertEqual(default_contructed.capacity(), 0);
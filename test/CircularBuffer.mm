@@ -340,6 +340,53 @@ static inline bool all_of(const circular_buffer &buffer, char val) {
     }
 }
 
+- (void)testPrepareAndCommit {
+    std::string_view input("input");
+    circular_buffer buffer;
+
+    char *dest = buffer.prepare(input.size());
+    XCTAssertGreaterThanOrEqual(buffer.capacity(), input.size());
+    XCTAssertEqual(buffer.size(), 0);
+
+    memcpy(dest, input.data(), input.size());
+    buffer.commit(input.size());
+    XCTAssertEqual(buffer, input);
+}
+
+- (void)testPrepareResizesAsNeeded {
+    circular_buffer buffer(1024);
+    size_t capacity = buffer.capacity();
+    char *data = buffer.data();
+
+    buffer.push_back('x');
+    buffer.prepare(capacity - 1);
+    XCTAssertEqual(buffer.capacity(), capacity);
+    XCTAssertEqual(buffer.data(), data);
+
+    memset(buffer.prepare(capacity), 'x', capacity);
+    buffer.commit(capacity);
+    XCTAssertGreaterThan(buffer.capacity(), capacity);
+    XCTAssertEqual(buffer.size(), capacity + 1);
+    XCTAssertTrue(all_of(buffer, 'x'));
+}
+
+- (void)testPrepareWrapsAround {
+    std::string_view input("1234567890123");
+
+    circular_buffer buffer(1024);
+    size_t capacity = buffer.capacity();
+    size_t lim = capacity * 4;
+
+    for (int i=0; i<lim; ++i) {
+        memcpy(buffer.prepare(input.size()), input.data(), input.size());
+        buffer.commit(input.size());
+        XCTAssertEqual(buffer, input);
+
+        buffer.consume(input.size());
+        XCTAssertEqual(buffer.capacity(), capacity);
+    }
+}
+
 - (void)testInsertAndConsumeDoesNotResize {
     std::string_view input("1234567890123");
     
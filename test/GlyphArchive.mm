@@ -0,0 +1,205 @@
+//
+//  Neovim Mac Test
+//  GlyphArchive.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <XCTest/XCTest.h>
+
+#include "glyph_archive.hpp"
+
+static glyph_archive::key_type makeKey(char ch) {
+    nvim::grapheme_cluster graphemes = {ch};
+    return glyph_archive::key_type(glyph_archive::font_id("Menlo-Regular", 24),
+                                   graphemes, 0xFFFFFFFF, 0xFF000000);
+}
+
+@interface testGlyphArchive : XCTestCase
+@end
+
+@implementation testGlyphArchive {
+    std::string path;
+    unsigned char pixels[4 * 16 * 8];
+    glyph_archive::bitmap bitmap;
+}
+
+- (void)setUp {
+    NSString *file = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    path = [file fileSystemRepresentation];
+
+    for (size_t i=0; i<sizeof(pixels); ++i) {
+        pixels[i] = static_cast<unsigned char>(i);
+    }
+
+    bitmap = glyph_archive::bitmap{pixels, 64, 1, 12, 15, 8};
+}
+
+- (void)tearDown {
+    unlink(path.c_str());
+}
+
+- (void)testFindUnsaved {
+    glyph_archive archive;
+    archive.open(path, 1, 1 << 20);
+
+    glyph_archive::bitmap found;
+    XCTAssertFalse(archive.find(makeKey('a'), found));
+
+    archive.add(makeKey('a'), bitmap, 64);
+    XCTAssertTrue(archive.find(makeKey('a'), found));
+    XCTAssertEqual(found.width, 15);
+    XCTAssertEqual(found.height, 8);
+    XCTAssertEqual(found.ascent, 12);
+    XCTAssertEqual(found.left_bearing, 1);
+    XCTAssertEqual(memcmp(found.pixels, pixels, sizeof(pixels)), 0);
+}
+
+- (void)testSaveAndReopen {
+    {
+        glyph_archive archive;
+        archive.open(path, 1, 1 << 20);
+        archive.add(makeKey('a'), bitmap, 64);
+        archive.save();
+    }
+
+    {
+        glyph_archive archive;
+        archive.open(path, 1, 1 << 20);
+        XCTAssertEqual(archive.size(), 1);
+
+        archive.add(makeKey('b'), bitmap, 64);
+        archive.save();
+    }
+
+    glyph_archive archive;
+    archive.open(path, 1, 1 << 20);
+    XCTAssertEqual(archive.size(), 2);
+
+    glyph_archive::bitmap found;
+    XCTAssertTrue(archive.find(makeKey('a'), found));
+    XCTAssertEqual(found.stride, 64);
+    XCTAssertEqual(memcmp(found.pixels, pixels, sizeof(pixels)), 0);
+    XCTAssertTrue(archive.find(makeKey('b'), found));
+    XCTAssertFalse(archive.find(makeKey('c'), found));
+}
+
+- (void)testPacksRows {
+    glyph_archive archive;
+    archive.open(path, 1, 1 << 20);
+
+    // Keep the first 16 bytes of every other row.
+    glyph_archive::bitmap rows = glyph_archive::bitmap{pixels, 128, 0, 4, 3, 4};
+    archive.add(makeKey('a'), rows, 16);
+
+    glyph_archive::bitmap found;
+    XCTAssertTrue(archive.find(makeKey('a'), found));
+    XCTAssertEqual(found.stride, 16);
+    XCTAssertEqual(memcmp(found.pixels + 16, pixels + 128, 16), 0);
+    XCTAssertEqual(memcmp(found.pixels + 48, pixels + 384, 16), 0);
+}
+
+- (void)testVersionMismatchDiscards {
+    {
+        glyph_archive archive;
+        archive.open(path, 1, 1 << 20);
+        archive.add(makeKey('a'), bitmap, 64);
+        archive.save();
+    }
+
+    {
+        glyph_archive archive;
+        archive.open(path, 2, 1 << 20);
+        XCTAssertEqual(archive.size(), 0);
+
+        archive.add(makeKey('b'), bitmap, 64);
+        archive.save();
+    }
+
+    glyph_archive archive;
+    archive.open(path, 2, 1 << 20);
+    glyph_archive::bitmap found;
+    XCTAssertEqual(archive.size(), 1);
+    XCTAssertFalse(archive.find(makeKey('a'), found));
+    XCTAssertTrue(archive.find(makeKey('b'), found));
+}
+
+- (void)testTruncatedRecordsAreIgnored {
+    {
+        glyph_archive archive;
+        archive.open(path, 1, 1 << 20);
+        archive.add(makeKey('a'), bitmap, 64);
+        archive.add(makeKey('b'), bitmap, 64);
+        archive.save();
+    }
+
+    struct stat info;
+    XCTAssertEqual(stat(path.c_str(), &info), 0);
+    XCTAssertEqual(truncate(path.c_str(), info.st_size - 100), 0);
+
+    glyph_archive archive;
+    archive.open(path, 1, 1 << 20);
+    XCTAssertEqual(archive.size(), 1);
+
+    glyph_archive::bitmap found;
+    XCTAssertTrue(archive.find(makeKey('a'), found));
+
+    archive.add(makeKey('b'), bitmap, 64);
+    archive.save();
+
+    glyph_archive reopened;
+    reopened.open(path, 1, 1 << 20);
+    XCTAssertEqual(reopened.size(), 2);
+}
+
+- (void)testSaveKeepsOtherMappings {
+    {
+        glyph_archive archive;
+        archive.open(path, 1, 1 << 20);
+        archive.add(makeKey('a'), bitmap, 64);
+        archive.save();
+    }
+
+    glyph_archive other;
+    other.open(path, 1, 1 << 20);
+
+    {
+        glyph_archive archive;
+        archive.open(path, 2, 1 << 20);
+        archive.add(makeKey('b'), bitmap, 64);
+        archive.save();
+    }
+
+    glyph_archive::bitmap found;
+    XCTAssertTrue(other.find(makeKey('a'), found));
+    XCTAssertEqual(memcmp(found.pixels, pixels, sizeof(pixels)), 0);
+}
+
+- (void)testNarrowStrideIsRejected {
+    {
+        glyph_archive archive;
+        archive.open(path, 1, 1 << 20);
+        archive.add(makeKey('a'), bitmap, 60);
+        archive.save();
+    }
+
+    glyph_archive archive;
+    archive.open(path, 1, 1 << 20);
+    XCTAssertEqual(archive.size(), 0);
+}
+
+- (void)testMaxSize {
+    glyph_archive archive;
+    archive.open(path, 1, 1024);
+    archive.add(makeKey('a'), bitmap, 64);
+    archive.add(makeKey('b'), bitmap, 64);
+    archive.add(makeKey('c'), bitmap, 64);
+    XCTAssertEqual(archive.size(), 1);
+}
+
+@end
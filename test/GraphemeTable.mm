@@ -0,0 +1,99 @@
+//
+//  Neovim Mac Test
+//  GraphemeTable.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <string>
+#include <string_view>
+#include <XCTest/XCTest.h>
+
+#include "grapheme_table.hpp"
+
+using nvim::grapheme_id;
+using nvim::grapheme_table;
+
+@interface testGraphemeTable : XCTestCase
+@end
+
+@implementation testGraphemeTable
+
+- (void)testInternReturnsSameIndex {
+    grapheme_table table;
+    uint32_t first = table.intern("e\xcc\x81\xcc\xa7");
+    uint32_t second = table.intern("a\xcc\x81\xcc\xa7");
+
+    XCTAssertNotEqual(first, second);
+    XCTAssertEqual(table.intern("e\xcc\x81\xcc\xa7"), first);
+    XCTAssertEqual(table.size(), 2);
+    XCTAssertEqual(table.get(first), "e\xcc\x81\xcc\xa7");
+    XCTAssertEqual(table.get(second), "a\xcc\x81\xcc\xa7");
+}
+
+- (void)testInternTrims {
+    grapheme_table table;
+    std::string text(32, 'a');
+    uint32_t index = table.intern(text);
+
+    XCTAssertEqual(table.get(index), std::string(24, 'a'));
+    XCTAssertEqual(table.intern(std::string(24, 'a')), index);
+}
+
+- (void)testEmptyId {
+    grapheme_table table;
+    grapheme_id id;
+
+    XCTAssertTrue(id.empty());
+    XCTAssertFalse(id.is_interned());
+    XCTAssertEqual(id.view(table), "");
+    XCTAssertTrue(id == grapheme_id("", table));
+}
+
+- (void)testInlineIds {
+    grapheme_table table;
+    std::string_view texts[] = {"a", "\xc3\xa9", "\xe4\xb8\xad", "\xf0\x9f\x98\x80"};
+
+    for (std::string_view text : texts) {
+        grapheme_id id(text, table);
+        XCTAssertFalse(id.empty());
+        XCTAssertFalse(id.is_interned());
+        XCTAssertEqual(id.view(table), text);
+    }
+
+    XCTAssertEqual(table.size(), 0);
+}
+
+- (void)testInternedIds {
+    grapheme_table table;
+    std::string_view text = "\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd";
+    grapheme_id id(text, table);
+
+    XCTAssertTrue(id.is_interned());
+    XCTAssertEqual(id.view(table), text);
+    XCTAssertTrue(id == grapheme_id(text, table));
+    XCTAssertTrue(id != grapheme_id("a", table));
+    XCTAssertEqual(table.size(), 1);
+
+    nvim::grapheme_cluster cluster = id.cluster(table);
+    XCTAssertEqual(std::string_view(cluster.data(), text.size()), text);
+    XCTAssertEqual(cluster[text.size()], 0);
+}
+
+- (void)testManyInternedIds {
+    grapheme_table table;
+
+    for (int i=0; i<10000; ++i) {
+        std::string text = "text" + std::to_string(i);
+        grapheme_id id(text, table);
+        XCTAssertEqual(id.view(table), text);
+    }
+
+    XCTAssertEqual(table.size(), 10000);
+    XCTAssertEqual(grapheme_id("text42", table).view(table), "text42");
+    XCTAssertEqual(table.size(), 10000);
+}
+
+@end
@@ -0,0 +1,242 @@
+//
+//  Neovim Mac Test
+//  GridLine.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <string>
+#include <XCTest/XCTest.h>
+
+#include "ui.hpp"
+
+using nvim::ui_controller;
+
+/// A redraw batch packed as Neovim sends it.
+class redraw_batch {
+private:
+    msg::packer packer;
+
+public:
+    void grid_resize(size_t width, size_t height) {
+        packer.start_array(2);
+        packer.pack_string("grid_resize");
+        packer.start_array(3);
+        packer.pack(1);
+        packer.pack(width);
+        packer.pack(height);
+    }
+
+    void grid_clear() {
+        packer.start_array(2);
+        packer.pack_string("grid_clear");
+        packer.start_array(1);
+        packer.pack(1);
+    }
+
+    /// Starts a grid_line event with count parameter tuples.
+    void start_grid_line(uint32_t count) {
+        packer.start_array(count + 1);
+        packer.pack_string("grid_line");
+    }
+
+    /// Starts a grid_line tuple of count cells.
+    void start_line(size_t row, size_t col, uint32_t count) {
+        packer.start_array(4);
+        packer.pack(1);
+        packer.pack(row);
+        packer.pack(col);
+        packer.start_array(count);
+    }
+
+    void cell(msg::string text) {
+        packer.start_array(1);
+        packer.pack_string(text);
+    }
+
+    void cell(msg::string text, size_t hlid) {
+        packer.start_array(2);
+        packer.pack_string(text);
+        packer.pack(hlid);
+    }
+
+    void cell(msg::string text, size_t hlid, size_t repeat) {
+        packer.start_array(3);
+        packer.pack_string(text);
+        packer.pack(hlid);
+        packer.pack(repeat);
+    }
+
+    void flush() {
+        packer.start_array(2);
+        packer.pack_string("flush");
+        packer.start_array(0);
+    }
+
+    /// Returns the packed event list of count events.
+    std::string events(uint32_t count) const {
+        msg::packer header;
+        header.start_array(count);
+
+        std::string events(header.data(), header.size());
+        events.append(packer.data(), packer.size());
+        return events;
+    }
+};
+
+static std::string_view text(const nvim::grid *grid, size_t row, size_t col) {
+    return grid->get(row, col)->grapheme_view();
+}
+
+static uint16_t highlight(const nvim::grid *grid, size_t row, size_t col) {
+    return grid->get(row, col)->highlight();
+}
+
+/// Applies events and returns the flushed grid set.
+static const nvim::grid_set* replay(ui_controller &ui, const std::string &events) {
+    dispatch_semaphore_t flushed = dispatch_semaphore_create(0);
+    ui.signal_on_flush(flushed);
+    ui.redraw(msg::reader(events.data(), events.size()));
+    return ui.get_grids();
+}
+
+@interface testGridLine : XCTestCase
+@end
+
+@implementation testGridLine
+
+- (void)testCells {
+    redraw_batch batch;
+    batch.grid_resize(10, 2);
+    batch.start_grid_line(1);
+    batch.start_line(0, 0, 7);
+    batch.cell("a", 3);
+    batch.cell("b");
+    batch.cell("c");
+    batch.cell(" ", 4, 2);
+    batch.cell("d");
+    batch.cell("\xc3\xa9", 5);
+    batch.cell("x");
+    batch.flush();
+
+    ui_controller ui;
+    ui.window = nvim::window_controller(nullptr);
+    const nvim::grid *grid = replay(ui, batch.events(3))->global_grid();
+
+    const char *texts[] = {"a", "b", "c", "", "", "d", "\xc3\xa9", "x", "", ""};
+    uint16_t highlights[] = {3, 3, 3, 4, 4, 4, 5, 5, 0, 0};
+
+    for (size_t col=0; col<10; ++col) {
+        XCTAssertEqual(text(grid, 0, col), texts[col]);
+        XCTAssertEqual(highlight(grid, 0, col), highlights[col]);
+    }
+}
+
+- (void)testAsciiRunOverflow {
+    redraw_batch batch;
+    batch.grid_resize(4, 1);
+    batch.start_grid_line(1);
+    batch.start_line(0, 1, 4);
+    batch.cell("a", 2);
+    batch.cell("b");
+    batch.cell("c");
+    batch.cell("d");
+    batch.flush();
+
+    ui_controller ui;
+    ui.window = nvim::window_controller(nullptr);
+    const nvim::grid *grid = replay(ui, batch.events(3))->global_grid();
+
+    // The cell that doesn't fit is dropped.
+    XCTAssertEqual(text(grid, 0, 0), "");
+    XCTAssertEqual(text(grid, 0, 1), "a");
+    XCTAssertEqual(text(grid, 0, 2), "b");
+    XCTAssertEqual(text(grid, 0, 3), "c");
+    XCTAssertEqual(highlight(grid, 0, 3), 2);
+}
+
+- (void)testGridClear {
+    redraw_batch batch;
+    batch.grid_resize(3, 3);
+    batch.start_grid_line(3);
+
+    for (size_t row=0; row<3; ++row) {
+        batch.start_line(row, 0, 1);
+        batch.cell("x", 1, 3);
+    }
+
+    batch.flush();
+
+    ui_controller ui;
+    ui.window = nvim::window_controller(nullptr);
+    const nvim::grid *grid = replay(ui, batch.events(3))->global_grid();
+    XCTAssertEqual(text(grid, 2, 2), "x");
+
+    redraw_batch clear;
+    clear.grid_clear();
+    clear.flush();
+
+    grid = replay(ui, clear.events(2))->global_grid();
+
+    for (const nvim::cell &cell : *grid) {
+        XCTAssertTrue(cell.empty());
+        XCTAssertEqual(cell.highlight(), 0);
+    }
+}
+
+/// Replays the grid_line events of a full redraw of a 200x60 grid. Rows have
+/// a line number column, text in a few highlights, and trailing blanks.
+- (void)testFullRedrawPerformance {
+    const size_t width = 200;
+    const size_t height = 60;
+
+    redraw_batch setup;
+    setup.grid_resize(width, height);
+
+    redraw_batch batch;
+    batch.start_grid_line(height);
+
+    for (size_t row=0; row<height; ++row) {
+        std::string number = std::to_string(row + 1);
+        std::string source = "    for (size_t i=0; i<count; ++i) { total += values[i]; }";
+
+        batch.start_line(row, 0, static_cast<uint32_t>(number.size() + source.size() + 3));
+        batch.cell(" ", 1, 4 - number.size());
+
+        for (char c : number) {
+            batch.cell(std::string(1, c));
+        }
+
+        batch.cell(" ", 0);
+
+        for (size_t i=0; i<source.size(); ++i) {
+            std::string c(1, source[i]);
+
+            if (i % 12 == 4) {
+                batch.cell(c, 2 + (i % 3));
+            } else {
+                batch.cell(c);
+            }
+        }
+
+        batch.cell(" ", 0, width - 5 - source.size());
+    }
+
+    ui_controller ui;
+    ui.window = nvim::window_controller(nullptr);
+
+    std::string setup_events = setup.events(1);
+    ui.redraw(msg::reader(setup_events.data(), setup_events.size()));
+
+    std::string events = batch.events(1);
+
+    [self measureBlock:^{
+        for (int i=0; i<100; ++i) {
+            ui.redraw(msg::reader(events.data(), events.size()));
+        }
+    }];
+}
+
+@end
@@ -0,0 +1,240 @@
+//
+//  Neovim Mac Test
+//  HashTable.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <array>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include <XCTest/XCTest.h>
+
+#include "hash_table.hpp"
+
+namespace {
+
+/// Mirrors the layout and hash function of glyph_manager's key type.
+struct test_key {
+    size_t hash;
+    std::array<char, 24> graphemes;
+    uint32_t background;
+    uint32_t foreground;
+    const void *font;
+
+    test_key() = default;
+
+    test_key(const void *font, char ch, uint32_t background, uint32_t foreground):
+        graphemes(), background(background), foreground(foreground), font(font) {
+        graphemes[0] = ch;
+
+        uint64_t jumbled[4];
+        memcpy(jumbled, graphemes.data(), graphemes.size());
+
+        jumbled[0] *= 18446744073709551557ull;
+        jumbled[1] *= 9223372036854775643ull;
+        jumbled[2] *= 4611686018427387701ull;
+        jumbled[3] = ((uintptr_t)font >> 3) ^ foreground ^ background;
+        hash = jumbled[0] ^ jumbled[1] ^ jumbled[2] ^ jumbled[3];
+    }
+};
+
+struct test_value {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+};
+
+struct key_hash {
+    size_t operator()(const test_key &key) const {
+        return key.hash;
+    }
+};
+
+struct key_equal {
+    bool operator()(const test_key &left, const test_key &right) const {
+        return memcmp(&left, &right, sizeof(test_key)) == 0;
+    }
+};
+
+using unordered_map = std::unordered_map<test_key, test_value, key_hash, key_equal>;
+
+/// Generates the cells of a realistic 250x200 frame. Mostly printable ASCII
+/// with a handful of highlight groups, and four font variants.
+std::vector<test_key> make_frame() {
+    static const char fonts[4] = {};
+    static const uint32_t colors[][2] = {
+        {0x1d1f21, 0xc5c8c6}, {0x1d1f21, 0xb294bb}, {0x1d1f21, 0x81a2be},
+        {0x1d1f21, 0xb5bd68}, {0x1d1f21, 0x969896}, {0x282a2e, 0xc5c8c6},
+        {0x373b41, 0xf0c674}, {0xcc6666, 0x1d1f21},
+    };
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> chars(33, 126);
+    std::uniform_int_distribution<int> color(0, 7);
+    std::uniform_int_distribution<int> font(0, 3);
+
+    std::vector<test_key> frame;
+    frame.reserve(250 * 200);
+
+    for (size_t i=0; i<250 * 200; ++i) {
+        int c = color(generator);
+        frame.emplace_back(&fonts[font(generator)], chars(generator),
+                           colors[c][0], colors[c][1]);
+    }
+
+    return frame;
+}
+
+} // namespace
+
+@interface testHashTable : XCTestCase
+@end
+
+@implementation testHashTable
+
+- (void)testEmptyFind {
+    hash_table<test_key, test_value> table;
+    XCTAssertEqual(table.size(), 0);
+    XCTAssertEqual(table.find(test_key(nullptr, 'a', 0, 0)), nullptr);
+}
+
+- (void)testInsertFind {
+    hash_table<test_key, test_value> table;
+    std::vector<test_key> keys = make_frame();
+    unordered_map expected;
+
+    for (const test_key &key : keys) {
+        if (!table.find(key)) {
+            test_value value{(int16_t)key.graphemes[0], 0, (int16_t)expected.size()};
+            table.insert(key, value);
+            expected.emplace(key, value);
+        }
+    }
+
+    XCTAssertEqual(table.size(), expected.size());
+
+    for (const auto& [key, value] : expected) {
+        const test_value *found = table.find(key);
+        XCTAssertNotEqual(found, nullptr);
+        XCTAssertEqual(found->z, value.z);
+    }
+
+    XCTAssertEqual(table.find(test_key(nullptr, 'a', 1, 2)), nullptr);
+}
+
+- (void)testFilter {
+    hash_table<test_key, test_value> table;
+
+    for (int i=0; i<1000; ++i) {
+        table.insert(test_key(nullptr, i % 128, i, 0), test_value{0, 0, (int16_t)(i % 10)});
+    }
+
+    table.filter([](test_value &value) {
+        if (value.z < 5) {
+            return false;
+        }
+
+        value.z -= 5;
+        return true;
+    });
+
+    XCTAssertEqual(table.size(), 500);
+
+    for (int i=0; i<1000; ++i) {
+        const test_value *found = table.find(test_key(nullptr, i % 128, i, 0));
+
+        if (i % 10 < 5) {
+            XCTAssertEqual(found, nullptr);
+        } else {
+            XCTAssertNotEqual(found, nullptr);
+            XCTAssertEqual(found->z, (i % 10) - 5);
+        }
+    }
+}
+
+- (void)testInsertAfterFilterReusesTombstones {
+    hash_table<test_key, test_value> table(64);
+
+    for (int round=0; round<100; ++round) {
+        for (int i=0; i<40; ++i) {
+            table.insert(test_key(nullptr, i, round, 0), test_value{});
+        }
+
+        table.filter([](test_value&) { return false; });
+        XCTAssertEqual(table.size(), 0);
+    }
+
+    table.insert(test_key(nullptr, 'a', 0, 0), test_value{1, 2, 3});
+    XCTAssertEqual(table.find(test_key(nullptr, 'a', 0, 0))->z, 3);
+}
+
+- (void)testClear {
+    hash_table<test_key, test_value> table;
+    table.insert(test_key(nullptr, 'a', 0, 0), test_value{});
+    table.clear();
+
+    XCTAssertEqual(table.size(), 0);
+    XCTAssertEqual(table.find(test_key(nullptr, 'a', 0, 0)), nullptr);
+}
+
+- (void)testSlotCount {
+    hash_table<test_key, test_value> table;
+    XCTAssertEqual(table.slot_count(), 0);
+
+    std::vector<test_key> keys = make_frame();
+
+    for (const test_key &key : keys) {
+        if (table.find_slot(key) == table.npos) {
+            XCTAssertLessThan(table.insert(key, test_value{}), table.slot_count());
+        }
+    }
+
+    XCTAssertGreaterThan(table.slot_count(), table.size());
+}
+
+- (void)testFramePerformanceHashTable {
+    std::vector<test_key> frame = make_frame();
+    hash_table<test_key, test_value> table(2048);
+
+    for (const test_key &key : frame) {
+        if (!table.find(key)) {
+            table.insert(key, test_value{});
+        }
+    }
+
+    [self measureBlock:^{
+        int64_t sum = 0;
+
+        for (const test_key &key : frame) {
+            sum += table.find(key)->x;
+        }
+
+        XCTAssertEqual(sum, 0);
+    }];
+}
+
+- (void)testFramePerformanceUnorderedMap {
+    std::vector<test_key> frame = make_frame();
+    unordered_map map;
+    map.reserve(2048);
+
+    for (const test_key &key : frame) {
+        map.emplace(key, test_value{});
+    }
+
+    [self measureBlock:^{
+        int64_t sum = 0;
+
+        for (const test_key &key : frame) {
+            sum += map.find(key)->second.x;
+        }
+
+        XCTAssertEqual(sum, 0);
+    }];
+}
+
+@end
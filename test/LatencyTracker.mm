@@ -0,0 +1,94 @@
+//
+//  Neovim Mac Test
+//  LatencyTracker.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <string>
+#include <XCTest/XCTest.h>
+
+#include "latency_tracker.hpp"
+
+static bool contains(const std::string &string, const char *substring) {
+    return string.find(substring) != std::string::npos;
+}
+
+@interface testLatencyTracker : XCTestCase
+@end
+
+@implementation testLatencyTracker
+
+- (void)testKeyToPhoton {
+    latency_tracker tracker;
+    XCTAssertEqual(tracker.last_input(), 0);
+
+    uint64_t id = tracker.input_started();
+    XCTAssertEqual(id, 1);
+    XCTAssertEqual(tracker.last_input(), 1);
+
+    // Flushes before the acknowledgement don't carry the input.
+    tracker.notification_decoded();
+    tracker.flushed(1);
+    tracker.presented(1, latency_tracker::now());
+    XCTAssertTrue(contains(tracker.report(), "no samples"));
+
+    tracker.input_acknowledged(id, 1);
+    tracker.notification_decoded();
+    tracker.flushed(2);
+
+    // Presenting an older frame doesn't complete the input.
+    tracker.presented(1, latency_tracker::now());
+    XCTAssertTrue(contains(tracker.report(), "no samples"));
+
+    tracker.presented(2, latency_tracker::now());
+    XCTAssertTrue(contains(tracker.report(), "1 samples"));
+}
+
+- (void)testFlushMustFollowAcknowledgement {
+    latency_tracker tracker;
+    uint64_t id = tracker.input_started();
+
+    // Two notifications were queued before the acknowledgement, only one of
+    // them has been decoded.
+    tracker.input_acknowledged(id, 2);
+    tracker.notification_decoded();
+    tracker.flushed(1);
+    tracker.presented(1, latency_tracker::now());
+    XCTAssertTrue(contains(tracker.report(), "no samples"));
+
+    tracker.notification_decoded();
+    tracker.notification_decoded();
+    tracker.flushed(2);
+    tracker.presented(2, latency_tracker::now());
+    XCTAssertTrue(contains(tracker.report(), "1 samples"));
+}
+
+- (void)testAcknowledgesEarlierInputs {
+    latency_tracker tracker;
+    tracker.input_started();
+    tracker.input_started();
+    uint64_t last = tracker.input_started();
+
+    tracker.input_acknowledged(last - 1, 0);
+    tracker.notification_decoded();
+    tracker.flushed(1);
+    tracker.presented(1, latency_tracker::now());
+    XCTAssertTrue(contains(tracker.report(), "2 samples"));
+
+    tracker.input_acknowledged(last, 1);
+    tracker.notification_decoded();
+    tracker.flushed(2);
+    tracker.presented(3, latency_tracker::now());
+    XCTAssertTrue(contains(tracker.report(), "3 samples"));
+}
+
+- (void)testGlyphStats {
+    latency_tracker tracker;
+    tracker.set_glyph_stats(glyph_cache_stats{90, 6, 1, 3});
+    XCTAssertTrue(contains(tracker.report(), "96.00% hits"));
+}
+
+@end
@@ -8,6 +8,7 @@
 //
 
 #include <array>
+#include <string>
 #include <XCTest/XCTest.h>
 #include "AsanAssert.h"
 #include "msgpack.hpp"
@@ -305,6 +306,42 @@ static inline bool all_a(const char *begin, const char *end) {
     AssertAddressPoisoned(&str);
 }
 
+- (void)testUnpackerReusesMemory {
+    // An array of 64 strings, each 1000 'a's long. Larger than the unpacker's
+    // initial allocator capacity.
+    std::string packed("\xdc\x00\x40", 3);
+
+    for (int i=0; i<64; ++i) {
+        packed.append("\xda\x03\xe8");
+        packed.append(1000, 'a');
+    }
+
+    msg::unpacker unpacker;
+    const char *data[3];
+
+    for (int i=0; i<3; ++i) {
+        unpacker.feed(packed.data(), packed.size());
+        msg::object *obj = unpacker.unpack();
+
+        XCTAssertTrue(obj);
+        msg::array array = obj->get<msg::array>();
+        XCTAssertEqual(array.size(), 64);
+
+        for (const msg::object &elem : array) {
+            msg::string str = elem.get<msg::string>();
+            XCTAssertEqual(str.size(), 1000);
+            XCTAssertTrue(all_a(str.data(), str.data() + str.size()));
+        }
+
+        data[i] = array[0].get<msg::string>().data();
+        XCTAssertFalse(unpacker.unpack());
+    }
+
+    // After the first message, the allocator has grown to fit the message,
+    // and the same memory is reused for every subsequent message.
+    XCTAssertEqual(data[1], data[2]);
+}
+
 - (void)testUnpackInvalid {
     auto packed = packed_data("\xc1");
     auto value = msg::make_object<msg::invalid>();
@@ -1874,4 +1911,71 @@ static inline bool all_a(const char *begin, const char *end) {
     XCTAssertEqual(msg::string(packer.data(), packer.size()), packed);
 }
 
+- (void)testScannerComplete {
+    auto packed = packed_data("\x93\x02\xa6\x72\x65\x64\x72\x61\x77\x91\x01");
+    msg::scanner scanner;
+
+    XCTAssertEqual(scanner.scan(packed.data(), packed.size()), packed.size());
+}
+
+- (void)testScannerIncremental {
+    auto packed = packed_data("\x92\xa5\x74\x75\x70\x6c\x65\x92\xcd\x01\xb0\x01\xc0");
+    msg::scanner scanner;
+
+    // The trailing nil is not part of the first object.
+    for (size_t i=0; i<packed.size() - 2; ++i) {
+        XCTAssertEqual(scanner.scan(packed.data(), i), 0);
+    }
+
+    XCTAssertEqual(scanner.scan(packed.data(), packed.size() - 1), packed.size() - 1);
+    XCTAssertEqual(scanner.scan(packed.data() + packed.size() - 1, 1), 1);
+}
+
+- (void)testReaderRead {
+    auto packed = packed_data("\x93\xa9\x67\x72\x69\x64\x5f\x6c\x69\x6e\x65"
+                              "\xcd\x01\xb0\xff\x81\xa1\x30\x00");
+
+    msg::reader reader(packed.data(), packed.size());
+
+    XCTAssertEqual(*reader.read_array(), 3);
+    XCTAssertEqual(*reader.read_string(), "grid_line");
+    XCTAssertEqual(reader.read_integer()->as<int>(), 432);
+    XCTAssertEqual(reader.read_integer()->as<int>(), -1);
+    XCTAssertEqual(*reader.read_map(), 1);
+    XCTAssertEqual(*reader.read_string(), "0");
+    XCTAssertEqual(reader.read_integer()->as<int>(), 0);
+    XCTAssertTrue(reader.empty());
+}
+
+- (void)testReaderTypeMismatch {
+    auto packed = packed_data("\xa1\x30");
+    msg::reader reader(packed.data(), packed.size());
+
+    XCTAssertFalse(reader.read_integer());
+    XCTAssertFalse(reader.read_array());
+    XCTAssertEqual(reader.position(), packed.data());
+    XCTAssertEqual(*reader.read_string(), "0");
+}
+
+- (void)testReaderTruncated {
+    auto packed = packed_data("\xa6\x72\x65\x64");
+    msg::reader reader(packed.data(), packed.size());
+
+    XCTAssertFalse(reader.read_string());
+    XCTAssertFalse(reader.skip());
+    XCTAssertEqual(reader.position(), packed.data());
+}
+
+- (void)testReaderSkip {
+    auto packed = packed_data("\x92\x83\xa1\x30\x00\xa1\x31\x01\xa1\x32"
+                              "\x92\xc0\xc3\xcb\x40\x09\x1e\xb8\x51\xeb"
+                              "\x85\x1f\x07");
+
+    msg::reader reader(packed.data(), packed.size());
+
+    XCTAssertTrue(reader.skip());
+    XCTAssertEqual(reader.read_integer()->as<int>(), 7);
+    XCTAssertTrue(reader.empty());
+}
+
 @end
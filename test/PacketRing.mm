@@ -0,0 +1,132 @@
+//
+//  Neovim Mac Test
+//  PacketRing.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <string>
+#include <string_view>
+#include <thread>
+#include <XCTest/XCTest.h>
+
+#include "AsanAssert.h"
+#include "packet_ring.hpp"
+
+static inline std::string_view view(packet_ring::packet packet) {
+    return std::string_view(packet.data, packet.size);
+}
+
+@interface testPacketRing : XCTestCase
+@end
+
+@implementation testPacketRing
+
+- (void)testCapacityIsPowerOfTwo {
+    packet_ring ring(100);
+    XCTAssertEqual(ring.capacity(), 128);
+    XCTAssertTrue(ring.empty());
+    XCTAssertFalse(ring.front());
+}
+
+- (void)testPushPop {
+    packet_ring ring(256);
+    XCTAssertTrue(ring.push("Hello", 5));
+    XCTAssertTrue(ring.push("", 0));
+    XCTAssertTrue(ring.push("World!!!", 8));
+    XCTAssertFalse(ring.empty());
+
+    XCTAssertEqual(view(ring.front()), "Hello");
+    ring.pop();
+    XCTAssertTrue(ring.front());
+    XCTAssertEqual(view(ring.front()), "");
+    ring.pop();
+    XCTAssertEqual(view(ring.front()), "World!!!");
+    ring.pop();
+
+    XCTAssertTrue(ring.empty());
+    XCTAssertFalse(ring.front());
+}
+
+- (void)testPushFull {
+    packet_ring ring(64);
+    std::string packet(20, 'a');
+
+    // Each packet takes 8 header bytes and 24 data bytes.
+    XCTAssertTrue(ring.push(packet.data(), packet.size()));
+    XCTAssertTrue(ring.push(packet.data(), packet.size()));
+    XCTAssertFalse(ring.push(packet.data(), packet.size()));
+    XCTAssertFalse(ring.push("", 0));
+
+    ring.pop();
+    XCTAssertTrue(ring.push(packet.data(), 16));
+}
+
+- (void)testPushTooLarge {
+    packet_ring ring(64);
+    std::string packet(64, 'a');
+    XCTAssertFalse(ring.push(packet.data(), packet.size()));
+    XCTAssertTrue(ring.push(packet.data(), 56));
+    XCTAssertEqual(view(ring.front()), std::string_view(packet.data(), 56));
+}
+
+- (void)testWrapAround {
+    packet_ring ring(128);
+    std::string first(24, 'a');
+    std::string second(24, 'b');
+    std::string third(24, 'c');
+    std::string fourth(40, 'd');
+
+    XCTAssertTrue(ring.push(first.data(), first.size()));
+    XCTAssertTrue(ring.push(second.data(), second.size()));
+    XCTAssertTrue(ring.push(third.data(), third.size()));
+    XCTAssertFalse(ring.push(fourth.data(), fourth.size()));
+
+    ring.pop();
+    ring.pop();
+
+    // Skips the last 32 bytes of the buffer and wraps to the start.
+    XCTAssertTrue(ring.push(fourth.data(), fourth.size()));
+
+    XCTAssertEqual(view(ring.front()), third);
+    ring.pop();
+    XCTAssertEqual(view(ring.front()), fourth);
+    ring.pop();
+    XCTAssertTrue(ring.empty());
+}
+
+- (void)testProducerConsumer {
+    packet_ring ring(1024);
+    constexpr size_t count = 100000;
+
+    std::thread producer([&]{
+        for (size_t i=0; i<count; ++i) {
+            std::string packet = std::to_string(i);
+
+            while (!ring.push(packet.data(), packet.size())) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    bool in_order = true;
+
+    for (size_t i=0; i<count; ++i) {
+        packet_ring::packet packet;
+
+        while (!(packet = ring.front())) {
+            std::this_thread::yield();
+        }
+
+        in_order &= view(packet) == std::to_string(i);
+        ring.pop();
+    }
+
+    producer.join();
+    XCTAssertTrue(in_order);
+    XCTAssertTrue(ring.empty());
+}
+
+@end
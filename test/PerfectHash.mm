@@ -0,0 +1,111 @@
+//
+//  Neovim Mac Test
+//  PerfectHash.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <XCTest/XCTest.h>
+#include "perfect_hash.hpp"
+
+@interface testPerfectHash : XCTestCase
+@end
+
+@implementation testPerfectHash
+
+- (void)testConstant {
+    static_assert(constant("") == 0);
+    static_assert(constant("a") == 0x61);
+    static_assert(constant("ab") == 0x6261);
+    static_assert(constant("\xff") == 0xff);
+
+    uint64_t value = 0;
+    memcpy(&value, "niI", 3);
+    XCTAssertEqual(constant("niI"), value);
+}
+
+- (void)testFind {
+    static constexpr auto map = make_perfect_hash_map<int>({
+        {"grid_line",          1},
+        {"grid_resize",        2},
+        {"grid_scroll",        3},
+        {"grid_clear",         4},
+        {"grid_destroy",       5},
+        {"grid_cursor_goto",   6},
+        {"default_colors_set", 7},
+        {"flush",              8},
+        {"win_pos",            9},
+        {"win_float_pos",      10},
+        {"win_external_pos",   11},
+        {"win_hide",           12},
+        {"win_close",          13},
+        {"msg_show",           14},
+        {"msg_clear",          15},
+        {"msg_history_show",   16},
+    });
+
+    static_assert(map.valid());
+    static_assert(map.find("grid_line") == 1);
+    static_assert(map.find("msg_history_show") == 16);
+
+    XCTAssertEqual(map.find("grid_resize"), 2);
+    XCTAssertEqual(map.find("win_float_pos"), 10);
+    XCTAssertEqual(map.find("flush"), 8);
+}
+
+- (void)testFindMissing {
+    static constexpr auto map = make_perfect_hash_map<const char*>({
+        {"redraw",      "redraw"},
+        {"colorscheme", "colorscheme"},
+        {"vimenter",    "vimenter"},
+    });
+
+    static_assert(map.valid());
+
+    XCTAssertEqual(map.find(""), nullptr);
+    XCTAssertEqual(map.find("redra"), nullptr);
+    XCTAssertEqual(map.find("redrawx"), nullptr);
+    XCTAssertEqual(map.find("vimleave"), nullptr);
+    XCTAssertEqual(std::string_view(map.find("colorscheme")), "colorscheme");
+}
+
+- (void)testCollidingKeys {
+    // Keys with the same length, head, and tail can't be separated.
+    constexpr auto map = make_perfect_hash_map<int>({
+        {"abcdefgh_1_abcdefgh", 1},
+        {"abcdefgh_2_abcdefgh", 2},
+    });
+
+    static_assert(!map.valid());
+}
+
+- (void)testFindPerformance {
+    static constexpr auto map = make_perfect_hash_map<int>({
+        {"grid_line",          1},
+        {"grid_resize",        2},
+        {"grid_scroll",        3},
+        {"grid_clear",         4},
+        {"flush",              5},
+        {"hl_attr_define",     6},
+        {"default_colors_set", 7},
+        {"mode_change",        8},
+    });
+
+    std::string_view names[] = {
+        "grid_line", "grid_scroll", "grid_line", "flush", "hl_attr_define"
+    };
+
+    [self measureBlock:^{
+        int64_t sum = 0;
+
+        for (int i=0; i<1000000; ++i) {
+            sum += map.find(names[i % 5]);
+        }
+
+        XCTAssertEqual(sum, 3200000);
+    }];
+}
+
+@end
@@ -0,0 +1,250 @@
+//
+//  Neovim Mac Test
+//  RedrawReplay.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#import <XCTest/XCTest.h>
+#import "NVGridView.h"
+#import "NVRenderContext.h"
+
+#include <string>
+#include "redraw_replay.hpp"
+
+using nvim::ui_controller;
+using nvim::redraw_replay;
+using nvim::replay_stats;
+
+/// Packs a capture, a stream of RPC messages as Neovim sends them.
+class capture_writer {
+private:
+    msg::packer packer;
+
+public:
+    /// Starts a redraw notification of count events.
+    void start_redraw(uint32_t count) {
+        packer.start_array(3);
+        packer.pack(2);
+        packer.pack_string("redraw");
+        packer.start_array(count);
+    }
+
+    void grid_resize(size_t width, size_t height) {
+        packer.start_array(2);
+        packer.pack_string("grid_resize");
+        packer.start_array(3);
+        packer.pack(1);
+        packer.pack(width);
+        packer.pack(height);
+    }
+
+    void grid_scroll(size_t top, size_t bottom, size_t width, int rows) {
+        packer.start_array(2);
+        packer.pack_string("grid_scroll");
+        packer.start_array(7);
+        packer.pack(1);
+        packer.pack(top);
+        packer.pack(bottom);
+        packer.pack(0);
+        packer.pack(width);
+        packer.pack(rows);
+        packer.pack(0);
+    }
+
+    /// Packs a grid_line event holding a single row of text, padded to width.
+    void grid_line(size_t row, std::string_view text, size_t width) {
+        packer.start_array(2);
+        packer.pack_string("grid_line");
+        packer.start_array(4);
+        packer.pack(1);
+        packer.pack(row);
+        packer.pack(0);
+        packer.start_array(static_cast<uint32_t>(text.size() + 1));
+
+        for (size_t i=0; i<text.size(); ++i) {
+            packer.start_array(2);
+            packer.pack_string(text.substr(i, 1));
+            packer.pack(1 + (i % 7 == 0));
+        }
+
+        packer.start_array(3);
+        packer.pack_string(" ");
+        packer.pack(0);
+        packer.pack(width - text.size());
+    }
+
+    void grid_cursor_goto(size_t row, size_t col) {
+        packer.start_array(2);
+        packer.pack_string("grid_cursor_goto");
+        packer.start_array(3);
+        packer.pack(1);
+        packer.pack(row);
+        packer.pack(col);
+    }
+
+    void flush() {
+        packer.start_array(2);
+        packer.pack_string("flush");
+        packer.start_array(0);
+    }
+
+    /// Packs a successful response to request id.
+    void response(uint32_t id) {
+        packer.start_array(4);
+        packer.pack(1);
+        packer.pack(id);
+        packer.pack_null();
+        packer.pack_null();
+    }
+
+    /// Packs a notification other than redraw.
+    void notification(std::string_view name) {
+        packer.start_array(3);
+        packer.pack(2);
+        packer.pack_string(name);
+        packer.start_array(0);
+    }
+
+    std::string data() const {
+        return std::string(packer.data(), packer.size());
+    }
+};
+
+/// Returns a capture of scrolling through a file one line per frame.
+static std::string scroll_capture(size_t width, size_t height, size_t frames) {
+    capture_writer capture;
+    std::string source = "    for (size_t i=0; i<count; ++i) { total += values[i]; }";
+
+    capture.response(1);
+    capture.start_redraw(height + 2);
+    capture.grid_resize(width, height);
+
+    for (size_t row=0; row<height; ++row) {
+        capture.grid_line(row, std::to_string(row) + source, width);
+    }
+
+    capture.flush();
+
+    for (size_t frame=0; frame<frames; ++frame) {
+        capture.start_redraw(4);
+        capture.grid_scroll(0, height - 1, width, 1);
+        capture.grid_line(height - 2, std::to_string(height + frame) + source, width);
+        capture.grid_cursor_goto(height - 2, 0);
+        capture.flush();
+    }
+
+    capture.notification("vimenter");
+    return capture.data();
+}
+
+@interface testRedrawReplay : XCTestCase<NVMetalDeviceDelegate>
+@end
+
+@implementation testRedrawReplay
+
+- (void)metalUnavailable {}
+- (void)metalDeviceFailedToInitialize:(NSString *)deviceName {}
+- (void)metalDevicesFailedToInitalize:(NSArray<NSString*> *)deviceNames
+                      hasAlternatives:(BOOL)hasAlternatives {}
+
+- (void)testReplay {
+    redraw_replay replay;
+    replay.assign(scroll_capture(20, 5, 10));
+
+    ui_controller ui;
+    ui.window = nvim::window_controller(nullptr);
+
+    size_t encoded = 0;
+    replay_stats stats = replay.run(ui, [&](const nvim::grid_set *grids) {
+        encoded += 1;
+    });
+
+    XCTAssertEqual(stats.packets, 13);
+    XCTAssertEqual(stats.notifications, 12);
+    XCTAssertEqual(stats.frames, 11);
+    XCTAssertEqual(encoded, 11);
+    XCTAssertEqual(stats.bytes, replay.data().size());
+    XCTAssertEqual(stats.frame_times.size(), 11);
+    XCTAssertLessThanOrEqual(stats.percentile(50).count(), stats.percentile(99).count());
+
+    const nvim::grid *grid = ui.get_global_grid();
+    XCTAssertEqual(grid->get(3, 0)->grapheme_view(), "1");
+    XCTAssertEqual(grid->get(3, 1)->grapheme_view(), "4");
+}
+
+- (void)testReplayTruncated {
+    std::string capture = scroll_capture(20, 5, 10);
+    capture.resize(capture.size() - 20);
+
+    redraw_replay replay;
+    replay.assign(capture);
+
+    ui_controller ui;
+    ui.window = nvim::window_controller(nullptr);
+
+    replay_stats stats = replay.run(ui, nullptr);
+    XCTAssertEqual(stats.packets, 11);
+    XCTAssertEqual(stats.frames, 10);
+}
+
+/// Replays a capture through an offscreen grid view, and logs the timings of
+/// each stage. Replays the capture at NVIM_MAC_REPLAY_CAPTURE if set, see
+/// +[NVPreferences redrawCaptureDirectory], otherwise a synthetic capture.
+- (void)testReplayPerformance {
+    redraw_replay replay;
+
+    if (const char *path = getenv("NVIM_MAC_REPLAY_CAPTURE")) {
+        XCTAssertEqual(replay.load(path), 0);
+    } else {
+        replay.assign(scroll_capture(200, 60, 300));
+    }
+
+    NVRenderContextOptions options = {};
+    options.rasterizerWidth = 512;
+    options.rasterizerHeight = 512;
+    options.cachePageWidth = 1024;
+    options.cachePageHeight = 1024;
+    options.cacheGrowthFactor = 1.5;
+    options.cacheInitialCapacity = 1;
+    options.cacheEvictionThreshold = 8;
+    options.cacheEvictionPreserve = 2;
+    options.glyphDilationBuckets = 4;
+
+    NVRenderContextManager *contextManager = [[NVRenderContextManager alloc] initWithOptions:options
+                                                                                    delegate:self];
+
+    NVRenderContext *renderContext = [contextManager defaultRenderContext];
+    auto descriptor = font_manager::default_descriptor();
+
+    NVGridView *gridView = [[NVGridView alloc] init];
+    gridView.renderContext = renderContext;
+    gridView.font = contextManager.fontManager->get(descriptor.get(), 12, 2);
+
+    ui_controller ui;
+    ui.window = nvim::window_controller(nullptr);
+
+    auto encode = [&](const nvim::grid_set *grids) {
+        @autoreleasepool {
+            gridView.grids = grids;
+
+            NSSize size = [gridView desiredFrameSize];
+
+            if (!NSEqualSizes(size, gridView.frame.size)) {
+                [gridView setFrameSize:size];
+            }
+
+            [gridView displayLayer:gridView.layer];
+            [renderContext commitFrame];
+        }
+    };
+
+    replay_stats stats = replay.run(ui, encode);
+    NSLog(@"%s", stats.report().c_str());
+
+    XCTAssertGreaterThan(stats.frames, 0);
+}
+
+@end
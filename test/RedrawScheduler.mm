@@ -0,0 +1,91 @@
+//
+//  Neovim Mac Test
+//  RedrawScheduler.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <XCTest/XCTest.h>
+#include "redraw_scheduler.hpp"
+
+@interface testRedrawScheduler : XCTestCase
+@end
+
+@implementation testRedrawScheduler
+
+- (void)testIdle {
+    redraw_scheduler scheduler;
+    XCTAssertFalse(scheduler.is_pending());
+    XCTAssertTrue(scheduler.refresh());
+    XCTAssertFalse(scheduler.begin_redraw());
+
+    redraw_stats stats = scheduler.stats();
+    XCTAssertEqual(stats.flushes, 0);
+    XCTAssertEqual(stats.redraws, 0);
+    XCTAssertEqual(stats.merged, 0);
+    XCTAssertEqual(stats.dropped, 0);
+}
+
+- (void)testMergedFlushes {
+    redraw_scheduler scheduler;
+    XCTAssertTrue(scheduler.flushed());
+    XCTAssertFalse(scheduler.flushed());
+    XCTAssertFalse(scheduler.flushed());
+    XCTAssertTrue(scheduler.is_pending());
+
+    XCTAssertTrue(scheduler.refresh());
+    XCTAssertTrue(scheduler.begin_redraw());
+    XCTAssertFalse(scheduler.is_pending());
+
+    // The next flush starts a new pending redraw.
+    XCTAssertTrue(scheduler.flushed());
+
+    redraw_stats stats = scheduler.stats();
+    XCTAssertEqual(stats.flushes, 4);
+    XCTAssertEqual(stats.redraws, 1);
+    XCTAssertEqual(stats.merged, 2);
+    XCTAssertEqual(stats.dropped, 0);
+}
+
+- (void)testDroppedRefreshes {
+    redraw_scheduler scheduler;
+    XCTAssertTrue(scheduler.flushed());
+    XCTAssertTrue(scheduler.refresh());
+
+    // The redraw is yet to run, so these refreshes are dropped.
+    XCTAssertFalse(scheduler.refresh());
+    XCTAssertFalse(scheduler.refresh());
+
+    XCTAssertTrue(scheduler.begin_redraw());
+
+    // Refreshes while nothing is pending aren't counted as dropped.
+    XCTAssertTrue(scheduler.refresh());
+    XCTAssertFalse(scheduler.refresh());
+    XCTAssertFalse(scheduler.begin_redraw());
+
+    redraw_stats stats = scheduler.stats();
+    XCTAssertEqual(stats.redraws, 1);
+    XCTAssertEqual(stats.dropped, 2);
+}
+
+- (void)testCancelledRefreshKeepsRedrawPending {
+    redraw_scheduler scheduler;
+    XCTAssertTrue(scheduler.flushed());
+    XCTAssertTrue(scheduler.refresh());
+    scheduler.cancel_refresh();
+
+    // The redraw is still pending, and refreshes are no longer dropped.
+    XCTAssertTrue(scheduler.is_pending());
+    XCTAssertFalse(scheduler.flushed());
+    XCTAssertTrue(scheduler.refresh());
+    XCTAssertTrue(scheduler.begin_redraw());
+
+    redraw_stats stats = scheduler.stats();
+    XCTAssertEqual(stats.redraws, 1);
+    XCTAssertEqual(stats.merged, 1);
+    XCTAssertEqual(stats.dropped, 0);
+}
+
+@end
@@ -0,0 +1,88 @@
+//
+//  Neovim Mac Test
+//  TripleBuffer.mm
+//
+//  Copyright © 2020 Jay Sandhu. All rights reserved.
+//  This file is distributed under the MIT License.
+//  See LICENSE.txt for details.
+//
+
+#include <thread>
+#include <vector>
+#include <XCTest/XCTest.h>
+
+#include "triple_buffer.hpp"
+
+@interface testTripleBuffer : XCTestCase
+@end
+
+@implementation testTripleBuffer
+
+- (void)testNothingPublished {
+    triple_buffer<std::vector<int>> buffer;
+    XCTAssertTrue(buffer.read().empty());
+    XCTAssertEqual(buffer.read_tick(), 0);
+}
+
+- (void)testReadLatest {
+    triple_buffer<int> buffer;
+    buffer.writing() = 1;
+    XCTAssertEqual(buffer.publish(), 1);
+    buffer.writing() = 2;
+    XCTAssertEqual(buffer.publish(), 2);
+    buffer.writing() = 3;
+    XCTAssertEqual(buffer.publish(), 3);
+
+    XCTAssertEqual(buffer.read(), 3);
+    XCTAssertEqual(buffer.read_tick(), 3);
+}
+
+- (void)testRereadWithoutPublish {
+    triple_buffer<int> buffer;
+    buffer.writing() = 1;
+    buffer.publish();
+
+    XCTAssertEqual(buffer.read(), 1);
+    XCTAssertEqual(buffer.read(), 1);
+    XCTAssertEqual(buffer.read(), 1);
+    XCTAssertEqual(buffer.read_tick(), 1);
+
+    buffer.writing() = 2;
+    buffer.publish();
+    XCTAssertEqual(buffer.read(), 2);
+    XCTAssertEqual(buffer.read(), 2);
+    XCTAssertEqual(buffer.read_tick(), 2);
+}
+
+- (void)testConcurrentTicksNeverGoBackwards {
+    struct snapshot {
+        uint64_t first;
+        uint64_t last;
+    };
+
+    triple_buffer<snapshot> buffer;
+    constexpr uint64_t count = 100000;
+
+    std::thread writer([&] {
+        for (uint64_t i=1; i<=count; ++i) {
+            snapshot &next = buffer.writing();
+            next.first = i;
+            next.last = i;
+            buffer.publish();
+        }
+    });
+
+    uint64_t previous = 0;
+
+    while (previous != count) {
+        const snapshot &current = buffer.read();
+        XCTAssertEqual(current.first, current.last);
+        XCTAssertGreaterThanOrEqual(current.first, previous);
+        XCTAssertEqual(buffer.read_tick(), current.first);
+        previous = current.first;
+    }
+
+    writer.join();
+}
+
+@end